@@ -0,0 +1,39 @@
+# - Find PCRE2
+# Find the PCRE2 includes and the library for 16 bit code units
+# This module defines
+#  PCRE2_INCLUDE_DIR, where to find pcre2.h
+#  PCRE2_LIBRARIES, the libraries needed to use PCRE2
+#  PCRE2_FOUND, if false, do not try to use PCRE2
+
+FIND_PATH(PCRE2_INCLUDE_DIR pcre2.h
+/usr/local/include
+/usr/include
+)
+
+FIND_LIBRARY(PCRE2_LIBRARY
+  NAMES pcre2-16
+  PATHS /usr/lib /usr/local/lib
+  )
+
+IF (PCRE2_LIBRARY AND PCRE2_INCLUDE_DIR)
+    SET(PCRE2_LIBRARIES ${PCRE2_LIBRARY})
+    SET(PCRE2_FOUND "YES")
+ELSE (PCRE2_LIBRARY AND PCRE2_INCLUDE_DIR)
+  SET(PCRE2_FOUND "NO")
+ENDIF (PCRE2_LIBRARY AND PCRE2_INCLUDE_DIR)
+
+
+IF (PCRE2_FOUND)
+   IF (NOT PCRE2_FIND_QUIETLY)
+      MESSAGE(STATUS "Found PCRE2: ${PCRE2_LIBRARIES}")
+   ENDIF (NOT PCRE2_FIND_QUIETLY)
+ELSE (PCRE2_FOUND)
+   IF (PCRE2_FIND_REQUIRED)
+      MESSAGE(FATAL_ERROR "Could not find PCRE2 library")
+   ENDIF (PCRE2_FIND_REQUIRED)
+ENDIF (PCRE2_FOUND)
+
+MARK_AS_ADVANCED(
+  PCRE2_LIBRARY
+  PCRE2_INCLUDE_DIR
+  )
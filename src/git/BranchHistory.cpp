@@ -0,0 +1,158 @@
+#include "BranchHistory.h"
+
+// entries per block, the most a lookup has to decode
+static const int blockSize = 32;
+
+static void appendVarint(QByteArray* out, unsigned long long value)
+{
+    while (value >= 0x80) 
+    {
+        out->append(char(value | 0x80));
+        value >>= 7;
+    }
+    
+    out->append(char(value));
+}
+
+static unsigned long long readVarint(const char** in)
+{
+    unsigned long long value = 0;
+    int shift = 0;
+    uchar byte;
+
+    do 
+    {
+        byte = uchar(*(*in)++);
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        shift += 7;
+    } 
+    while (byte & 0x80);
+
+    return value;
+}
+
+// deltas go either way: resets move a branch to any mark, or to none
+static unsigned long long zigzag(long long value)
+{
+    return (unsigned long long)(value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value)
+{
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+BranchHistory::BranchHistory() :
+    count(0),
+    lastRev(0),
+    lastMk(0)
+{
+}
+
+void BranchHistory::append(int revnum, unsigned long long mark)
+{
+    if (count % blockSize == 0) 
+    {
+        Block block;
+        block.revnum = revnum;
+        block.offset = deltas.size();
+        blocks.append(block);
+
+        appendVarint(&deltas, zigzag(revnum));
+        appendVarint(&deltas, mark);
+    }
+    else 
+    {
+        appendVarint(&deltas, zigzag((long long)revnum - lastRev));
+        appendVarint(&deltas, zigzag((long long)(mark - lastMk)));
+    }
+
+    ++count;
+    lastRev = revnum;
+    lastMk = mark;
+}
+
+bool BranchHistory::isEmpty() const
+{
+    return count == 0;
+}
+
+int BranchHistory::size() const
+{
+    return count;
+}
+
+int BranchHistory::lastRevision() const
+{
+    return lastRev;
+}
+
+unsigned long long BranchHistory::lastMark() const
+{
+    return lastMk;
+}
+
+bool BranchHistory::find(int revnum, int* foundRevnum, unsigned long long* mark) const
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    if (revnum >= lastRev) 
+    {
+        *foundRevnum = lastRev;
+        *mark = lastMk;
+        
+        return true;
+    }
+
+    // the last block starting at or before revnum
+    int low = 0;
+    int high = blocks.size();
+    
+    while (low < high) 
+    {
+        const int middle = (low + high) / 2;
+        
+        if (blocks.at(middle).revnum <= revnum)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low == 0)
+    {
+        return false;
+    }
+
+    const int block = low - 1;
+    const int entries = qMin(blockSize, count - block * blockSize);
+    const char* in = deltas.constData() + blocks.at(block).offset;
+
+    int rev = unzigzag(readVarint(&in));
+    unsigned long long mk = readVarint(&in);
+
+    for (int i = 1; i < entries; ++i) 
+    {
+        const int nextRev = rev + unzigzag(readVarint(&in));
+        const unsigned long long nextMark = mk + unzigzag(readVarint(&in));
+
+        if (nextRev > revnum)
+        {
+            break;
+        }
+
+        rev = nextRev;
+        mk = nextMark;
+    }
+
+    *foundRevnum = rev;
+    *mark = mk;
+    
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRANCH_HISTORY_H
+#define BRANCH_HISTORY_H
+
+#include <QVector>
+#include <QByteArray>
+
+/**
+ * The marks a branch pointed to after each revision that changed it, in
+ * the order they were added. Entries are varint deltas against the one
+ * before, grouped in blocks that start with absolute values, so a lookup
+ * is a binary search over the blocks plus a short scan.
+ */
+class BranchHistory
+{
+
+public:
+
+    BranchHistory();
+
+    void append(int revnum, unsigned long long mark);
+
+    bool isEmpty() const;
+    int size() const;
+    int lastRevision() const;
+    unsigned long long lastMark() const;
+
+    // the last entry at or before revnum, false if there is none
+    bool find(int revnum, int* foundRevnum, unsigned long long* mark) const;
+
+private:
+
+    struct Block
+    {
+        int revnum;
+        int offset;
+    };
+
+    QVector<Block> blocks;
+    QByteArray deltas;
+    int count;
+    int lastRev;
+    unsigned long long lastMk;
+};
+
+Q_DECLARE_TYPEINFO(BranchHistory, Q_MOVABLE_TYPE);
+
+#endif
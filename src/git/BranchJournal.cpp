@@ -0,0 +1,315 @@
+#include "BranchJournal.h"
+
+#include <QDebug>
+#include <QtEndian>
+
+#include <zlib.h>
+#include <string.h>
+
+static const char magic[] = "SVN2GITJ";
+static const quint32 version = 1;
+static const int headerSize = 16;
+
+// "<payload length><payload><crc32 of the payload>", all little endian
+static const int framingSize = 8;
+
+enum RecordKind
+{
+    BranchRecord = 'B',
+    RevisionRecord = 'R'
+};
+
+static bool validHeader(const uchar* header)
+{
+    return memcmp(header, magic, 8) == 0 && qFromLittleEndian<quint32>(header + 8) == version;
+}
+
+static quint32 checksum(const uchar* data, qint64 length)
+{
+    return crc32(crc32(0L, Z_NULL, 0), data, length);
+}
+
+BranchJournal::BranchJournal(const QString& fileName) :
+    file(fileName),
+    data(0),
+    size(0),
+    pos(0),
+    lastRecord(-1),
+    truncateAt(-1),
+    appending(false)
+{
+}
+
+BranchJournal::~BranchJournal()
+{
+    close();
+    flush();
+}
+
+bool BranchJournal::exists() const
+{
+    return file.exists();
+}
+
+bool BranchJournal::open()
+{
+    close();
+    ids.clear();
+    names.clear();
+    nameOffsets.clear();
+    truncateAt = -1;
+    lastRecord = -1;
+
+    if (!file.isOpen() && !file.open(QIODevice::ReadWrite))
+    {
+        return false;
+    }
+
+    size = file.size();
+    
+    if (size < headerSize)
+    {
+        return false;
+    }
+
+    data = file.map(0, size);
+    
+    if (!data)
+    {
+        return false;
+    }
+
+    if (!validHeader(data)) 
+    {
+        close();
+        return false;
+    }
+
+    pos = headerSize;
+    
+    return true;
+}
+
+bool BranchJournal::next(int* revnum, QString* branch, unsigned long long* mark)
+{
+    while (data && pos < size) 
+    {
+        const qint64 start = pos;
+        
+        if (size - pos < framingSize)
+        {
+            break;
+        }
+
+        const qint64 length = qFromLittleEndian<quint32>(data + pos);
+        
+        if (length < 1 || size - pos - framingSize < length)
+        {
+            break;
+        }
+
+        const uchar* payload = data + pos + 4;
+        
+        if (qFromLittleEndian<quint32>(payload + length) != checksum(payload, length))
+        {
+            break;
+        }
+
+        pos += length + framingSize;
+
+        if (payload[0] == BranchRecord && length >= 5) 
+        {
+            const quint32 id = qFromLittleEndian<quint32>(payload + 1);
+            const QString name = QString::fromUtf8(reinterpret_cast<const char*>(payload + 5), length - 5);
+
+            if (id >= quint32(names.size())) 
+            {
+                names.resize(id + 1);
+                nameOffsets.resize(id + 1);
+            }
+            
+            names[id] = name;
+            nameOffsets[id] = start;
+            ids.insert(name, id);
+        }
+        else if (payload[0] == RevisionRecord && length == 17) 
+        {
+            const quint32 id = qFromLittleEndian<quint32>(payload + 5);
+            
+            if (id >= quint32(names.size()) || nameOffsets.at(id) == 0)
+            {
+                break;
+            }
+
+            *revnum = qFromLittleEndian<qint32>(payload + 1);
+            *branch = names.at(id);
+            *mark = qFromLittleEndian<quint64>(payload + 9);
+            lastRecord = start;
+            
+            return true;
+        }
+        else 
+        {
+            pos = start;
+            break;
+        }
+    }
+
+    if (data && pos < size) 
+    {
+        // most likely the last run died while writing this
+        qWarning() << "WARN: dropping" << size - pos << "bytes at the end of" << file.fileName();
+        truncateAt = pos;
+    }
+
+    return false;
+}
+
+void BranchJournal::close()
+{
+    if (data) 
+    {
+        file.unmap(const_cast<uchar*>(data));
+        data = 0;
+    }
+}
+
+void BranchJournal::truncateAtLast()
+{
+    if (lastRecord != -1)
+    {
+        truncateAt = lastRecord;
+    }
+}
+
+void BranchJournal::keepAll()
+{
+    truncateAt = -1;
+}
+
+bool BranchJournal::openForAppend()
+{
+    if (appending)
+    {
+        return true;
+    }
+
+    close();
+
+    if (!file.isOpen() && !file.open(QIODevice::ReadWrite))
+    {
+        qFatal("Failed to open %s: %s", qPrintable(file.fileName()), qPrintable(file.errorString()));
+    }
+
+    QByteArray header(headerSize, '\0');
+    file.seek(0);
+    
+    if (file.read(header.data(), headerSize) != headerSize || !validHeader(reinterpret_cast<const uchar*>(header.constData()))) 
+    {
+        // nothing usable in there, start over
+        ids.clear();
+        names.clear();
+        nameOffsets.clear();
+
+        header = QByteArray(magic, 8);
+        header.resize(headerSize);
+        qToLittleEndian<quint32>(version, reinterpret_cast<uchar*>(header.data()) + 8);
+        qToLittleEndian<quint32>(0, reinterpret_cast<uchar*>(header.data()) + 12);
+
+        file.resize(0);
+        file.write(header);
+    }
+    else if (truncateAt != -1) 
+    {
+        file.resize(truncateAt);
+
+        // names first written in the dropped part have to be written again
+        for (int id = 0; id < nameOffsets.size(); ++id) 
+        {
+            if (nameOffsets.at(id) >= truncateAt)
+            {
+                ids.remove(names.at(id));
+            }
+        }
+    }
+
+    truncateAt = -1;
+    file.seek(file.size());
+    appending = true;
+    
+    return true;
+}
+
+void BranchJournal::writeRecord(const QByteArray& payload)
+{
+    QByteArray record(framingSize + payload.size(), '\0');
+    uchar* out = reinterpret_cast<uchar*>(record.data());
+    
+    qToLittleEndian<quint32>(payload.size(), out);
+    memcpy(out + 4, payload.constData(), payload.size());
+    qToLittleEndian<quint32>(checksum(out + 4, payload.size()), out + 4 + payload.size());
+
+    if (file.write(record) != record.size())
+    {
+        qFatal("Failed to write %s: %s", qPrintable(file.fileName()), qPrintable(file.errorString()));
+    }
+}
+
+void BranchJournal::append(int revnum, const QString& branch, unsigned long long mark)
+{
+    openForAppend();
+
+    QHash<QString, quint32>::ConstIterator it = ids.constFind(branch);
+    quint32 id;
+    
+    if (it == ids.constEnd()) 
+    {
+        // a new number, names from the dropped part must not be reused
+        id = names.size();
+        names.append(branch);
+        nameOffsets.append(file.pos());
+        ids.insert(branch, id);
+
+        const QByteArray name = branch.toUtf8();
+        QByteArray payload(5, '\0');
+        payload[0] = char(BranchRecord);
+        qToLittleEndian<quint32>(id, reinterpret_cast<uchar*>(payload.data()) + 1);
+        payload.append(name);
+        
+        writeRecord(payload);
+    }
+    else 
+    {
+        id = *it;
+    }
+
+    QByteArray payload(17, '\0');
+    uchar* out = reinterpret_cast<uchar*>(payload.data());
+    out[0] = RevisionRecord;
+    qToLittleEndian<qint32>(revnum, out + 1);
+    qToLittleEndian<quint32>(id, out + 5);
+    qToLittleEndian<quint64>(mark, out + 9);
+    
+    writeRecord(payload);
+}
+
+void BranchJournal::flush()
+{
+    if (appending && !file.flush())
+    {
+        qFatal("Failed to write %s: %s", qPrintable(file.fileName()), qPrintable(file.errorString()));
+    }
+}
+
+void BranchJournal::remove()
+{
+    close();
+    
+    if (file.isOpen())
+    {
+        file.close();
+    }
+    
+    appending = false;
+    file.remove();
+}
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRANCH_JOURNAL_H
+#define BRANCH_JOURNAL_H
+
+#include <QHash>
+#include <QFile>
+#include <QVector>
+#include <QString>
+
+/**
+ * The branch tips after each exported revision, what setupIncremental()
+ * needs to resume: an append-only binary file with a header, made of
+ * records with their own length and CRC, so a torn write at the end is
+ * recognized and dropped. Branch names are written once and referred to
+ * by number. Loading maps the file instead of reading it line by line,
+ * and cutting the history at a revision only takes effect once the run
+ * appends its first record, so nothing has to be backed up for
+ * restoreLog().
+ */
+class BranchJournal
+{
+
+public:
+
+    BranchJournal(const QString& fileName);
+    ~BranchJournal();
+
+    bool exists() const;
+
+    // reading, from the beginning; false when the file is not a journal
+    bool open();
+    bool next(int* revnum, QString* branch, unsigned long long* mark);
+    void close();
+
+    // forgets the record next() returned last and everything after it,
+    // as soon as something is appended
+    void truncateAtLast();
+    void keepAll();
+
+    void append(int revnum, const QString& branch, unsigned long long mark);
+    void flush();
+    void remove();
+
+private:
+
+    bool openForAppend();
+    void writeRecord(const QByteArray& payload);
+
+    QFile file;
+
+    // while reading
+    const uchar* data;
+    qint64 size;
+    qint64 pos;
+    qint64 lastRecord;
+
+    // where the records to drop start, -1 to keep everything
+    qint64 truncateAt;
+
+    QHash<QString, quint32> ids;
+    QVector<QString> names;
+    QVector<qint64> nameOffsets;
+
+    bool appending;
+
+    Q_DISABLE_COPY(BranchJournal)
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "CheckpointScheduler.h"
+
+#include <QFile>
+#include <QList>
+
+#include <unistd.h>
+
+#include "commandline/CommandLineParser.h"
+
+// fast-import's memory is read at most this often, in milliseconds
+static const qint64 memoryCheckInterval = 1000;
+
+CheckpointScheduler* CheckpointScheduler::instance()
+{
+    static CheckpointScheduler scheduler;
+    return &scheduler;
+}
+
+CheckpointScheduler::CheckpointScheduler() :
+    lastCheckpoint(-1)
+{
+    CommandLineParser* args = CommandLineParser::instance();
+
+    commitInterval = args->optionArgument(QLatin1String("commit-interval"), QLatin1String("10000")).toInt();
+    byteInterval = args->optionArgument(QLatin1String("checkpoint-bytes"), QLatin1String("0")).toLongLong() * 1024 * 1024;
+    timeInterval = args->optionArgument(QLatin1String("checkpoint-interval"), QLatin1String("0")).toLongLong() * 1000;
+    memoryGrowth = args->optionArgument(QLatin1String("checkpoint-memory"), QLatin1String("0")).toLongLong() * 1024 * 1024;
+    gap = args->optionArgument(QLatin1String("checkpoint-gap"), QLatin1String("1000")).toLongLong();
+
+    if (commitInterval <= 0)
+    {
+        commitInterval = 10000;
+    }
+
+    clock.start();
+}
+
+int CheckpointScheduler::addRepository()
+{
+    // spreads the phases evenly however many repositories there are
+    const double phase = repositories.size() * 0.6180339887;
+    const double fraction = phase - qint64(phase);
+
+    Repository r;
+    r.commits = int(commitInterval * fraction);
+    r.bytes = -qint64(byteInterval * fraction);
+    r.time = clock.elapsed() - qint64(timeInterval * fraction);
+    r.memory = -1;
+    r.memoryChecked = 0;
+    repositories.append(r);
+
+    return repositories.size() - 1;
+}
+
+bool CheckpointScheduler::checkpointDue(int repository, qint64 bytes, qint64 pid)
+{
+    Repository& r = repositories[repository];
+    const qint64 now = clock.elapsed();
+    bool due = false;
+    bool overdue = false;
+
+    ++r.commits;
+    
+    if (r.commits >= commitInterval) 
+    {
+        due = true;
+        overdue = r.commits >= 2 * commitInterval;
+    }
+
+    if (byteInterval > 0 && bytes - r.bytes >= byteInterval) 
+    {
+        due = true;
+        overdue = overdue || bytes - r.bytes >= 2 * byteInterval;
+    }
+
+    if (timeInterval > 0 && now - r.time >= timeInterval) 
+    {
+        due = true;
+        overdue = overdue || now - r.time >= 2 * timeInterval;
+    }
+
+    if (memoryGrowth > 0 && pid > 0 && now - r.memoryChecked >= memoryCheckInterval) 
+    {
+        r.memoryChecked = now;
+        const qint64 memory = residentSize(pid);
+
+        // measured against what was left right after the last checkpoint
+        if (r.memory < 0 || memory < r.memory)
+        {
+            r.memory = memory;
+        }
+        else if (memory - r.memory >= memoryGrowth)
+        {
+            due = overdue = true;
+        }
+    }
+
+    if (!due)
+    {
+        return false;
+    }
+
+    return overdue || lastCheckpoint < 0 || now - lastCheckpoint >= gap;
+}
+
+void CheckpointScheduler::checkpointed(int repository, qint64 bytes)
+{
+    Repository& r = repositories[repository];
+    
+    lastCheckpoint = clock.elapsed();
+    r.commits = 0;
+    r.bytes = bytes;
+    r.time = lastCheckpoint;
+    r.memory = -1;
+}
+
+qint64 CheckpointScheduler::residentSize(qint64 pid)
+{
+    QFile statm(QString("/proc/%1/statm").arg(pid));
+    
+    if (!statm.open(QIODevice::ReadOnly))
+    {
+        return 0;
+    }
+
+    // "size resident shared ...", in pages
+    QList<QByteArray> fields = statm.readAll().split(' ');
+
+    return fields.value(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_SCHEDULER_H
+#define CHECKPOINT_SCHEDULER_H
+
+#include <QVector>
+#include <QElapsedTimer>
+
+/**
+ * Decides when the repositories write a checkpoint. One is due after
+ * --commit-interval transactions, --checkpoint-interval seconds or
+ * --checkpoint-bytes megabytes sent to git, or once git-fast-import grew
+ * by --checkpoint-memory megabytes since the last one. Every repository
+ * starts at its own phase of these intervals, and a due checkpoint waits
+ * while another repository checkpointed less than --checkpoint-gap
+ * milliseconds ago, unless it is twice overdue. That way repositories
+ * that move together don't all checkpoint in the same revision.
+ */
+class CheckpointScheduler
+{
+
+public:
+
+    static CheckpointScheduler* instance();
+
+    // the handle to pass to the other calls
+    int addRepository();
+
+    // called for every transaction; bytes is what the repository sent to
+    // git so far, pid the process whose memory counts or 0
+    bool checkpointDue(int repository, qint64 bytes, qint64 pid);
+
+    // the repository wrote a checkpoint
+    void checkpointed(int repository, qint64 bytes);
+
+private:
+
+    struct Repository
+    {
+        int commits;
+        qint64 bytes;
+        qint64 time;
+        qint64 memory;
+        qint64 memoryChecked;
+    };
+
+    CheckpointScheduler();
+
+    // resident size of a process in bytes, 0 if unknown
+    static qint64 residentSize(qint64 pid);
+
+    QVector<Repository> repositories;
+    QElapsedTimer clock;
+    qint64 lastCheckpoint;
+
+    int commitInterval;
+    qint64 byteInterval;
+    qint64 timeInterval;
+    qint64 memoryGrowth;
+    qint64 gap;
+};
+
+#endif
@@ -3,7 +3,10 @@
 #include <QDir>
 #include <QDebug>
 
+#include <string.h>
+
 #include "GitProcessCache.h"
+#include "CheckpointScheduler.h"
 #include "rules/RuleRepository.h"
 #include "commandline/CommandLineParser.h"
 #include "FastImportGitRepositoryTransaction.h"
@@ -12,11 +15,19 @@ FastImportGitRepository::FastImportGitRepository(const RuleRepository& rule) :
     name(rule.getName()),
     prefix(rule.getForwardTo()),
     fastImport(name),
-    commitCount(0),
     outstandingTransactions(0),
+    checkpoints(CheckpointScheduler::instance()->addRepository()),
+    pendingNoteCount(0),
+    notesInterval(qMax(1, CommandLineParser::instance()->optionArgument(QLatin1String("notes-interval"), QLatin1String("1000")).toInt())),
+    notesTime(0),
     last_commit_mark(0),
     next_file_mark(maxMark),
-    processHasStarted(false)
+    dedupBlobs(CommandLineParser::instance()->contains(QLatin1String("dedup-blobs"))),
+    copyTrees(false),
+    processHasStarted(false),
+    journal(journalFileName(rule.getName())),
+    useJournal(!CommandLineParser::instance()->contains("dry-run") && !CommandLineParser::instance()->contains("create-dump")),
+    journalConverted(false)
 {
     foreach (RuleRepository::Branch branchRule, rule.getBranches()) 
     {
@@ -29,32 +40,19 @@ FastImportGitRepository::FastImportGitRepository(const RuleRepository& rule) :
     // create the default branch
     branches["master"].created = 1;
 
+    // the trees are looked up with "ls", which a dump file can't answer
+    if (CommandLineParser::instance()->contains(QLatin1String("copy-trees")) && !CommandLineParser::instance()->contains("dry-run") && !CommandLineParser::instance()->contains("create-dump"))
+    {
+        copyTrees = true;
+    }
+
     fastImport.setWorkingDirectory(name);
+    catFile.setWorkingDirectory(name);
     
     if (!CommandLineParser::instance()->contains("dry-run") && !CommandLineParser::instance()->contains("create-dump")) 
     {
-        if (!QDir(name).exists()) 
+        if (initRepository(rule)) 
         { 
-            // repo doesn't exist yet.
-            qDebug() << "Creating new repository" << name;
-            QDir::current().mkpath(name);
-            QProcess init;
-            init.setWorkingDirectory(name);
-            init.start("git", QStringList() << "--bare" << "init");
-            init.waitForFinished(-1);
-            
-            // Write description
-            if (!rule.getDescription().isEmpty()) 
-            {
-                QFile fDesc(QDir(name).filePath("description"));
-                if (fDesc.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) 
-                {
-                    fDesc.write(rule.getDescription().toUtf8());
-                    fDesc.putChar('\n');
-                    fDesc.close();
-                }
-            }
-            
             QFile marks(name + "/" + marksFileName(name));
             marks.open(QIODevice::WriteOnly);
             marks.close();
@@ -90,6 +88,14 @@ QString FastImportGitRepository::logFileName(QString name)
     return name;
 }
 
+QString FastImportGitRepository::journalFileName(QString name)
+{
+    name.replace('/', '_');
+    name.prepend("journal-");
+    
+    return name;
+}
+
 unsigned long long FastImportGitRepository::lastValidMark(const QString& name)
 {
     QFile marksfile(name + "/" + marksFileName(name));
@@ -102,29 +108,56 @@ unsigned long long FastImportGitRepository::lastValidMark(const QString& name)
     qDebug()  << "marksfile " << marksfile.fileName();
     unsigned long long prev_mark = 0;
 
+    const qint64 size = marksfile.size();
+    
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    // ":<mark> <sha1>" lines, millions of them: scan the bytes in place
+    const char *data = reinterpret_cast<const char *>(marksfile.map(0, size));
+    
+    if (!data) 
+    {
+        qCritical() << marksfile.fileName() << "cannot be mapped:" << marksfile.errorString();
+        return 0;
+    }
+
+    const char *end = data + size;
+    const char *p = data;
     int lineno = 0;
-    while (!marksfile.atEnd()) 
+
+    while (p < end) 
     {
-        QString line = marksfile.readLine();
-        ++lineno;
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
         
-        if (line.isEmpty())
+        if (!eol)
         {
-            continue;
+            eol = end;
         }
+        
+        ++lineno;
 
         unsigned long long mark = 0;
-        if (line[0] == ':') 
+        
+        if (*p == ':') 
         {
-            int sp = line.indexOf(' ');
+            const char *digit = p + 1;
             
-            if (sp != -1) 
+            while (digit < eol && *digit >= '0' && *digit <= '9')
             {
-                QString m = line.mid(1, sp-1);
-                mark = m.toULongLong();
+                mark = mark * 10 + (*digit++ - '0');
+            }
+
+            if (digit == eol || *digit != ' ')
+            {
+                mark = 0;
             }
         }
 
+        p = eol + 1;
+
         if (!mark) 
         {
             qCritical() << marksfile.fileName() << "line" << lineno << "marks file corrupt?" << "mark " << mark;
@@ -157,7 +190,131 @@ unsigned long long FastImportGitRepository::lastValidMark(const QString& name)
     return prev_mark;
 }
 
+void FastImportGitRepository::addRevision(Branch& br, const QString& branch, int revnum, unsigned long long mark)
+{
+    br.history.append(revnum, mark);
+
+    if (useJournal)
+    {
+        journal.append(revnum, branch, mark);
+    }
+}
+
 int FastImportGitRepository::setupIncremental(int& cutoff)
+{
+    if (useJournal && journal.exists() && journal.open())
+    {
+        return setupFromJournal(cutoff);
+    }
+
+    return setupFromLog(cutoff);
+}
+
+int FastImportGitRepository::setupFromJournal(int& cutoff)
+{
+    unsigned long long last_valid_mark = lastValidMark(name);
+
+    int last_revnum = 0;
+    bool truncated = false;
+    int revnum;
+    QString branch;
+    unsigned long long mark;
+
+    while (journal.next(&revnum, &branch, &mark)) 
+    {
+        if (revnum >= cutoff)
+        {
+            truncated = true;
+            break;
+        }
+
+        if (revnum < last_revnum)
+        {
+            qWarning() << "WARN:" << name << "revision numbers are not monotonic: got" << QString::number(last_revnum) << "and then" << QString::number(revnum);
+        }
+
+        if (mark > last_valid_mark) 
+        {
+            qWarning() << "WARN:" << name << "unknown commit mark found: rewinding -- did you hit Ctrl-C?";
+            cutoff = revnum;
+            truncated = true;
+            break;
+        }
+
+        last_revnum = revnum;
+
+        if (last_commit_mark < mark)
+            last_commit_mark = mark;
+
+        Branch &br = branches[branch];
+        if (!br.created || !mark || !br.history.lastMark())
+            br.created = revnum;
+        br.history.append(revnum, mark);
+    }
+
+    journal.close();
+
+    if (!truncated)
+    {
+        if (last_revnum + 1 == cutoff)
+        {
+            // don't let restoreLog() bring back a log of an earlier run
+            QFile::remove(logFileName(name) + ".old");
+        }
+
+        return last_revnum + 1;
+    }
+
+    // the records stay until the first new one is written, restoreLog() only has to keep them
+    qDebug() << name << "truncating history to revision" << cutoff;
+    journal.truncateAtLast();
+
+    // the log still gets the progress lines, so it has to drop the same revisions
+    truncateLog(cutoff);
+    
+    return cutoff;
+}
+
+void FastImportGitRepository::truncateLog(int cutoff)
+{
+    QFile logfile(logFileName(name));
+    
+    if (!logfile.open(QIODevice::ReadWrite))
+    {
+        return;
+    }
+
+    QRegExp progress("progress SVN r(\\d+) branch (.*) = :(\\d+)");
+
+    while (!logfile.atEnd()) 
+    {
+        qint64 pos = logfile.pos();
+        QByteArray line = logfile.readLine();
+        int hash = line.indexOf('#');
+        
+        if (hash != -1)
+        {
+            line.truncate(hash);
+        }
+        
+        line = line.trimmed();
+
+        if (!progress.exactMatch(line) || progress.cap(1).toInt() < cutoff)
+        {
+            continue;
+        }
+
+        // backup file, restoreLog() puts it back if the run fails
+        QString bkup = logfile.fileName() + ".old";
+        QFile::remove(bkup);
+        logfile.copy(bkup);
+
+        logfile.resize(pos);
+        return;
+    }
+}
+
+int FastImportGitRepository::setupFromLog(int& cutoff)
 {
     QFile logfile(logFileName(name));
     
@@ -177,6 +334,15 @@ int FastImportGitRepository::setupIncremental(int& cutoff)
     int retval = 0;
     QString bkup = logfile.fileName() + ".old";
 
+    // the journal is written from the log once, and used from then on
+    journalConverted = useJournal;
+    
+    if (journalConverted) 
+    {
+        qDebug() << name << "converting" << logfile.fileName() << "into" << journalFileName(name);
+        journal.remove();
+    }
+
     while (!logfile.atEnd()) 
     {
         pos = logfile.pos();
@@ -227,10 +393,15 @@ int FastImportGitRepository::setupIncremental(int& cutoff)
             last_commit_mark = mark;
 
         Branch &br = branches[branch];
-        if (!br.created || !mark || br.marks.isEmpty() || !br.marks.last())
+        if (!br.created || !mark || !br.history.lastMark())
             br.created = revnum;
-        br.commits.append(revnum);
-        br.marks.append(mark);
+        addRevision(br, branch, revnum, mark);
+    }
+
+    // a retry in main() sets up a new repository from the journal right away
+    if (journalConverted)
+    {
+        journal.flush();
     }
 
     retval = last_revnum + 1;
@@ -247,6 +418,11 @@ int FastImportGitRepository::setupIncremental(int& cutoff)
 
 beyond_cutoff:
 
+    if (journalConverted)
+    {
+        journal.flush();
+    }
+
     // backup file, since we'll truncate
     QFile::remove(bkup);
     logfile.copy(bkup);
@@ -261,6 +437,16 @@ beyond_cutoff:
 
 void FastImportGitRepository::restoreLog()
 {
+    if (journalConverted) 
+    {
+        // the next run converts the restored log again
+        journal.remove();
+    }
+    else
+    {
+        journal.keepAll();
+    }
+
     QString file = logFileName(name);
     QString bkup = file + ".old";
     
@@ -276,8 +462,61 @@ void FastImportGitRepository::restoreLog()
 void FastImportGitRepository::doCheckpoint()
 {
     qDebug() << "checkpoint!, marks file trunkated";
+
+    flushNotes();
+
+    // the journal may run ahead of the marks, never behind them
+    journal.flush();
+
+    // only queued for the pipe, git-fast-import writes the pack while we go on
     fastImport.write("checkpoint\n");
-    fastImport.waitForBytesWritten(-1);
+    CheckpointScheduler::instance()->checkpointed(checkpoints, fastImport.bytesSent());
+}
+
+void FastImportGitRepository::queueNote(const QByteArray& target, const QByteArray& text, const QByteArray& author, uint dt, const QByteArray& message)
+{
+    // a later note for the same target replaces the earlier one, as it
+    // did when every note was a commit of its own
+    pendingNotes << "N inline " << target << '\n';
+    pendingNotes.data(text) << '\n';
+
+    notesAuthor = author;
+    notesTime = dt;
+    notesMessage = message;
+
+    if (++pendingNoteCount >= notesInterval)
+    {
+        flushNotes();
+    }
+}
+
+void FastImportGitRepository::flushNotes()
+{
+    if (!pendingNoteCount)
+    {
+        return;
+    }
+
+    startFastImport();
+
+    command << "commit refs/notes/commits\nmark ";
+    command.mark(maxMark + 1) << "\ncommitter " << notesAuthor << ' ';
+    command.number(notesTime) << " +0000\n";
+
+    if (pendingNoteCount == 1)
+    {
+        command.data(notesMessage);
+    }
+    else
+    {
+        command.data("Adding Git notes for " + QByteArray::number(pendingNoteCount) + " commits\n");
+    }
+
+    command << '\n' << pendingNotes;
+    command.writeTo(&fastImport);
+
+    pendingNotes.clear();
+    pendingNoteCount = 0;
 }
 
 void FastImportGitRepository::closeFastImport()
@@ -288,7 +527,7 @@ void FastImportGitRepository::closeFastImport()
         
         // Give the signal to close up shop.
         fastImport.write("done\n");
-        fastImport.closeWriteChannel();
+        fastImport.closeInputChannel();
         
         if (!fastImport.waitForFinished(-1))
         {
@@ -303,6 +542,7 @@ void FastImportGitRepository::closeFastImport()
         }
     }
     
+    fastImport.closeResponseChannel();
     processHasStarted = false;
     processCache.remove(this);
 }
@@ -314,27 +554,26 @@ void FastImportGitRepository::reloadBranches()
     {
         Branch &br = branches[branch];
 
-        if (br.marks.isEmpty() || !br.marks.last())
+        if (!br.history.lastMark())
         {
             continue;
         }
 
 	reset_notes = true;
 
-        QByteArray branchRef = branch.toUtf8();
-        
-        if (!branchRef.startsWith("refs/"))
-        {
-            branchRef.prepend("refs/heads/");
-        }
-
-        fastImport.write("reset " + branchRef + "\nfrom :" + QByteArray::number(br.marks.last()) + "\n\nprogress Branch " + branchRef + " reloaded\n");
+        command << "reset ";
+        command.ref(branch) << "\nfrom ";
+        command.mark(br.history.lastMark()) << "\n\nprogress Branch ";
+        command.ref(branch) << " reloaded\n";
     }
 
     if (reset_notes && CommandLineParser::instance()->contains("add-metadata-notes")) 
     {
-        fastImport.write("reset refs/notes/commits\nfrom :" + QByteArray::number(maxMark + 1) + "\n");
+        command << "reset refs/notes/commits\nfrom ";
+        command.mark(maxMark + 1) << '\n';
     }
+
+    command.writeTo(&fastImport);
 }
 
 long long FastImportGitRepository::markFrom(const QString& branchFrom, int branchRevNum, QByteArray& branchFromDesc)
@@ -346,25 +585,24 @@ long long FastImportGitRepository::markFrom(const QString& branchFrom, int branc
         return -1;
     }
 
-    if (brFrom.commits.isEmpty()) 
+    if (brFrom.history.isEmpty()) 
     {
         return -1;
     }
     
-    if (branchRevNum == brFrom.commits.last()) 
+    if (branchRevNum == brFrom.history.lastRevision()) 
     {
-        return brFrom.marks.last();
+        return brFrom.history.lastMark();
     }
 
-    QVector<int>::const_iterator it = qUpperBound(brFrom.commits, branchRevNum);
+    int closestCommit;
+    unsigned long long mark;
     
-    if (it == brFrom.commits.begin()) 
+    if (!brFrom.history.find(branchRevNum, &closestCommit, &mark)) 
     {
         return 0;
     }
 
-    int closestCommit = *--it;
-
     if (!branchFromDesc.isEmpty()) 
     {
         branchFromDesc += " at r" + QByteArray::number(branchRevNum);
@@ -375,7 +613,7 @@ long long FastImportGitRepository::markFrom(const QString& branchFrom, int branc
         }
     }
 
-    return brFrom.marks[it - brFrom.commits.begin()];
+    return mark;
 }
 
 int FastImportGitRepository::createBranch(const QString& branch, int revnum, const QString& branchFrom, int branchRevNum)
@@ -428,9 +666,9 @@ int FastImportGitRepository::resetBranch(const QString& branch, int revnum, unsi
     }
 
     Branch &br = branches[branch];
-    QByteArray backupCmd;
+    FastImportSerializer &cmd = (comment == "delete") ? deletedBranches : resetBranches;
     
-    if (br.created && br.created != revnum && !br.marks.isEmpty() && br.marks.last()) 
+    if (br.created && br.created != revnum && br.history.lastMark()) 
     {
         QByteArray backupBranch;
         if ((comment == "delete") && branchRef.startsWith("refs/heads/"))
@@ -444,23 +682,15 @@ int FastImportGitRepository::resetBranch(const QString& branch, int revnum, unsi
         
         qWarning() << "WARN: backing up branch" << branch << "to" << backupBranch;
 
-        backupCmd = "reset " + backupBranch + "\nfrom " + branchRef + "\n\n";
+        cmd << "reset " << backupBranch << "\nfrom " << branchRef << "\n\n";
     }
 
     br.created = revnum;
-    br.commits.append(revnum);
-    br.marks.append(mark);
+    addRevision(br, branch, revnum, mark);
 
-    QByteArray cmd = "reset " + branchRef + "\nfrom " + resetTo + "\n\nprogress SVN r" + QByteArray::number(revnum) + " branch " + branch.toUtf8() + " = :" + QByteArray::number(mark) + " # " + comment + "\n\n";
-    
-    if(comment == "delete")
-    {
-        deletedBranches.append(backupCmd).append(cmd);
-    }
-    else
-    {
-        resetBranches.append(backupCmd).append(cmd);
-    }
+    cmd << "reset " << branchRef << "\nfrom " << resetTo << "\n\nprogress SVN r";
+    cmd.number(revnum) << " branch " << branch << " = ";
+    cmd.mark(mark) << " # " << comment << "\n\n";
 
     return EXIT_SUCCESS;
 }
@@ -473,10 +703,8 @@ void FastImportGitRepository::commit()
     }
     
     startFastImport();
-    fastImport.write(deletedBranches);
-    fastImport.write(resetBranches);
-    deletedBranches.clear();
-    resetBranches.clear();
+    deletedBranches.writeTo(&fastImport);
+    resetBranches.writeTo(&fastImport);
 }
 
 GitRepositoryTransaction* FastImportGitRepository::newTransaction(const QString& branch, const QString& svnprefix, int revnum)
@@ -492,12 +720,14 @@ GitRepositoryTransaction* FastImportGitRepository::newTransaction(const QString&
     txn->svnprefix = svnprefix.toUtf8();
     txn->datetime = 0;
     txn->revnum = revnum;
+    txn->treeCopied = false;
+    txn->deleteAll = false;
+    txn->deletionCount = 0;
+    txn->modificationCount = 0;
 
-    if ((++commitCount % CommandLineParser::instance()->optionArgument(QLatin1String("commit-interval"), QLatin1String("10000")).toInt()) == 0) 
+    if (CheckpointScheduler::instance()->checkpointDue(checkpoints, fastImport.bytesSent(), fastImport.state() == QProcess::Running ? qint64(fastImport.pid()) : 0)) 
     {
         startFastImport();
-        
-        // write everything to disk every 10000 commits
         doCheckpoint();
     }
     
@@ -506,9 +736,60 @@ GitRepositoryTransaction* FastImportGitRepository::newTransaction(const QString&
     return txn;
 }
 
+bool FastImportGitRepository::hasBlob(const QByteArray& id)
+{
+    if (knownBlobs.contains(id))
+    {
+        return true;
+    }
+
+    if (missingBlobs.contains(id))
+    {
+        return false;
+    }
+
+    // sees what git-fast-import wrote up to its last checkpoint, and
+    // whatever the repository borrows through objects/info/alternates
+    if (catFile.state() == QProcess::NotRunning) 
+    {
+        catFile.start("git", QStringList() << "cat-file" << "--batch-check");
+        
+        if (!catFile.waitForStarted(-1)) 
+        {
+            qWarning() << "WARN: cannot start git cat-file for repository" << name << ":" << catFile.errorString();
+            missingBlobs.insert(id);
+            
+            return false;
+        }
+    }
+
+    catFile.write(id.toHex() + "\n");
+    catFile.waitForBytesWritten(-1);
+
+    while (!catFile.canReadLine())
+    {
+        if (!catFile.waitForReadyRead(-1))
+        {
+            missingBlobs.insert(id);
+            return false;
+        }
+    }
+
+    // "<sha1> <type> <size>", or "<sha1> missing"
+    if (catFile.readLine().split(' ').value(1) == "blob") 
+    {
+        knownBlobs.insert(id);
+        return true;
+    }
+
+    missingBlobs.insert(id);
+    
+    return false;
+}
+
 void FastImportGitRepository::forgetTransaction(FastImportGitRepositoryTransaction* )
 {
-    if (!--outstandingTransactions)
+    if (!--outstandingTransactions && !dedupBlobs)
     {
         next_file_mark = maxMark;
     }
@@ -544,6 +825,14 @@ void FastImportGitRepository::createAnnotatedTag(const QString& ref, const QStri
 void FastImportGitRepository::close()
 {
 	closeFastImport();
+
+    if (catFile.state() != QProcess::NotRunning) 
+    {
+        catFile.closeWriteChannel();
+        catFile.waitForFinished(-1);
+    }
+
+    GitBlobIndex::instance()->flush();
 }
 
 void FastImportGitRepository::finalizeTags()
@@ -573,24 +862,12 @@ void FastImportGitRepository::finalizeTags()
             message += "\n" + formatMetadataMessage(tag.svnprefix, tag.revnum, tagName.toUtf8());
         }
 
-        QByteArray branchRef = tag.supportingRef.toUtf8();
-        
-        if (!branchRef.startsWith("refs/"))
-        {
-            branchRef.prepend("refs/heads/");
-        }
-
-        QByteArray s = "progress Creating annotated tag " + tagName.toUtf8() + " from ref " + branchRef + "\n" + "tag " + tagName.toUtf8() + "\n" + "from " + branchRef + "\n" + "tagger " + tag.author + ' ' + QByteArray::number(tag.dt) + " +0000" + "\n" + "data " + QByteArray::number( message.length() ) + "\n";
-        
-        fastImport.write(s);
-
-        fastImport.write(message);
-        fastImport.putChar('\n');
-        
-        if (!fastImport.waitForBytesWritten(-1))
-        {
-            qFatal("Failed to write to process: %s", qPrintable(fastImport.errorString()));
-        }
+        command << "progress Creating annotated tag " << tagName << " from ref ";
+        command.ref(tag.supportingRef) << "\ntag " << tagName << "\nfrom ";
+        command.ref(tag.supportingRef) << "\ntagger " << tag.author << ' ';
+        command.number(tag.dt) << " +0000\n";
+        command.data(message) << '\n';
+        command.writeTo(&fastImport);
 
         // Append note to the tip commit of the supporting ref. There is no
         // easy way to attach a note to the tag itself with fast-import.
@@ -601,11 +878,6 @@ void FastImportGitRepository::finalizeTags()
             txn->setDateTime(tag.dt);
             txn->commitNote(formatMetadataMessage(tag.svnprefix, tag.revnum, tagName.toUtf8()), true);
             delete txn;
-
-            if (!fastImport.waitForBytesWritten(-1))
-            {
-                qFatal("Failed to write to process: %s", qPrintable(fastImport.errorString()));
-            }
         }
 
         printf(" %s", qPrintable(tagName));
@@ -613,45 +885,10 @@ void FastImportGitRepository::finalizeTags()
         fflush(stdout);
     }
 
-    while (fastImport.bytesToWrite())
-    {
-        if (!fastImport.waitForBytesWritten(-1))
-        {
-            qFatal("Failed to write to process: %s", qPrintable(fastImport.errorString()));
-        }
-    }
-    
     printf("\n");
 }
 
 
-const QByteArray FastImportGitRepository::msgFilter(const QByteArray& msg)
-{
-    QByteArray output = msg;
-
-    if (CommandLineParser::instance()->contains("msg-filter")) 
-    {
-	if (filterMsg.state() == QProcess::Running)
-        {
-	    qFatal("filter process already running?");
-        }
-
-	filterMsg.start(CommandLineParser::instance()->optionArgument("msg-filter"));
-
-	if(!(filterMsg.waitForStarted(-1)))
-        {
-	    qFatal("Failed to Start Filter %d %s", __LINE__, qPrintable(filterMsg.errorString()));
-        }
-
-	filterMsg.write(msg);
-	filterMsg.closeWriteChannel();
-	filterMsg.waitForFinished();
-	output = filterMsg.readAllStandardOutput();
-    }
-    
-    return output;
-}
-
 void FastImportGitRepository::startFastImport()
 {
     processCache.touch(this);
@@ -679,6 +916,24 @@ void FastImportGitRepository::startFastImport()
             marksOptions << "--max-pack-size=" + maxPackSize;
         }
 
+        if (copyTrees) 
+        {
+            if (fastImport.openResponseChannel())
+            {
+                marksOptions << "--cat-blob-fd=3";
+            }
+            else
+            {
+                qWarning() << "WARN: cannot create a pipe for git-fast-import answers, not copying trees";
+                copyTrees = false;
+            }
+        }
+
+        if (!fastImport.openInputChannel())
+        {
+            qWarning() << "WARN: cannot create a pipe for git-fast-import input, writing to it synchronously";
+        }
+
         fastImport.setStandardOutputFile(logFileName(name), QIODevice::Append);
         fastImport.setProcessChannelMode(QProcess::MergedChannels);
 
@@ -697,11 +952,56 @@ void FastImportGitRepository::startFastImport()
     }
 }
 
+QByteArray FastImportGitRepository::treeAt(unsigned long long mark, const QByteArray& path)
+{
+    startFastImport();
+    command << "ls ";
+    command.mark(mark) << ' ';
+    
+    if (path.isEmpty())
+    {
+        command << "\"\"";
+    }
+    else
+    {
+        command << path;
+    }
+    
+    command << '\n';
+    command.writeTo(&fastImport);
+
+    QByteArray response;
+    
+    if (!fastImport.readResponseLine(&response)) 
+    {
+        qWarning() << "WARN: git-fast-import for repository" << name << "did not answer, not copying trees anymore";
+        copyTrees = false;
+        return QByteArray();
+    }
+
+    // "040000 tree <sha1>\t<path>", or "missing <path>"
+    static const QByteArray treePrefix("040000 tree ");
+    int tab = response.indexOf('\t');
+    
+    if (!response.startsWith(treePrefix) || tab < 0)
+    {
+        return QByteArray();
+    }
+
+    return response.mid(treePrefix.length(), tab - treePrefix.length());
+}
+
 bool FastImportGitRepository::branchExists(const QString& branch) const
 {
     return branches.contains(branch);
 }
 
+bool FastImportGitRepository::hasCommitFrom(const QString& branch, int revnum)
+{
+    QByteArray dummy;
+    return markFrom(branch, revnum, dummy) > 0;
+}
+
 const QByteArray FastImportGitRepository::branchNote(const QString& branch) const
 {
     return branches.value(branch).note;
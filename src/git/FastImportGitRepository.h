@@ -19,10 +19,14 @@
 #ifndef FAST_IMPORT_GIT_REPOSITORY_H
 #define FAST_IMPORT_GIT_REPOSITORY_H
 
-#include <QVector>
+#include <QSet>
 #include <QProcess>
 
 #include "GitRepository.h"
+#include "GitBlobIndex.h"
+#include "BranchJournal.h"
+#include "BranchHistory.h"
+#include "FastImportSerializer.h"
 #include "logging/LoggingQProcess.h"
 
 class GitRepositoryTransaction;
@@ -38,8 +42,7 @@ public:
     struct Branch
     {
         int created;
-        QVector<int> commits;
-        QVector<int> marks;
+        BranchHistory history;
         QByteArray note;
     };
     
@@ -59,6 +62,7 @@ public:
     void commit();
     
     bool branchExists(const QString& branch) const;
+    bool hasCommitFrom(const QString& branch, int revnum);
     const QByteArray branchNote(const QString& branch) const;
     void setBranchNote(const QString& branch, const QByteArray& noteText);
     bool hasPrefix() const;
@@ -79,12 +83,28 @@ private:
     
     static QString marksFileName(QString name);
     static QString logFileName(QString name);
+    static QString journalFileName(QString name);
     static unsigned long long lastValidMark(const QString& name);
 
+    int setupFromJournal(int &cutoff);
+    int setupFromLog(int &cutoff);
+    void truncateLog(int cutoff);
+    void addRevision(Branch &br, const QString &branch, int revnum, unsigned long long mark);
+
     void doCheckpoint();
     void startFastImport();
+
+    // notes go out together as one commit on refs/notes/commits, see flushNotes()
+    void queueNote(const QByteArray &target, const QByteArray &text, const QByteArray &author, uint dt, const QByteArray &message);
+    void flushNotes();
     void closeFastImport();
 
+    // sha1 of the tree at path in the commit with the given mark, null if it is not a tree
+    QByteArray treeAt(unsigned long long mark, const QByteArray &path);
+
+    // whether M can name the blob by its id instead of sending it
+    bool hasBlob(const QByteArray &id);
+
     // called when a transaction is deleted
     void forgetTransaction(FastImportGitRepositoryTransaction *t);
 
@@ -97,23 +117,51 @@ private:
     QString name;
     QString prefix;
     LoggingQProcess fastImport;
-    int commitCount;
     int outstandingTransactions;
-    QByteArray deletedBranches;
-    QByteArray resetBranches;
+    int checkpoints;
+    FastImportSerializer deletedBranches;
+    FastImportSerializer resetBranches;
+
+    /* the command being built, reused for all of them */
+    FastImportSerializer command;
 
-    /* Optional filter to fix up log messages */
-    QProcess filterMsg;
-    const QByteArray msgFilter(const QByteArray& msg);
+    /* "N" commands waiting for the next notes commit */
+    FastImportSerializer pendingNotes;
+    int pendingNoteCount;
+    int notesInterval;
+    QByteArray notesAuthor;
+    uint notesTime;
+    QByteArray notesMessage;
 
     /* starts at 0, and counts up.  */
     unsigned long long last_commit_mark;
 
-    /* starts at maxMark and counts down. Reset after each SVN revision */
+    /* starts at maxMark and counts down. Reset after each SVN revision,
+       unless blobs are deduplicated: their marks must stay valid */
     unsigned long long next_file_mark;
 
+    /* marks of the blobs sent so far, by content checksum */
+    QHash<QByteArray, unsigned long long> blobMarks;
+    bool dedupBlobs;
+
+    /* copied directories reuse the git tree of their source */
+    bool copyTrees;
+
+    /* blobs of the --blob-index sent in this run or found in the repository */
+    QSet<QByteArray> knownBlobs;
+    QSet<QByteArray> missingBlobs;
+    GitBlobHashDevice blobHasher;
+    QProcess catFile;
+
     bool processHasStarted;
 
+    /* where setupIncremental() finds the branches, see BranchJournal */
+    BranchJournal journal;
+    bool useJournal;
+
+    /* written from the log in this run, the log is what restoreLog() restores */
+    bool journalConverted;
+
     friend class GitProcessCache;
     friend class FastImportGitRepositoryTransaction;
     Q_DISABLE_COPY(FastImportGitRepository)
@@ -1,6 +1,7 @@
 #include "FastImportGitRepositoryTransaction.h"
 
 #include <QDebug>
+#include <QVarLengthArray>
 
 #include "commandline/CommandLineParser.h"
 
@@ -69,43 +70,167 @@ void FastImportGitRepositoryTransaction::deleteFile(const QString& path)
     {
         pathNoSlash.chop(1);
     }
+
+    if (treeCopied) 
+    {
+        if (pathNoSlash.isEmpty())
+        {
+            modifications << "deleteall\n";
+        }
+        else
+        {
+            modifications << "D " << pathNoSlash << '\n';
+        }
+
+        ++modificationCount;
+        return;
+    }
+
+    if (pathNoSlash.isEmpty())
+    {
+        deleteAll = true;
+    }
+    else
+    {
+        deletions << "D " << pathNoSlash << '\n';
+    }
     
-    deletedFiles.append(pathNoSlash);
+    ++deletionCount;
 }
 
-QIODevice* FastImportGitRepositoryTransaction::addFile(const QString& path, int mode, qint64 length)
+QIODevice* FastImportGitRepositoryTransaction::addFile(const QString& path, int mode, qint64 length, const QByteArray& contentKey)
 {
     unsigned long long mark = repository->next_file_mark--;
 
     // in case the two mark allocations meet, we might as well just abort
     Q_ASSERT(mark > repository->last_commit_mark + 1);
 
-    if (modifiedFiles.capacity() == 0)
+    modifyFile(path, mode, mark);
+
+    if (repository->dedupBlobs && !contentKey.isEmpty())
     {
-        modifiedFiles.reserve(2048);
+        repository->blobMarks.insert(contentKey, mark);
     }
-    
-    modifiedFiles.append("M ");
-    modifiedFiles.append(QByteArray::number(mode, 8));
-    modifiedFiles.append(" :");
-    modifiedFiles.append(QByteArray::number(mark));
-    modifiedFiles.append(' ');
-    modifiedFiles.append(repository->prefix + path.toUtf8());
-    modifiedFiles.append("\n");
 
     if (!CommandLineParser::instance()->contains("dry-run")) 
     {
         repository->startFastImport();
-        repository->fastImport.writeNoLog("blob\nmark :");
-        repository->fastImport.writeNoLog(QByteArray::number(mark));
-        repository->fastImport.writeNoLog("\ndata ");
-        repository->fastImport.writeNoLog(QByteArray::number(length));
-        repository->fastImport.writeNoLog("\n", 1);
+
+        FastImportSerializer &s = repository->command;
+        s << "blob\nmark ";
+        s.mark(mark) << "\ndata ";
+        s.number(length) << '\n';
+        s.writeNoLogTo(&repository->fastImport);
+
+        if (GitBlobIndex::instance()->isEnabled() && !contentKey.isEmpty()) 
+        {
+            repository->blobHasher.start(&repository->fastImport, length, contentKey, &repository->knownBlobs);
+            return &repository->blobHasher;
+        }
     }
 
     return &repository->fastImport;
 }
 
+bool FastImportGitRepositoryTransaction::addExistingFile(const QString& path, int mode, const QByteArray& contentKey)
+{
+    if (contentKey.isEmpty())
+    {
+        return false;
+    }
+
+    if (repository->dedupBlobs) 
+    {
+        QHash<QByteArray, unsigned long long>::ConstIterator it = repository->blobMarks.constFind(contentKey);
+        
+        if (it != repository->blobMarks.constEnd()) 
+        {
+            modifyFile(path, mode, *it);
+            return true;
+        }
+    }
+
+    // sent by an earlier run, maybe to another repository
+    QByteArray id = GitBlobIndex::instance()->lookup(contentKey);
+    
+    if (id.isEmpty() || !repository->hasBlob(id))
+    {
+        return false;
+    }
+
+    modifyFile(path, mode, id);
+    
+    return true;
+}
+
+bool FastImportGitRepositoryTransaction::copyTree(const QString& branchFrom, int revFrom, const QString& pathFrom, const QString& path)
+{
+    if (!repository->copyTrees)
+    {
+        return false;
+    }
+
+    QByteArray dummy;
+    long long mark = repository->markFrom(branchFrom, revFrom, dummy);
+    
+    if (mark <= 0)
+    {
+        return false;
+    }
+
+    QByteArray source = (repository->prefix + pathFrom).toUtf8();
+    QByteArray target = (repository->prefix + path).toUtf8();
+    
+    if (source.endsWith('/'))
+    {
+        source.chop(1);
+    }
+    
+    if (target.endsWith('/'))
+    {
+        target.chop(1);
+    }
+
+    QByteArray tree = repository->treeAt(mark, source);
+    
+    if (tree.isEmpty())
+    {
+        return false;
+    }
+
+    modifications << "M 040000 " << tree << ' ';
+    
+    if (target.isEmpty())
+    {
+        modifications << "\"\"";
+    }
+    else
+    {
+        modifications << target;
+    }
+    
+    modifications << '\n';
+    ++modificationCount;
+    treeCopied = true;
+    
+    return true;
+}
+
+void FastImportGitRepositoryTransaction::modifyFile(const QString& path, int mode, unsigned long long mark)
+{
+    modifications << "M ";
+    modifications.octal(mode) << ' ';
+    modifications.mark(mark) << ' ' << repository->prefix << path << '\n';
+    ++modificationCount;
+}
+
+void FastImportGitRepositoryTransaction::modifyFile(const QString& path, int mode, const QByteArray& id)
+{
+    modifications << "M ";
+    modifications.octal(mode) << ' ' << id.toHex() << ' ' << repository->prefix << path << '\n';
+    ++modificationCount;
+}
+
 void FastImportGitRepositoryTransaction::commitNote(const QByteArray& noteText, bool append, const QByteArray& commit = QByteArray())
 {
     QByteArray branchRef = branch;
@@ -125,16 +250,27 @@ void FastImportGitRepositoryTransaction::commitNote(const QByteArray& noteText,
         message = "Appending Git note for current " + commitRef + "\n";
     }
 
-    QByteArray s("");
-    s.append("commit refs/notes/commits\n");
-    s.append("mark :" + QByteArray::number(maxMark + 1) + "\n");
-    s.append("committer " + author + " " + QString::number(datetime) + " +0000" + "\n");
-    s.append("data " + QString::number(message.length()) + "\n");
-    s.append(message + "\n");
-    s.append("N inline " + commitRef + "\n");
-    s.append("data " + QString::number(text.length()) + "\n");
-    s.append(text + "\n");
-    repository->fastImport.write(s);
+    // the branch may move on before the notes are written, so name its
+    // current commit by mark rather than by ref
+    QByteArray target = commitRef;
+    unsigned long long tip = 0;
+
+    if (commit.isNull())
+    {
+        tip = repository->branches.value(QString::fromUtf8(branch)).history.lastMark();
+
+        if (tip)
+        {
+            target = ':' + QByteArray::number(tip);
+        }
+    }
+
+    repository->queueNote(target, text, author, datetime, message);
+
+    if (commit.isNull() && !tip)
+    {
+        repository->flushNotes();
+    }
 
     if (commit.isNull()) 
     {
@@ -172,9 +308,9 @@ void FastImportGitRepositoryTransaction::commit()
     unsigned long long parentmark = 0;
     FastImportGitRepository::Branch &br = repository->branches[branch];
     
-    if (br.created && !br.marks.isEmpty() && br.marks.last()) 
+    if (br.created && br.history.lastMark()) 
     {
-        parentmark = br.marks.last();
+        parentmark = br.history.lastMark();
     } 
     else 
     {
@@ -183,32 +319,24 @@ void FastImportGitRepositoryTransaction::commit()
         br.created = revnum;
     }
     
-    br.commits.append(revnum);
-    br.marks.append(mark);
+    repository->addRevision(br, QString::fromUtf8(branch), revnum, mark);
 
-    QByteArray branchRef = branch;
-    
-    if (!branchRef.startsWith("refs/"))
-    {
-        branchRef.prepend("refs/heads/");
-    }
-
-    QByteArray s("");
-    s.append("commit " + branchRef + "\n");
-    s.append("mark :" + QByteArray::number(mark) + "\n");
-    s.append("committer " + author + " " + QString::number(datetime).toUtf8() + " +0000" + "\n");
-    s.append("data " + QString::number(message.length()) + "\n");
-    s.append(message + "\n");
-    repository->fastImport.write(s);
+    FastImportSerializer &s = repository->command;
+    s << "commit ";
+    s.ref(branch) << "\nmark ";
+    s.mark(mark) << "\ncommitter " << author << ' ';
+    s.number(datetime) << " +0000\n";
+    s.data(message) << '\n';
 
     // note some of the inferred merges
-    QByteArray desc = "";
+    QVarLengthArray<unsigned long long, 16> desc;
     unsigned long long i = !!parentmark;	// if parentmark != 0, there's at least one parent
 
     if(log.contains("This commit was manufactured by cvs2svn") && merges.count() > 1) 
     {
         qSort(merges);
-        repository->fastImport.write("merge :" + QByteArray::number(merges.last()) + "\n");
+        s << "merge ";
+        s.mark(merges.last()) << '\n';
         merges.pop_back();
         qWarning() << "WARN: Discarding all but the highest merge point as a workaround for cvs2svn created branch/tag Discarded marks:" << merges;
     } 
@@ -234,43 +362,46 @@ void FastImportGitRepositoryTransaction::commit()
                 break;
             }
 
-            QByteArray m = " :" + QByteArray::number(merge);
-            desc += m;
-            repository->fastImport.write("merge" + m + "\n");
+            desc.append(merge);
+            s << "merge ";
+            s.mark(merge) << '\n';
         }
     }
     
     // write the file deletions
-    if (deletedFiles.contains(""))
+    if (deleteAll)
     {
-        repository->fastImport.write("deleteall\n");
+        s << "deleteall\n";
     }
     else
     {
-        foreach (QString df, deletedFiles)
-        {
-            repository->fastImport.write("D " + df.toUtf8() + "\n");
-        }
+        s << deletions;
     }
 
     // write the file modifications
-    repository->fastImport.write(modifiedFiles);
+    s << modifications << "\nprogress SVN r";
+    s.number(revnum) << " branch " << branch << " = ";
+    s.mark(mark);
 
-    repository->fastImport.write("\nprogress SVN r" + QByteArray::number(revnum) + " branch " + branch + " = :" + QByteArray::number(mark) + (desc.isEmpty() ? "" : " # merge from") + desc + "\n\n");
+    if (!desc.isEmpty()) 
+    {
+        s << " # merge from";
+        
+        for (int m = 0; m < desc.size(); ++m) 
+        {
+            s << ' ';
+            s.mark(desc[m]);
+        }
+    }
     
-    printf(" %d modifications from SVN %s to %s/%s", deletedFiles.count() + modifiedFiles.count('\n'), svnprefix.data(), qPrintable(repository->name), branch.data());
+    s << "\n\n";
+    s.writeTo(&repository->fastImport);
+    
+    printf(" %d modifications from SVN %s to %s/%s", deletionCount + modificationCount, svnprefix.data(), qPrintable(repository->name), branch.data());
 
     // Commit metadata note if requested
     if (CommandLineParser::instance()->contains("add-metadata-notes"))
     {
         commitNote(GitRepository::formatMetadataMessage(svnprefix, revnum), false);
     }
-
-    while (repository->fastImport.bytesToWrite())
-    {
-        if (!repository->fastImport.waitForBytesWritten(-1))
-        {
-            qFatal("Failed to write to process: %s for repository %s", qPrintable(repository->fastImport.errorString()), qPrintable(repository->name));
-        }
-    }
 }
@@ -21,9 +21,9 @@
 
 #include <QVector>
 #include <QByteArray>
-#include <QStringList>
 
 #include "GitRepositoryTransaction.h"
+#include "FastImportSerializer.h"
 
 #include "FastImportGitRepository.h"
 
@@ -45,7 +45,9 @@ public:
     void noteCopyFromBranch (const QString &prevbranch, int revFrom);
 
     void deleteFile(const QString &path);
-    QIODevice *addFile(const QString &path, int mode, qint64 length);
+    QIODevice *addFile(const QString &path, int mode, qint64 length, const QByteArray &contentKey = QByteArray());
+    bool addExistingFile(const QString &path, int mode, const QByteArray &contentKey);
+    bool copyTree(const QString &branchFrom, int revFrom, const QString &pathFrom, const QString &path);
 
     void commitNote(const QByteArray &noteText, bool append, const QByteArray &commit);
     
@@ -62,9 +64,19 @@ private:
 
     QVector<int> merges;
 
-    QStringList deletedFiles;
-    QByteArray modifiedFiles;
+    FastImportSerializer deletions;
+    FastImportSerializer modifications;
+    bool deleteAll;
+    int deletionCount;
+    int modificationCount;
+
+    // once a tree was copied, deletions have to stay in order with the modifications
+    bool treeCopied;
     
+    // by the mark of a blob, or by the id of one the repository has
+    void modifyFile(const QString &path, int mode, unsigned long long mark);
+    void modifyFile(const QString &path, int mode, const QByteArray &id);
+
     inline FastImportGitRepositoryTransaction() {}
     
     friend class FastImportGitRepository;
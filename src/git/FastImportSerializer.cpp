@@ -0,0 +1,166 @@
+#include "FastImportSerializer.h"
+
+#include <string.h>
+
+#include "logging/LoggingQProcess.h"
+
+// what a commit with a few files fits into
+static const int initialSize = 4096;
+
+FastImportSerializer::FastImportSerializer() :
+    used(0)
+{
+}
+
+void FastImportSerializer::grow(int length)
+{
+    int size = qMax(buffer.size(), initialSize);
+    
+    while (size < used + length)
+    {
+        size *= 2;
+    }
+
+    buffer.resize(size);
+}
+
+void FastImportSerializer::append(const char* bytes, int length)
+{
+    reserve(length);
+    memcpy(buffer.data() + used, bytes, length);
+    used += length;
+}
+
+FastImportSerializer& FastImportSerializer::operator<<(const QString& text)
+{
+    // QString::toUtf8() without the temporary
+    const int length = text.length();
+    reserve(length * 3);
+
+    const ushort* in = text.utf16();
+    uchar* out = reinterpret_cast<uchar*>(buffer.data()) + used;
+
+    for (int i = 0; i < length; ++i) 
+    {
+        uint c = in[i];
+
+        if (c < 0x80) 
+        {
+            *out++ = c;
+        }
+        else if (c < 0x800) 
+        {
+            *out++ = 0xc0 | (c >> 6);
+            *out++ = 0x80 | (c & 0x3f);
+        }
+        else if ((c & 0xfc00) == 0xd800 && i + 1 < length && (in[i + 1] & 0xfc00) == 0xdc00) 
+        {
+            c = 0x10000 + ((c - 0xd800) << 10) + (in[++i] - 0xdc00);
+            *out++ = 0xf0 | (c >> 18);
+            *out++ = 0x80 | ((c >> 12) & 0x3f);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        }
+        else 
+        {
+            *out++ = 0xe0 | (c >> 12);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        }
+    }
+
+    used = out - reinterpret_cast<uchar*>(buffer.data());
+    
+    return *this;
+}
+
+FastImportSerializer& FastImportSerializer::number(unsigned long long value)
+{
+    char digits[20];
+    int pos = sizeof(digits);
+
+    do 
+    {
+        digits[--pos] = '0' + value % 10;
+        value /= 10;
+    } 
+    while (value);
+
+    append(digits + pos, sizeof(digits) - pos);
+    
+    return *this;
+}
+
+FastImportSerializer& FastImportSerializer::octal(unsigned int value)
+{
+    char digits[11];
+    int pos = sizeof(digits);
+
+    do 
+    {
+        digits[--pos] = '0' + (value & 7);
+        value >>= 3;
+    } 
+    while (value);
+
+    append(digits + pos, sizeof(digits) - pos);
+    
+    return *this;
+}
+
+FastImportSerializer& FastImportSerializer::mark(unsigned long long value)
+{
+    *this << ':';
+    
+    return number(value);
+}
+
+FastImportSerializer& FastImportSerializer::ref(const QByteArray& branch)
+{
+    if (!branch.startsWith("refs/"))
+    {
+        *this << "refs/heads/";
+    }
+
+    return *this << branch;
+}
+
+FastImportSerializer& FastImportSerializer::ref(const QString& branch)
+{
+    if (!branch.startsWith(QLatin1String("refs/")))
+    {
+        *this << "refs/heads/";
+    }
+
+    return *this << branch;
+}
+
+FastImportSerializer& FastImportSerializer::data(const QByteArray& payload)
+{
+    *this << "data ";
+    number(payload.size());
+    
+    return *this << '\n' << payload;
+}
+
+FastImportSerializer& FastImportSerializer::path(const QString& prefix, const QString& path)
+{
+    if (prefix.isEmpty() && path.isEmpty())
+    {
+        return *this << "\"\"";
+    }
+
+    return *this << prefix << path;
+}
+
+void FastImportSerializer::writeTo(LoggingQProcess* process)
+{
+    process->write(buffer.constData(), used);
+    used = 0;
+}
+
+void FastImportSerializer::writeNoLogTo(LoggingQProcess* process)
+{
+    process->writeNoLog(buffer.constData(), used);
+    used = 0;
+}
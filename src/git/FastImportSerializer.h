@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAST_IMPORT_SERIALIZER_H
+#define FAST_IMPORT_SERIALIZER_H
+
+#include <QString>
+#include <QByteArray>
+
+class LoggingQProcess;
+
+/**
+ * Builds git-fast-import commands in a buffer that is kept between
+ * commands, so writing one does not allocate once the buffer has grown
+ * to size. Keywords are string literals whose length is known at compile
+ * time; numbers and UTF-8 are written straight into the buffer.
+ */
+class FastImportSerializer
+{
+
+public:
+
+    FastImportSerializer();
+
+    template <int N>
+    inline FastImportSerializer& operator<<(const char (&keyword)[N])
+    {
+        append(keyword, N - 1);
+        return *this;
+    }
+
+    inline FastImportSerializer& operator<<(char c)
+    {
+        reserve(1);
+        buffer.data()[used++] = c;
+        return *this;
+    }
+
+    inline FastImportSerializer& operator<<(const QByteArray& bytes)
+    {
+        append(bytes.constData(), bytes.size());
+        return *this;
+    }
+
+    FastImportSerializer& operator<<(const QString& text);
+
+    inline FastImportSerializer& operator<<(const FastImportSerializer& other)
+    {
+        append(other.buffer.constData(), other.used);
+        return *this;
+    }
+
+    FastImportSerializer& number(unsigned long long value);
+    FastImportSerializer& octal(unsigned int value);
+    FastImportSerializer& mark(unsigned long long value);
+
+    // the branch with refs/heads/ in front unless it is a full ref already
+    FastImportSerializer& ref(const QByteArray& branch);
+    FastImportSerializer& ref(const QString& branch);
+
+    // "data <length>\n<payload>"
+    FastImportSerializer& data(const QByteArray& payload);
+
+    // a path of a file command, "" for the root
+    FastImportSerializer& path(const QString& prefix, const QString& path);
+
+    inline const char* constData() const
+    {
+        return buffer.constData();
+    }
+
+    inline int size() const
+    {
+        return used;
+    }
+
+    inline bool isEmpty() const
+    {
+        return used == 0;
+    }
+
+    // keeps the memory for the next command
+    inline void clear()
+    {
+        used = 0;
+    }
+
+    // sends the buffer to git-fast-import and clears it
+    void writeTo(LoggingQProcess* process);
+    void writeNoLogTo(LoggingQProcess* process);
+
+private:
+
+    inline void reserve(int length)
+    {
+        if (used + length > buffer.size())
+        {
+            grow(length);
+        }
+    }
+
+    void grow(int length);
+    void append(const char* bytes, int length);
+
+    QByteArray buffer;
+    int used;
+};
+
+#endif
@@ -66,6 +66,11 @@ bool ForwardingGitRepository::branchExists(const QString& branch) const
     return repo->branchExists(branch); 
 }
 
+bool ForwardingGitRepository::hasCommitFrom(const QString& branch, int revnum) 
+{ 
+    return repo->hasCommitFrom(branch, revnum); 
+}
+
 const QByteArray ForwardingGitRepository::branchNote(const QString& branch) const 
 { 
     return repo->branchNote(branch); 
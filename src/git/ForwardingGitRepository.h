@@ -43,6 +43,7 @@ public:
     void commit();
     
     bool branchExists(const QString& branch) const;
+    bool hasCommitFrom(const QString& branch, int revnum);
     const QByteArray branchNote(const QString& branch) const;
     void setBranchNote(const QString& branch, const QByteArray& noteText);
     bool hasPrefix() const;
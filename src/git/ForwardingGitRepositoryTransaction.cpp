@@ -44,9 +44,19 @@ void ForwardingGitRepositoryTransaction::deleteFile(const QString& path)
     txn->deleteFile(prefix + path); 
 }
 
-QIODevice* ForwardingGitRepositoryTransaction::addFile(const QString& path, int mode, qint64 length)  
+QIODevice* ForwardingGitRepositoryTransaction::addFile(const QString& path, int mode, qint64 length, const QByteArray& contentKey)  
 { 
-    return txn->addFile(prefix + path, mode, length); 
+    return txn->addFile(prefix + path, mode, length, contentKey); 
+}
+
+bool ForwardingGitRepositoryTransaction::addExistingFile(const QString& path, int mode, const QByteArray& contentKey)  
+{ 
+    return txn->addExistingFile(prefix + path, mode, contentKey); 
+}
+
+bool ForwardingGitRepositoryTransaction::copyTree(const QString& branchFrom, int revFrom, const QString& pathFrom, const QString& path)  
+{ 
+    return txn->copyTree(branchFrom, revFrom, prefix + pathFrom, prefix + path); 
 }
 
 void ForwardingGitRepositoryTransaction::commitNote(const QByteArray& noteText, bool append, const QByteArray& commit) 
@@ -39,7 +39,9 @@ public:
     void setLog(const QByteArray& log);
     void noteCopyFromBranch (const QString& prevbranch, int revFrom);
     void deleteFile(const QString& path);
-    QIODevice* addFile(const QString& path, int mode, qint64 length);
+    QIODevice* addFile(const QString& path, int mode, qint64 length, const QByteArray& contentKey = QByteArray());
+    bool addExistingFile(const QString& path, int mode, const QByteArray& contentKey);
+    bool copyTree(const QString& branchFrom, int revFrom, const QString& pathFrom, const QString& path);
     void commitNote(const QByteArray& noteText, bool append, const QByteArray& commit);
 
 private:
@@ -0,0 +1,213 @@
+#include "GitBlobIndex.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "GitPackWriter.h"
+#include "commandline/CommandLineParser.h"
+
+// entries are "<key length><key><20 byte id>"
+static const int idSize = 20;
+
+// appended to the file in chunks of at least this size
+static const int flushSize = 64 * 1024;
+
+GitBlobIndex* GitBlobIndex::instance()
+{
+    static GitBlobIndex index;
+    
+    return &index;
+}
+
+GitBlobIndex::GitBlobIndex() :
+    enabled(false)
+{
+    const QString fileName = CommandLineParser::instance()->optionArgument(QLatin1String("blob-index"));
+
+    // nothing is written in a dry run, and nothing gets into a repository in a dump
+    if (fileName.isEmpty() || CommandLineParser::instance()->contains("dry-run") || CommandLineParser::instance()->contains("create-dump"))
+    {
+        return;
+    }
+
+    file.setFileName(fileName);
+    
+    if (!file.open(QIODevice::ReadWrite)) 
+    {
+        qWarning() << "WARN: cannot open the blob index" << fileName << ":" << file.errorString();
+        return;
+    }
+
+    load();
+    enabled = true;
+}
+
+GitBlobIndex::~GitBlobIndex()
+{
+    flush();
+}
+
+void GitBlobIndex::load()
+{
+    const QByteArray data = file.readAll();
+    int pos = 0;
+
+    while (pos < data.size()) 
+    {
+        const int keySize = uchar(data.at(pos));
+        
+        if (pos + 1 + keySize + idSize > data.size())
+        {
+            break;
+        }
+
+        ids.insert(data.mid(pos + 1, keySize), data.mid(pos + 1 + keySize, idSize));
+        pos += 1 + keySize + idSize;
+    }
+
+    if (pos != data.size()) 
+    {
+        // the last run stopped in the middle of an entry
+        qWarning() << "WARN: dropping" << data.size() - pos << "bytes at the end of the blob index" << file.fileName();
+        file.resize(pos);
+    }
+
+    file.seek(pos);
+    qDebug() << "blob index" << file.fileName() << "has" << ids.size() << "entries";
+}
+
+bool GitBlobIndex::isEnabled() const
+{
+    return enabled;
+}
+
+bool GitBlobIndex::contains(const QByteArray& contentKey)
+{
+    if (!enabled || contentKey.isEmpty())
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    
+    return ids.contains(contentKey);
+}
+
+QByteArray GitBlobIndex::lookup(const QByteArray& contentKey)
+{
+    if (!enabled || contentKey.isEmpty())
+    {
+        return QByteArray();
+    }
+
+    QMutexLocker locker(&mutex);
+    
+    return ids.value(contentKey);
+}
+
+void GitBlobIndex::insert(const QByteArray& contentKey, const QByteArray& id)
+{
+    if (!enabled || contentKey.isEmpty() || contentKey.size() > 255)
+    {
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+    QHash<QByteArray, QByteArray>::Iterator it = ids.find(contentKey);
+    
+    if (it != ids.end() && *it == id)
+    {
+        return;
+    }
+
+    ids.insert(contentKey, id);
+
+    pending.append(char(contentKey.size()));
+    pending.append(contentKey);
+    pending.append(id);
+
+    if (pending.size() >= flushSize) 
+    {
+        locker.unlock();
+        flush();
+    }
+}
+
+void GitBlobIndex::flush()
+{
+    QMutexLocker locker(&mutex);
+    
+    if (pending.isEmpty())
+    {
+        return;
+    }
+
+    if (file.write(pending) != pending.size() || !file.flush())
+    {
+        qWarning() << "WARN: failed to write the blob index" << file.fileName() << ":" << file.errorString();
+    }
+
+    pending.clear();
+}
+
+GitBlobHashDevice::GitBlobHashDevice() :
+    target(0),
+    hash(QCryptographicHash::Sha1),
+    knownIds(0),
+    remaining(0)
+{
+    open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+void GitBlobHashDevice::start(QIODevice* device, qint64 length, const QByteArray& contentKey, QSet<QByteArray>* known)
+{
+    target = device;
+    key = contentKey;
+    knownIds = known;
+    remaining = length;
+
+    hash.reset();
+    hash.addData(GitPackWriter::objectHeader(GitBlob, length));
+
+    if (remaining == 0)
+    {
+        writeData(0, 0);
+    }
+}
+
+bool GitBlobHashDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 GitBlobHashDevice::readData(char* , qint64 )
+{
+    return -1;
+}
+
+qint64 GitBlobHashDevice::writeData(const char* data, qint64 length)
+{
+    if (remaining >= 0) 
+    {
+        // the newline after the contents is not part of the blob
+        const qint64 used = qMin(length, remaining);
+        hash.addData(data, used);
+        remaining -= used;
+
+        if (remaining == 0) 
+        {
+            const QByteArray id = hash.result();
+            knownIds->insert(id);
+            GitBlobIndex::instance()->insert(key, id);
+            
+            remaining = -1;
+        }
+    }
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    return target->write(data, length);
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIT_BLOB_INDEX_H
+#define GIT_BLOB_INDEX_H
+
+#include <QSet>
+#include <QHash>
+#include <QFile>
+#include <QMutex>
+#include <QIODevice>
+#include <QByteArray>
+#include <QCryptographicHash>
+
+/**
+ * The git blob ids of file contents exported by earlier runs, by the
+ * content key of SvnHelper::contentKey (svn checksum and length). Kept
+ * in the file given with --blob-index, which only ever grows; whether
+ * an object is still in a repository is up to the repository to check.
+ */
+class GitBlobIndex
+{
+
+public:
+
+    static GitBlobIndex* instance();
+
+    bool isEnabled() const;
+
+    // thread safe, the blob readers ask before reading the contents
+    bool contains(const QByteArray& contentKey);
+    QByteArray lookup(const QByteArray& contentKey);
+
+    void insert(const QByteArray& contentKey, const QByteArray& id);
+    void flush();
+
+private:
+
+    GitBlobIndex();
+    ~GitBlobIndex();
+
+    void load();
+
+    QFile file;
+    QMutex mutex;
+    QHash<QByteArray, QByteArray> ids;
+    QByteArray pending;
+    bool enabled;
+
+    Q_DISABLE_COPY(GitBlobIndex)
+};
+
+/**
+ * Passes a blob on to the device it goes to and names it on the way: once
+ * the announced length went through, its id is entered into the index and
+ * into the set of objects the repository has.
+ */
+class GitBlobHashDevice : public QIODevice
+{
+
+public:
+
+    GitBlobHashDevice();
+
+    void start(QIODevice* target, qint64 length, const QByteArray& contentKey, QSet<QByteArray>* known);
+
+    bool isSequential() const;
+
+protected:
+
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 length);
+
+private:
+
+    QIODevice* target;
+    QCryptographicHash hash;
+    QByteArray key;
+    QSet<QByteArray>* knownIds;
+    qint64 remaining;
+};
+
+#endif
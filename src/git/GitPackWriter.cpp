@@ -0,0 +1,823 @@
+#include "GitPackWriter.h"
+
+#include <QDir>
+#include <QMutex>
+#include <QDebug>
+#include <QThread>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "commandline/CommandLineParser.h"
+
+// how much data may wait in the queue before add() waits for the workers
+static const qint64 maxQueuedBytes = 128 * 1024 * 1024;
+static const int maxQueuedJobs = 4096;
+
+// output buffer for streamed objects
+static const int streamChunkSize = 256 * 1024;
+
+struct GitPackJob
+{
+    GitObjectType type;
+    QByteArray data;
+    QByteArray id;
+    QByteArray packed;
+    quint32 crc;
+    bool done;
+    bool written;
+    bool claimed;
+};
+
+static void appendEntryHeader(QByteArray* out, GitObjectType type, qint64 length)
+{
+    unsigned char c = (type << 4) | (length & 15);
+    length >>= 4;
+
+    while (length) 
+    {
+        out->append(char(c | 0x80));
+        c = length & 0x7f;
+        length >>= 7;
+    }
+
+    out->append(char(c));
+}
+
+static void appendBigEndian(QByteArray* out, quint32 value)
+{
+    out->append(char(value >> 24));
+    out->append(char(value >> 16));
+    out->append(char(value >> 8));
+    out->append(char(value));
+}
+
+/**
+ * The threads hashing and compressing objects for all pack writers.
+ */
+class DeflatePool
+{
+
+public:
+
+    static DeflatePool* instance();
+
+    void submit(GitPackJob* job);
+    bool isDone(GitPackJob* job);
+    void wait(GitPackJob* job);
+
+private:
+
+    class Worker : public QThread
+    {
+
+    public:
+
+        Worker(DeflatePool* pool);
+
+    protected:
+
+        void run();
+
+    private:
+
+        DeflatePool* pool;
+    };
+
+    DeflatePool();
+    ~DeflatePool();
+
+    static void process(GitPackJob* job);
+
+    QMutex mutex;
+    QWaitCondition workCondition;
+    QWaitCondition doneCondition;
+    QList<GitPackJob*> jobs;
+    QList<Worker*> workers;
+    bool stopping;
+};
+
+DeflatePool* DeflatePool::instance()
+{
+    static DeflatePool pool;
+    return &pool;
+}
+
+DeflatePool::DeflatePool() :
+    stopping(false)
+{
+    int threads = CommandLineParser::instance()->optionArgument(QLatin1String("pack-threads"), QString::number(QThread::idealThreadCount())).toInt();
+
+    for (int i = 0; i < qMax(threads, 1); ++i) 
+    {
+        Worker* worker = new Worker(this);
+        workers.append(worker);
+        worker->start();
+    }
+}
+
+DeflatePool::~DeflatePool()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        workCondition.wakeAll();
+    }
+
+    foreach (Worker* worker, workers) 
+    {
+        worker->wait();
+        delete worker;
+    }
+}
+
+void DeflatePool::submit(GitPackJob* job)
+{
+    QMutexLocker locker(&mutex);
+    jobs.append(job);
+    workCondition.wakeOne();
+}
+
+bool DeflatePool::isDone(GitPackJob* job)
+{
+    QMutexLocker locker(&mutex);
+    return job->done;
+}
+
+void DeflatePool::wait(GitPackJob* job)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!job->done)
+    {
+        doneCondition.wait(&mutex);
+    }
+}
+
+void DeflatePool::process(GitPackJob* job)
+{
+    if (job->id.isEmpty()) 
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(GitPackWriter::objectHeader(job->type, job->data.size()));
+        hash.addData(job->data);
+        job->id = hash.result();
+    }
+
+    appendEntryHeader(&job->packed, job->type, job->data.size());
+    
+    const int headerSize = job->packed.size();
+    uLongf length = compressBound(job->data.size());
+    job->packed.resize(headerSize + length);
+
+    if (compress2(reinterpret_cast<Bytef*>(job->packed.data()) + headerSize, &length, reinterpret_cast<const Bytef*>(job->data.constData()), job->data.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        qFatal("Failed to compress a git object of %d bytes", job->data.size());
+    }
+
+    job->packed.resize(headerSize + length);
+    job->crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(job->packed.constData()), job->packed.size());
+}
+
+DeflatePool::Worker::Worker(DeflatePool* p) :
+    pool(p)
+{
+}
+
+void DeflatePool::Worker::run()
+{
+    forever 
+    {
+        GitPackJob* job;
+        
+        {
+            QMutexLocker locker(&pool->mutex);
+
+            while (pool->jobs.isEmpty() && !pool->stopping)
+            {
+                pool->workCondition.wait(&pool->mutex);
+            }
+
+            if (pool->stopping)
+            {
+                return;
+            }
+
+            job = pool->jobs.takeFirst();
+        }
+
+        process(job);
+
+        QMutexLocker locker(&pool->mutex);
+        job->done = true;
+        pool->doneCondition.wakeAll();
+    }
+}
+
+/**
+ * Runs GitPackWriter::finalize() for one pack.
+ */
+class GitPackWriter::Finisher : public QThread
+{
+
+public:
+
+    Finisher(const QString& f, const QString& d, const QHash<QByteArray, Entry>& e) :
+        fileName(f),
+        packDir(d),
+        entries(e),
+        ok(false)
+    {
+    }
+
+    const QString fileName;
+    const QString packDir;
+    const QHash<QByteArray, Entry> entries;
+    bool ok;
+
+protected:
+
+    void run()
+    {
+        ok = GitPackWriter::finalize(fileName, packDir, entries);
+    }
+};
+
+GitPackWriter::GitPackWriter(const QString& gitDir) :
+    packDir(gitDir + "/objects/pack"),
+    nextTicket(0),
+    queuedBytes(0),
+    failed(false),
+    finisher(0),
+    streamHash(QCryptographicHash::Sha1),
+    streamRemaining(0),
+    streaming(false)
+{
+    memset(&stream, 0, sizeof stream);
+}
+
+GitPackWriter::~GitPackWriter()
+{
+    drain(true);
+
+    bool ok;
+    backgroundDone(true, &ok);
+
+    // queued jobs are written now, the rest only waits for id()
+    qDeleteAll(tickets);
+
+    if (pack.isOpen()) 
+    {
+        qWarning() << "WARN: discarding unfinished pack" << pack.fileName();
+        pack.close();
+        pack.remove();
+    }
+}
+
+QByteArray GitPackWriter::objectHeader(GitObjectType type, qint64 length)
+{
+    static const char* const names[] = { "", "commit", "tree", "blob", "tag" };
+    
+    return QByteArray(names[type]) + ' ' + QByteArray::number(length) + '\0';
+}
+
+int GitPackWriter::add(GitObjectType type, const QByteArray& data)
+{
+    GitPackJob* job = new GitPackJob;
+    job->type = type;
+    job->data = data;
+    job->crc = 0;
+    job->done = false;
+    job->written = false;
+    job->claimed = false;
+    
+    tickets.insert(nextTicket, job);
+    enqueue(job);
+    
+    return nextTicket++;
+}
+
+QByteArray GitPackWriter::id(int ticket)
+{
+    GitPackJob* job = tickets.take(ticket);
+    Q_ASSERT(job);
+    
+    DeflatePool::instance()->wait(job);
+    QByteArray result = job->id;
+
+    if (job->written)
+    {
+        delete job;
+    }
+    else
+    {
+        job->claimed = true;
+    }
+    
+    return result;
+}
+
+QByteArray GitPackWriter::write(GitObjectType type, const QByteArray& data)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(objectHeader(type, data.size()));
+    hash.addData(data);
+    QByteArray result = hash.result();
+
+    if (entries.contains(result) || finished.contains(result))
+    {
+        return result;
+    }
+
+    GitPackJob* job = new GitPackJob;
+    job->type = type;
+    job->data = data;
+    job->id = result;
+    job->crc = 0;
+    job->done = false;
+    job->written = false;
+    job->claimed = true;
+    enqueue(job);
+    
+    return result;
+}
+
+void GitPackWriter::enqueue(GitPackJob* job)
+{
+    queue.append(job);
+    queuedBytes += job->data.size();
+    DeflatePool::instance()->submit(job);
+
+    drain(false);
+
+    // keep the memory bounded when the workers fall behind
+    while (!queue.isEmpty() && (queuedBytes > maxQueuedBytes || queue.size() > maxQueuedJobs)) 
+    {
+        GitPackJob* first = queue.takeFirst();
+        DeflatePool::instance()->wait(first);
+        append(first);
+    }
+}
+
+void GitPackWriter::drain(bool wait)
+{
+    while (!queue.isEmpty()) 
+    {
+        GitPackJob* job = queue.first();
+        
+        if (wait)
+        {
+            DeflatePool::instance()->wait(job);
+        }
+        else if (!DeflatePool::instance()->isDone(job))
+        {
+            break;
+        }
+
+        queue.removeFirst();
+        append(job);
+    }
+}
+
+void GitPackWriter::append(GitPackJob* job)
+{
+    // objects are written once per pack, and once per run
+    if (!entries.contains(job->id) && !finished.contains(job->id) && open()) 
+    {
+        Entry entry;
+        entry.offset = pack.pos();
+        entry.length = job->packed.size();
+        entry.crc = job->crc;
+        
+        writeRaw(job->packed.constData(), job->packed.size());
+        entries.insert(job->id, entry);
+    }
+
+    queuedBytes -= job->data.size();
+    job->written = true;
+    job->data.clear();
+    job->packed.clear();
+
+    if (job->claimed)
+    {
+        delete job;
+    }
+}
+
+bool GitPackWriter::open()
+{
+    if (pack.isOpen())
+    {
+        return true;
+    }
+
+    static int packCount = 0;
+    
+    QDir().mkpath(packDir);
+    pack.setFileName(packDir + QString("/tmp_pack_svn2git_%1_%2").arg(getpid()).arg(++packCount));
+
+    if (!pack.open(QIODevice::ReadWrite | QIODevice::Truncate)) 
+    {
+        qCritical() << "Failed to create" << pack.fileName() << ":" << pack.errorString();
+        failed = true;
+        
+        return false;
+    }
+
+    // the object count is filled in by finish()
+    QByteArray header("PACK");
+    appendBigEndian(&header, 2);
+    appendBigEndian(&header, 0);
+    writeRaw(header.constData(), header.size());
+
+    return true;
+}
+
+void GitPackWriter::writeRaw(const char* data, qint64 length)
+{
+    if (pack.write(data, length) != length && !failed) 
+    {
+        qCritical() << "Failed to write to" << pack.fileName() << ":" << pack.errorString();
+        failed = true;
+    }
+}
+
+void GitPackWriter::beginObject(GitObjectType type, qint64 length)
+{
+    Q_ASSERT(!streaming);
+    
+    streaming = true;
+    streamRemaining = length;
+    streamHash.reset();
+    streamHash.addData(objectHeader(type, length));
+
+    if (!open())
+    {
+        return;
+    }
+
+    QByteArray header;
+    appendEntryHeader(&header, type, length);
+    
+    streamEntry.offset = pack.pos();
+    streamEntry.crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(header.constData()), header.size());
+    writeRaw(header.constData(), header.size());
+
+    memset(&stream, 0, sizeof stream);
+    
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        qFatal("Failed to initialize zlib");
+    }
+}
+
+void GitPackWriter::writeObject(const char* data, qint64 length)
+{
+    Q_ASSERT(streaming);
+    
+    streamHash.addData(data, length);
+    streamRemaining -= length;
+    deflateChunk(data, length, Z_NO_FLUSH);
+}
+
+QByteArray GitPackWriter::endObject()
+{
+    Q_ASSERT(streaming);
+    
+    deflateChunk(0, 0, Z_FINISH);
+    deflateEnd(&stream);
+    streaming = false;
+
+    if (streamRemaining != 0 && !failed) 
+    {
+        qCritical() << "Streamed git object is off by" << streamRemaining << "bytes";
+        failed = true;
+    }
+
+    QByteArray result = streamHash.result();
+
+    if (!pack.isOpen())
+    {
+        return result;
+    }
+
+    if (entries.contains(result) || finished.contains(result)) 
+    {
+        pack.flush();
+        pack.resize(streamEntry.offset);
+        pack.seek(streamEntry.offset);
+    }
+    else 
+    {
+        streamEntry.length = pack.pos() - streamEntry.offset;
+        entries.insert(result, streamEntry);
+    }
+    
+    return result;
+}
+
+void GitPackWriter::deflateChunk(const char* data, qint64 length, int flush)
+{
+    if (!pack.isOpen())
+    {
+        return;
+    }
+
+    if (streamBuffer.size() != streamChunkSize)
+    {
+        streamBuffer.resize(streamChunkSize);
+    }
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = length;
+
+    int ret;
+    
+    do 
+    {
+        stream.next_out = reinterpret_cast<Bytef*>(streamBuffer.data());
+        stream.avail_out = streamBuffer.size();
+        ret = deflate(&stream, flush);
+
+        const int produced = streamBuffer.size() - stream.avail_out;
+        streamEntry.crc = crc32(streamEntry.crc, reinterpret_cast<const Bytef*>(streamBuffer.constData()), produced);
+        writeRaw(streamBuffer.constData(), produced);
+    } 
+    while (stream.avail_out == 0 || (flush == Z_FINISH && ret == Z_OK));
+}
+
+bool GitPackWriter::read(const QByteArray& id, GitObjectType* type, QByteArray* data)
+{
+    foreach (GitPackJob* job, queue) 
+    {
+        // the name of a job is only there for sure once it is claimed or done
+        if ((job->claimed || DeflatePool::instance()->isDone(job)) && job->id == id) 
+        {
+            *type = job->type;
+            *data = job->data;
+            
+            return true;
+        }
+    }
+
+    QHash<QByteArray, Entry>::ConstIterator it = entries.constFind(id);
+    
+    if (it != entries.constEnd())
+    {
+        return readEntry(pack, *it, type, data);
+    }
+
+    it = sealedEntries.constFind(id);
+    
+    if (it != sealedEntries.constEnd())
+    {
+        return readEntry(sealed, *it, type, data);
+    }
+
+    return false;
+}
+
+bool GitPackWriter::readEntry(QFile& file, const Entry& entry, GitObjectType* type, QByteArray* data)
+{
+    const qint64 end = file.pos();
+    file.seek(entry.offset);
+    QByteArray raw = file.read(entry.length);
+    file.seek(end);
+
+    if (raw.size() != entry.length)
+    {
+        return false;
+    }
+
+    const uchar* p = reinterpret_cast<const uchar*>(raw.constData());
+    uchar c = p[0];
+    int used = 1;
+    int shift = 4;
+    qint64 length = c & 15;
+    
+    while (c & 0x80) 
+    {
+        c = p[used++];
+        length |= qint64(c & 0x7f) << shift;
+        shift += 7;
+    }
+
+    *type = GitObjectType((p[0] >> 4) & 7);
+    data->resize(length);
+    
+    uLongf inflated = length;
+    
+    return uncompress(reinterpret_cast<Bytef*>(data->data()), &inflated, p + used, raw.size() - used) == Z_OK && qint64(inflated) == length;
+}
+
+qint64 GitPackWriter::size() const
+{
+    return pack.isOpen() ? pack.pos() : 0;
+}
+
+bool GitPackWriter::finish(bool background)
+{
+    Q_ASSERT(!streaming);
+    drain(true);
+
+    // one pack at a time, the one before had all this time to get done
+    bool ok;
+    backgroundDone(true, &ok);
+
+    if (!pack.isOpen())
+    {
+        return ok && !failed;
+    }
+
+    if (entries.isEmpty()) 
+    {
+        pack.close();
+        pack.remove();
+        
+        return ok && !failed;
+    }
+
+    foreach (const QByteArray& id, entries.keys())
+    {
+        finished.insert(id);
+    }
+
+    pack.close();
+    ok = ok && !failed;
+    failed = false;
+
+    if (ok && background) 
+    {
+        sealed.setFileName(pack.fileName());
+        
+        if (sealed.open(QIODevice::ReadOnly)) 
+        {
+            sealedEntries = entries;
+            entries.clear();
+            
+            finisher = new Finisher(sealed.fileName(), packDir, sealedEntries);
+            finisher->start();
+            
+            return true;
+        }
+
+        qCritical() << "Failed to open" << sealed.fileName() << ":" << sealed.errorString();
+        ok = false;
+    }
+
+    ok = ok && finalize(pack.fileName(), packDir, entries);
+    entries.clear();
+    
+    return ok;
+}
+
+bool GitPackWriter::backgroundDone(bool wait, bool* ok)
+{
+    *ok = true;
+
+    if (!finisher)
+    {
+        return true;
+    }
+
+    if (!wait && !finisher->isFinished())
+    {
+        return false;
+    }
+
+    finisher->wait();
+    *ok = finisher->ok;
+    delete finisher;
+    finisher = 0;
+
+    sealed.close();
+    sealedEntries.clear();
+    
+    return true;
+}
+
+bool GitPackWriter::finalize(const QString& fileName, const QString& packDir, const QHash<QByteArray, Entry>& entries)
+{
+    QFile pack(fileName);
+    
+    if (!pack.open(QIODevice::ReadWrite)) 
+    {
+        qCritical() << "Failed to open" << fileName << ":" << pack.errorString();
+        return false;
+    }
+
+    QByteArray count;
+    appendBigEndian(&count, entries.size());
+    pack.seek(8);
+    bool ok = pack.write(count) == count.size();
+
+    // the trailer covers the patched header, so hash the file once more
+    QCryptographicHash packHash(QCryptographicHash::Sha1);
+    pack.seek(0);
+    
+    forever 
+    {
+        QByteArray chunk = pack.read(1024 * 1024);
+        
+        if (chunk.isEmpty())
+        {
+            break;
+        }
+        
+        packHash.addData(chunk);
+    }
+
+    const QByteArray packId = packHash.result();
+    pack.seek(pack.size());
+    ok = ok && pack.write(packId) == packId.size();
+    pack.close();
+
+    if (!ok) 
+    {
+        qCritical() << "Failed to write to" << fileName << ":" << pack.errorString();
+        return false;
+    }
+
+    // version 2 index: fan-out, names, CRCs, offsets, then the large offsets
+    QList<QByteArray> ids = entries.keys();
+    qSort(ids);
+
+    QByteArray index("\377tOc");
+    appendBigEndian(&index, 2);
+
+    int below = 0;
+    
+    for (int byte = 0; byte < 256; ++byte) 
+    {
+        while (below < ids.size() && uchar(ids.at(below).at(0)) <= byte)
+        {
+            ++below;
+        }
+        
+        appendBigEndian(&index, below);
+    }
+
+    foreach (const QByteArray& id, ids)
+    {
+        index.append(id);
+    }
+
+    foreach (const QByteArray& id, ids)
+    {
+        appendBigEndian(&index, entries.value(id).crc);
+    }
+
+    QByteArray largeOffsets;
+    
+    foreach (const QByteArray& id, ids) 
+    {
+        const qint64 offset = entries.value(id).offset;
+        
+        if (offset < 0x80000000LL) 
+        {
+            appendBigEndian(&index, offset);
+        }
+        else 
+        {
+            appendBigEndian(&index, 0x80000000U | (largeOffsets.size() / 8));
+            appendBigEndian(&largeOffsets, offset >> 32);
+            appendBigEndian(&largeOffsets, offset & 0xffffffffU);
+        }
+    }
+
+    index.append(largeOffsets);
+    index.append(packId);
+    index.append(QCryptographicHash::hash(index, QCryptographicHash::Sha1));
+
+    QFile indexFile(fileName + ".idx");
+    
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate) || indexFile.write(index) != index.size()) 
+    {
+        qCritical() << "Failed to write" << indexFile.fileName() << ":" << indexFile.errorString();
+        return false;
+    }
+    
+    indexFile.close();
+
+    const QString base = packDir + "/pack-" + QString::fromLatin1(packId.toHex());
+
+    if (QFile::exists(base + ".pack")) 
+    {
+        // the very same objects were written before
+        QFile::remove(fileName);
+        indexFile.remove();
+        
+        return true;
+    }
+
+    // git looks for the index, so it goes last
+    if (!QFile::rename(fileName, base + ".pack") || !QFile::rename(indexFile.fileName(), base + ".idx")) 
+    {
+        qCritical() << "Failed to move" << fileName << "to" << base + ".pack";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIT_PACK_WRITER_H
+#define GIT_PACK_WRITER_H
+
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QCryptographicHash>
+
+#include <zlib.h>
+
+enum GitObjectType 
+{
+    GitCommit = 1,
+    GitTree = 2,
+    GitBlob = 3,
+    GitTag = 4
+};
+
+struct GitPackJob;
+
+/**
+ * Writes git objects straight into a pack of a bare repository, without
+ * deltas. Hashing and compression run on a pool of threads shared by all
+ * writers (--pack-threads), the calling thread only appends finished
+ * objects to the file. finish() writes the index and moves the pack into
+ * objects/pack, only then git can see the objects. It can leave that to
+ * a thread of its own, the objects stay readable through read() until
+ * backgroundDone() collects it.
+ */
+class GitPackWriter
+{
+
+public:
+
+    GitPackWriter(const QString& gitDir);
+    ~GitPackWriter();
+
+    static QByteArray objectHeader(GitObjectType type, qint64 length);
+
+    // queues an object, id() gives its name once a worker hashed it
+    int add(GitObjectType type, const QByteArray& data);
+
+    // the binary name of the object of a ticket, once per ticket
+    QByteArray id(int ticket);
+
+    // hashes an object right away and queues it for compression
+    QByteArray write(GitObjectType type, const QByteArray& data);
+
+    // streams an object too large to be buffered into the pack
+    void beginObject(GitObjectType type, qint64 length);
+    void writeObject(const char* data, qint64 length);
+    QByteArray endObject();
+
+    // objects added since the last finish(), older ones are up to git
+    bool read(const QByteArray& id, GitObjectType* type, QByteArray* data);
+
+    qint64 size() const;
+    bool finish(bool background = false);
+
+    // whether the last finish() in the background is done, waits for it
+    // if asked to; ok tells whether it succeeded
+    bool backgroundDone(bool wait, bool* ok);
+
+private:
+
+    struct Entry
+    {
+        qint64 offset;
+        qint64 length;
+        quint32 crc;
+    };
+
+    class Finisher;
+    friend class Finisher;
+
+    // patches the object count, appends the trailer, writes the index and
+    // moves both into packDir
+    static bool finalize(const QString& fileName, const QString& packDir, const QHash<QByteArray, Entry>& entries);
+    static bool readEntry(QFile& file, const Entry& entry, GitObjectType* type, QByteArray* data);
+
+    bool open();
+    void enqueue(GitPackJob* job);
+    void drain(bool wait);
+    void append(GitPackJob* job);
+    void writeRaw(const char* data, qint64 length);
+    void deflateChunk(const char* data, qint64 length, int flush);
+
+    QString packDir;
+    QFile pack;
+    QHash<QByteArray, Entry> entries;
+    QSet<QByteArray> finished;
+    QList<GitPackJob*> queue;
+    QHash<int, GitPackJob*> tickets;
+    int nextTicket;
+    qint64 queuedBytes;
+    bool failed;
+
+    // the pack being finished in the background
+    Finisher* finisher;
+    QFile sealed;
+    QHash<QByteArray, Entry> sealedEntries;
+
+    // the object between beginObject() and endObject()
+    z_stream stream;
+    QCryptographicHash streamHash;
+    QByteArray streamBuffer;
+    Entry streamEntry;
+    qint64 streamRemaining;
+    bool streaming;
+
+    Q_DISABLE_COPY(GitPackWriter)
+};
+
+#endif
@@ -1,14 +1,40 @@
 #include "GitRepository.h"
 
+#include <QDir>
+#include <QFile>
 #include <QDebug>
+#include <QProcess>
 
+#include "NativeGitRepository.h"
 #include "FastImportGitRepository.h"
 #include "ForwardingGitRepository.h"
+#include "commandline/CommandLineParser.h"
+
+static QList<RuleMatchSubstitution> logSubstitutions;
+
+// the --msg-filter-server program, started with the first message
+static QProcess* msgFilterServer = 0;
 
 GitRepository* GitRepository::createRepository(const RuleRepository& rule, const QHash<QString, GitRepository*>& repositories)
 {
     if (rule.getForwardTo().isEmpty())
     {
+        const QString backend = CommandLineParser::instance()->optionArgument(QLatin1String("backend"), QLatin1String("fast-import"));
+
+        if (backend == QLatin1String("native")) 
+        {
+            // dry runs and dumps are fast-import streams by definition
+            if (!CommandLineParser::instance()->contains("dry-run") && !CommandLineParser::instance()->contains("create-dump"))
+            {
+                return new NativeGitRepository(rule);
+            }
+        }
+        else if (backend != QLatin1String("fast-import"))
+        {
+            qCritical() << "unknown backend" << backend;
+            return 0;
+        }
+
         return new FastImportGitRepository(rule);
     }
     
@@ -23,6 +49,169 @@ GitRepository* GitRepository::createRepository(const RuleRepository& rule, const
     return new ForwardingGitRepository(rule.getName(), r, rule.getPrefix());
 }
 
+bool GitRepository::initRepository(const RuleRepository& rule)
+{
+    const QString name = rule.getName();
+    
+    if (QDir(name).exists())
+    {
+        return false;
+    }
+
+    qDebug() << "Creating new repository" << name;
+    QDir::current().mkpath(name);
+    QProcess init;
+    init.setWorkingDirectory(name);
+    init.start("git", QStringList() << "--bare" << "init");
+    init.waitForFinished(-1);
+    
+    // Write description
+    if (!rule.getDescription().isEmpty()) 
+    {
+        QFile fDesc(QDir(name).filePath("description"));
+        if (fDesc.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) 
+        {
+            fDesc.write(rule.getDescription().toUtf8());
+            fDesc.putChar('\n');
+            fDesc.close();
+        }
+    }
+
+    return true;
+}
+
+void GitRepository::setLogSubstitutions(const QList<RuleMatchSubstitution>& substitutions)
+{
+    logSubstitutions = substitutions;
+}
+
+// Asks the long running --msg-filter-server program to rewrite one
+// message. Both directions carry "<decimal length>\n<bytes>", so the
+// program only starts once and no end of file is needed between messages.
+static QByteArray filterThroughServer(const QByteArray& msg)
+{
+    if (!msgFilterServer)
+    {
+        msgFilterServer = new QProcess;
+        msgFilterServer->start(CommandLineParser::instance()->optionArgument("msg-filter-server"));
+
+        if (!msgFilterServer->waitForStarted(-1))
+        {
+            qFatal("Failed to start msg-filter-server: %s", qPrintable(msgFilterServer->errorString()));
+        }
+    }
+    else if (msgFilterServer->state() == QProcess::NotRunning)
+    {
+        qFatal("msg-filter-server has been started once and exited?");
+    }
+
+    QProcess& server = *msgFilterServer;
+
+    server.write(QByteArray::number(msg.length()) + '\n');
+    server.write(msg);
+    server.waitForBytesWritten(-1);
+
+    while (!server.canReadLine())
+    {
+        if (!server.waitForReadyRead(-1))
+        {
+            qFatal("msg-filter-server did not answer: %s", qPrintable(server.errorString()));
+        }
+    }
+
+    bool ok;
+    int length = server.readLine().trimmed().toInt(&ok);
+
+    if (!ok || length < 0)
+    {
+        qFatal("msg-filter-server sent a malformed length");
+    }
+
+    QByteArray output;
+    output.reserve(length);
+
+    while (output.length() < length)
+    {
+        if (!server.bytesAvailable() && !server.waitForReadyRead(-1))
+        {
+            qFatal("msg-filter-server stopped in the middle of a message: %s", qPrintable(server.errorString()));
+        }
+
+        output += server.read(length - output.length());
+    }
+
+    return output;
+}
+
+void GitRepository::closeMsgFilterServer()
+{
+    if (!msgFilterServer)
+    {
+        return;
+    }
+
+    // end of file tells it there are no more messages
+    msgFilterServer->closeWriteChannel();
+
+    if (!msgFilterServer->waitForFinished(-1))
+    {
+        qWarning() << "WARN: msg-filter-server did not exit:" << msgFilterServer->errorString();
+    }
+    else if (msgFilterServer->exitStatus() != QProcess::NormalExit || msgFilterServer->exitCode() != 0)
+    {
+        qWarning() << "WARN: msg-filter-server exited with code" << msgFilterServer->exitCode();
+    }
+
+    delete msgFilterServer;
+    msgFilterServer = 0;
+}
+
+const QByteArray GitRepository::msgFilter(const QByteArray& msg)
+{
+    QByteArray output = msg;
+
+    if (!logSubstitutions.isEmpty())
+    {
+        QString log = QString::fromUtf8(output);
+
+        for (int i = 0; i < logSubstitutions.size(); ++i)
+        {
+            logSubstitutions[i].apply(log);
+        }
+
+        output = log.toUtf8();
+    }
+
+    if (CommandLineParser::instance()->contains("msg-filter-server"))
+    {
+        output = filterThroughServer(output);
+    }
+
+    if (CommandLineParser::instance()->contains("msg-filter")) 
+    {
+        static QProcess filterMsg;
+        
+	if (filterMsg.state() == QProcess::Running)
+        {
+	    qFatal("filter process already running?");
+        }
+
+	filterMsg.start(CommandLineParser::instance()->optionArgument("msg-filter"));
+
+	if(!(filterMsg.waitForStarted(-1)))
+        {
+	    qFatal("Failed to Start Filter %d %s", __LINE__, qPrintable(filterMsg.errorString()));
+        }
+
+	filterMsg.write(output);
+	filterMsg.closeWriteChannel();
+	filterMsg.waitForFinished();
+	output = filterMsg.readAllStandardOutput();
+    }
+    
+    return output;
+}
+
 const QByteArray GitRepository::formatMetadataMessage(const QByteArray &svnprefix, int revnum, const QByteArray &tag)
 {
     QByteArray msg = "svn path=" + svnprefix + "; revision=" + QByteArray::number(revnum);
@@ -20,8 +20,10 @@
 #define GIT_REPOSITORY_H
 
 #include <QHash>
+#include <QList>
 
 #include "rules/RuleRepository.h"
+#include "rules/RuleMatchSubstitution.h"
 
 class QString;
 class QByteArray;
@@ -50,9 +52,18 @@ public:
     virtual void finalizeTags() = 0;
     virtual void commit() = 0;
 
+    // substitutions from the "filter log" blocks of the rules files
+    static void setLogSubstitutions(const QList<RuleMatchSubstitution>& substitutions);
+
+    // ends the --msg-filter-server program once no more messages come
+    static void closeMsgFilterServer();
+
     static const QByteArray formatMetadataMessage(const QByteArray& svnprefix, int revnum, const QByteArray& tag = QByteArray());
 
     virtual bool branchExists(const QString& branch) const = 0;
+
+    // whether createBranch() would find an exported commit of the branch for revnum
+    virtual bool hasCommitFrom(const QString& branch, int revnum) = 0;
     virtual const QByteArray branchNote(const QString& branch) const = 0;
     virtual void setBranchNote(const QString& branch, const QByteArray& noteText) = 0;
 
@@ -60,6 +71,15 @@ public:
 
     virtual const QString& getName() const = 0;
     virtual GitRepository *getEffectiveRepository() = 0;
+
+protected:
+
+    // creates the bare repository on disk, returns false if it was there already
+    static bool initRepository(const RuleRepository& rule);
+
+    // runs the log message through the log substitutions, then
+    // --msg-filter-server and --msg-filter, if given
+    static const QByteArray msgFilter(const QByteArray& msg);
 };
 
 
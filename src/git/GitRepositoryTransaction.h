@@ -40,7 +40,15 @@ public:
     virtual void noteCopyFromBranch (const QString &prevbranch, int revFrom) = 0;
 
     virtual void deleteFile(const QString& path) = 0;
-    virtual QIODevice* addFile(const QString& path, int mode, qint64 length) = 0;
+    virtual QIODevice* addFile(const QString& path, int mode, qint64 length, const QByteArray& contentKey = QByteArray()) = 0;
+
+    // adds a file whose contents were already sent with the same contentKey,
+    // returns false if they have to be sent again through addFile
+    virtual bool addExistingFile(const QString& path, int mode, const QByteArray& contentKey) = 0;
+
+    // makes path the tree pathFrom had on branchFrom at revFrom,
+    // returns false if the files have to be added one by one instead
+    virtual bool copyTree(const QString& branchFrom, int revFrom, const QString& pathFrom, const QString& path) = 0;
 
     virtual void commitNote(const QByteArray& noteText, bool append, const QByteArray& commit = QByteArray()) = 0;
         
@@ -0,0 +1,1346 @@
+#include "NativeGitRepository.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QRegExp>
+#include <QSet>
+
+#include <stdio.h>
+
+#include "rules/RuleRepository.h"
+#include "commandline/CommandLineParser.h"
+#include "CheckpointScheduler.h"
+#include "NativeGitRepositoryTransaction.h"
+
+// how many branches keep their loaded working tree between commits
+static const int maxWorktrees = 32;
+
+static const int treeMode = 040000;
+
+// blobs from this size on are compressed while they are read from svn
+static const qint64 streamedBlobSize = 32 * 1024 * 1024;
+
+// sha1 of "tree 0\0"; git has no empty directories
+static const QByteArray emptyTreeId = QByteArray::fromHex("4b825dc642cb6eb9a060e54bf8d69288fbee4904");
+
+static qint64 parseSize(const QString& text)
+{
+    // the suffixes git-fast-import --max-pack-size takes
+    QString number = text.trimmed().toLower();
+    qint64 unit = 1;
+
+    if (number.endsWith('k'))
+    {
+        unit = 1024;
+    }
+    else if (number.endsWith('m'))
+    {
+        unit = 1024 * 1024;
+    }
+    else if (number.endsWith('g'))
+    {
+        unit = 1024 * 1024 * 1024;
+    }
+
+    if (unit > 1)
+    {
+        number.chop(1);
+    }
+
+    return number.toLongLong() * unit;
+}
+
+static QList<QByteArray> pathParts(const QByteArray& path)
+{
+    QList<QByteArray> parts = path.split('/');
+    parts.removeAll(QByteArray());
+    
+    return parts;
+}
+
+NativeBlobDevice::NativeBlobDevice() :
+    pack(0),
+    remaining(0),
+    streaming(false)
+{
+    open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+void NativeBlobDevice::start(GitPackWriter* packWriter, qint64 length)
+{
+    pack = packWriter;
+    remaining = length;
+    streaming = length >= streamedBlobSize;
+    buffer.clear();
+
+    if (streaming)
+    {
+        pack->beginObject(GitBlob, length);
+    }
+    else
+    {
+        buffer.reserve(length);
+    }
+}
+
+bool NativeBlobDevice::isStreaming() const
+{
+    return streaming;
+}
+
+qint64 NativeBlobDevice::missing() const
+{
+    return remaining;
+}
+
+QByteArray NativeBlobDevice::takeData()
+{
+    QByteArray data = buffer;
+    buffer = QByteArray();
+    
+    return data;
+}
+
+bool NativeBlobDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 NativeBlobDevice::readData(char* , qint64 )
+{
+    return -1;
+}
+
+qint64 NativeBlobDevice::writeData(const char* data, qint64 length)
+{
+    const qint64 used = qMin(length, remaining);
+
+    if (used > 0) 
+    {
+        if (streaming)
+        {
+            pack->writeObject(data, used);
+        }
+        else
+        {
+            buffer.append(data, used);
+        }
+        
+        remaining -= used;
+    }
+
+    return length;
+}
+
+NativeGitRepository::Branch::Branch() :
+    created(0)
+{
+}
+
+NativeGitRepository::TreeEntry::TreeEntry() :
+    mode(0),
+    tree(0)
+{
+}
+
+NativeGitRepository::TreeNode::TreeNode(const QByteArray& treeId) :
+    id(treeId),
+    loaded(treeId.isEmpty())
+{
+}
+
+NativeGitRepository::TreeNode::~TreeNode()
+{
+    foreach (const TreeEntry& entry, entries)
+    {
+        delete entry.tree;
+    }
+}
+
+NativeGitRepository::NativeGitRepository(const RuleRepository& rule) :
+    name(rule.getName()),
+    prefix(rule.getForwardTo()),
+    outstandingTransactions(0),
+    checkpoints(CheckpointScheduler::instance()->addRepository()),
+    pack(rule.getName()),
+    maxPackSize(parseSize(CommandLineParser::instance()->optionArgument(QLatin1String("max-packsize"), QLatin1String("0")))),
+    packedBytes(0),
+    blobOwner(0),
+    blobChange(-1),
+    dedupBlobs(CommandLineParser::instance()->contains(QLatin1String("dedup-blobs"))),
+    copyTrees(CommandLineParser::instance()->contains(QLatin1String("copy-trees"))),
+    notesTree(0),
+    notesLoaded(false),
+    pendingNoteCount(0),
+    notesInterval(qMax(1, CommandLineParser::instance()->optionArgument(QLatin1String("notes-interval"), QLatin1String("1000")).toInt())),
+    notesTime(0)
+{
+    foreach (RuleRepository::Branch branchRule, rule.getBranches()) 
+    {
+        Branch branch;
+        branch.created = 1;
+
+        branches.insert(branchRule.name, branch);
+    }
+
+    // create the default branch
+    branches["master"].created = 1;
+
+    initRepository(rule);
+    catFile.setWorkingDirectory(name);
+}
+
+NativeGitRepository::~NativeGitRepository()
+{
+    Q_ASSERT(outstandingTransactions == 0);
+
+    qDeleteAll(worktrees);
+    delete notesTree;
+}
+
+QString NativeGitRepository::logFileName(QString name)
+{
+    name.replace('/', '_');
+    name.prepend("log-");
+    
+    return name;
+}
+
+QByteArray NativeGitRepository::branchRef(const QString& branch)
+{
+    QByteArray ref = branch.toUtf8();
+    
+    if (!ref.startsWith("refs/"))
+    {
+        ref.prepend("refs/heads/");
+    }
+
+    return ref;
+}
+
+int NativeGitRepository::setupIncremental(int& cutoff)
+{
+    QFile logfile(logFileName(name));
+    
+    if (!logfile.exists())
+    {
+        return 1;
+    }
+
+    logfile.open(QIODevice::ReadWrite);
+
+    // only complete packs get into the log, every id in it is valid
+    QRegExp progress("progress SVN r(\\d+) branch (.*) = ([0-9a-f]{40})");
+
+    int last_revnum = 0;
+    qint64 pos = 0;
+    bool beyondCutoff = false;
+    QString bkup = logfile.fileName() + ".old";
+
+    while (!logfile.atEnd()) 
+    {
+        pos = logfile.pos();
+        QByteArray line = logfile.readLine();
+        int hash = line.indexOf('#');
+        
+        if (hash != -1)
+        {
+            line.truncate(hash);
+        }
+        
+        line = line.trimmed();
+        
+        if (line.isEmpty())
+        {
+            continue;
+        }
+        
+        if (!progress.exactMatch(line)) 
+        {
+            if (line.startsWith("progress SVN r"))
+            {
+                qFatal("%s was not exported with --backend native, resume it with the backend it was started with", qPrintable(name));
+            }
+            
+            continue;
+        }
+
+        int revnum = progress.cap(1).toInt();
+        QString branch = progress.cap(2);
+        QByteArray id = QByteArray::fromHex(progress.cap(3).toLatin1());
+
+        if (revnum >= cutoff) 
+        {
+            beyondCutoff = true;
+            break;
+        }
+
+        if (revnum < last_revnum)
+        {
+            qWarning() << "WARN:" << name << "revision numbers are not monotonic: got" << QString::number(last_revnum) << "and then" << QString::number(revnum);
+        }
+
+        last_revnum = revnum;
+
+        if (id.count('\0') == id.size())
+        {
+            id.clear();
+        }
+
+        Branch &br = branches[branch];
+        
+        if (!br.created || id.isEmpty() || br.ids.isEmpty() || br.ids.last().isEmpty())
+        {
+            br.created = revnum;
+        }
+        
+        br.commits.append(revnum);
+        br.ids.append(id);
+    }
+
+    if (!beyondCutoff) 
+    {
+        int retval = last_revnum + 1;
+        
+        if (retval == cutoff)
+        {
+            // a stale backup would confuse restoreLog()
+            QFile::remove(bkup);
+        }
+
+        return retval;
+    }
+
+    // backup file, since we'll truncate
+    QFile::remove(bkup);
+    logfile.copy(bkup);
+
+    // what the refs and the notes point to past the cutoff
+    QSet<QString> droppedBranches;
+    QList<QByteArray> droppedCommits;
+    logfile.seek(pos);
+
+    while (!logfile.atEnd()) 
+    {
+        QByteArray line = logfile.readLine();
+        int hash = line.indexOf('#');
+        
+        if (hash != -1)
+        {
+            line.truncate(hash);
+        }
+
+        if (progress.exactMatch(line.trimmed())) 
+        {
+            droppedBranches.insert(progress.cap(2));
+            droppedCommits.append(QByteArray::fromHex(progress.cap(3).toLatin1()));
+        }
+    }
+
+    // truncate, so that we ignore the rest of the revisions
+    qDebug() << name << "truncating history to revision" << cutoff;
+    
+    logfile.resize(pos);
+
+    // the refs go back with the log, published by the first checkpoint
+    reloadBranches();
+
+    foreach (const QString& branch, droppedBranches) 
+    {
+        if (branches.value(branch).ids.isEmpty())
+        {
+            refUpdates[branchRef(branch)] = QByteArray();
+        }
+    }
+
+    // a reset past the cutoff may name a commit that is still there
+    QSet<QByteArray> kept;
+    
+    foreach (const Branch& br, branches)
+    {
+        foreach (const QByteArray& id, br.ids)
+        {
+            kept.insert(id);
+        }
+    }
+
+    QList<QByteArray> dropped;
+    
+    foreach (const QByteArray& id, droppedCommits)
+    {
+        if (!kept.contains(id))
+        {
+            dropped.append(id);
+        }
+    }
+
+    dropNotes(dropped, cutoff);
+    
+    return cutoff;
+}
+
+void NativeGitRepository::restoreLog()
+{
+    QString file = logFileName(name);
+    QString bkup = file + ".old";
+    
+    if (!QFile::exists(bkup))
+    {
+        return;
+    }
+    
+    QFile::remove(file);
+    QFile::rename(bkup, file);
+}
+
+void NativeGitRepository::reloadBranches()
+{
+    // moves the refs back to the tips in the log, a null id deletes one
+    QHash<QString, Branch>::ConstIterator it = branches.constBegin();
+    
+    for ( ; it != branches.constEnd(); ++it) 
+    {
+        if (!it->ids.isEmpty())
+        {
+            refUpdates[branchRef(it.key())] = it->ids.last();
+        }
+    }
+}
+
+void NativeGitRepository::checkpoint()
+{
+    qDebug() << "checkpoint!, pack written for" << name;
+
+    // a streamed blob cannot span packs
+    finishBlob();
+    flushNotes();
+    completeCheckpoint(true);
+
+    packedBytes += pack.size();
+
+    // hashing and indexing the pack goes on while we export the next revisions
+    if (!pack.finish(true))
+    {
+        qFatal("Failed to write a pack for repository %s", qPrintable(name));
+    }
+
+    checkpointRefs = refUpdates;
+    checkpointLog = pendingLog;
+    refUpdates.clear();
+    pendingLog.clear();
+
+    // an empty pack is done already
+    completeCheckpoint(false);
+
+    CheckpointScheduler::instance()->checkpointed(checkpoints, packedBytes);
+}
+
+void NativeGitRepository::completeCheckpoint(bool wait)
+{
+    bool ok;
+    
+    if (!pack.backgroundDone(wait, &ok))
+    {
+        return;
+    }
+
+    if (!ok)
+    {
+        qFatal("Failed to write a pack for repository %s", qPrintable(name));
+    }
+
+    updateRefs(checkpointRefs);
+    checkpointRefs.clear();
+
+    if (checkpointLog.isEmpty())
+    {
+        return;
+    }
+
+    QFile logfile(logFileName(name));
+    
+    if (!logfile.open(QIODevice::WriteOnly | QIODevice::Append) || logfile.write(checkpointLog) != checkpointLog.size())
+    {
+        qFatal("Failed to write %s: %s", qPrintable(logfile.fileName()), qPrintable(logfile.errorString()));
+    }
+
+    checkpointLog.clear();
+}
+
+void NativeGitRepository::updateRefs(const QMap<QByteArray, QByteArray>& updates)
+{
+    if (updates.isEmpty())
+    {
+        return;
+    }
+
+    QByteArray commands;
+    QMapIterator<QByteArray, QByteArray> i(updates);
+    
+    while (i.hasNext()) 
+    {
+        i.next();
+        
+        if (i.value().isEmpty())
+        {
+            commands += "delete " + i.key() + "\n";
+        }
+        else
+        {
+            commands += "update " + i.key() + " " + i.value().toHex() + "\n";
+        }
+    }
+
+    QProcess updateRef;
+    updateRef.setWorkingDirectory(name);
+    updateRef.setProcessChannelMode(QProcess::MergedChannels);
+    updateRef.start("git", QStringList() << "update-ref" << "--stdin");
+
+    if (!updateRef.waitForStarted(-1))
+    {
+        qFatal("Failed to start git update-ref for repository %s: %s", qPrintable(name), qPrintable(updateRef.errorString()));
+    }
+
+    updateRef.write(commands);
+    updateRef.closeWriteChannel();
+    updateRef.waitForFinished(-1);
+
+    if (updateRef.exitStatus() != QProcess::NormalExit || updateRef.exitCode() != 0)
+    {
+        qFatal("git update-ref failed for repository %s: %s", qPrintable(name), updateRef.readAll().constData());
+    }
+}
+
+bool NativeGitRepository::catObject(const QByteArray& objectName, QByteArray* id, QByteArray* type, QByteArray* data)
+{
+    if (catFile.state() == QProcess::NotRunning) 
+    {
+        catFile.start("git", QStringList() << "cat-file" << "--batch");
+        
+        if (!catFile.waitForStarted(-1)) 
+        {
+            qCritical() << "Failed to start git cat-file for repository" << name << ":" << catFile.errorString();
+            return false;
+        }
+    }
+
+    catFile.write(objectName + "\n");
+    catFile.waitForBytesWritten(-1);
+
+    while (!catFile.canReadLine())
+    {
+        if (!catFile.waitForReadyRead(-1))
+        {
+            return false;
+        }
+    }
+
+    // "<sha1> <type> <size>", or "<name> missing"
+    QList<QByteArray> fields = catFile.readLine().trimmed().split(' ');
+    
+    if (fields.size() != 3)
+    {
+        return false;
+    }
+
+    const qint64 size = fields.at(2).toLongLong();
+    data->clear();
+
+    // the contents are followed by a newline
+    while (data->size() < size + 1) 
+    {
+        if (catFile.bytesAvailable() == 0 && !catFile.waitForReadyRead(-1))
+        {
+            return false;
+        }
+        
+        data->append(catFile.read(size + 1 - data->size()));
+    }
+
+    data->chop(1);
+    *id = QByteArray::fromHex(fields.at(0));
+    *type = fields.at(1);
+    
+    return true;
+}
+
+bool NativeGitRepository::readObject(const QByteArray& id, GitObjectType type, QByteArray* data)
+{
+    static const char* const typeNames[] = { "", "commit", "tree", "blob", "tag" };
+    
+    GitObjectType found;
+    
+    if (pack.read(id, &found, data))
+    {
+        return found == type;
+    }
+
+    QByteArray foundId;
+    QByteArray foundType;
+    
+    return catObject(id.toHex(), &foundId, &foundType, data) && foundType == typeNames[type];
+}
+
+bool NativeGitRepository::loadTree(TreeNode* node)
+{
+    if (node->loaded)
+    {
+        return true;
+    }
+
+    QByteArray data;
+    
+    if (!readObject(node->id, GitTree, &data))
+    {
+        // going on would write trees without the files of this one
+        qFatal("Failed to read tree %s of repository %s", node->id.toHex().constData(), qPrintable(name));
+    }
+
+    // "<octal mode> <name>\0<20 byte id>" for each entry
+    int pos = 0;
+    
+    while (pos < data.size()) 
+    {
+        int space = data.indexOf(' ', pos);
+        int nul = data.indexOf('\0', space + 1);
+        
+        if (space < 0 || nul < 0 || nul + 21 > data.size())
+        {
+            qFatal("Tree %s of repository %s is corrupt", node->id.toHex().constData(), qPrintable(name));
+        }
+
+        TreeEntry entry;
+        entry.mode = data.mid(pos, space - pos).toInt(0, 8);
+        entry.id = data.mid(nul + 1, 20);
+        node->entries.insert(data.mid(space + 1, nul - space - 1), entry);
+        
+        pos = nul + 21;
+    }
+
+    node->loaded = true;
+    
+    return true;
+}
+
+QByteArray NativeGitRepository::commitTree(const QByteArray& commit)
+{
+    QHash<QByteArray, QByteArray>::ConstIterator it = commitTrees.constFind(commit);
+    
+    if (it != commitTrees.constEnd())
+    {
+        return *it;
+    }
+
+    QByteArray data;
+    
+    if (!readObject(commit, GitCommit, &data) || !data.startsWith("tree "))
+    {
+        return QByteArray();
+    }
+
+    QByteArray tree = QByteArray::fromHex(data.mid(5, 40));
+    commitTrees.insert(commit, tree);
+    
+    return tree;
+}
+
+QByteArray NativeGitRepository::lookup(const QByteArray& tree, const QByteArray& path)
+{
+    QByteArray id = tree;
+
+    foreach (const QByteArray& part, pathParts(path)) 
+    {
+        TreeNode node(id);
+        loadTree(&node);
+
+        QMap<QByteArray, TreeEntry>::ConstIterator it = node.entries.constFind(part);
+        
+        if (it == node.entries.constEnd() || it->mode != treeMode)
+        {
+            return QByteArray();
+        }
+
+        id = it->id;
+    }
+
+    return id;
+}
+
+NativeGitRepository::TreeNode* NativeGitRepository::worktree(const QString& branch)
+{
+    TreeNode* root = worktrees.value(branch);
+
+    if (!root) 
+    {
+        const Branch br = branches.value(branch);
+        QByteArray tree;
+        
+        if (!br.ids.isEmpty() && !br.ids.last().isEmpty()) 
+        {
+            tree = commitTree(br.ids.last());
+            
+            if (tree.isEmpty())
+            {
+                qFatal("Failed to read commit %s of repository %s", br.ids.last().toHex().constData(), qPrintable(name));
+            }
+        }
+
+        root = new TreeNode(tree);
+        worktrees.insert(branch, root);
+    }
+
+    recentWorktrees.removeAll(branch);
+    recentWorktrees.append(branch);
+
+    // all trees are written at the end of each commit, so dropping them loses nothing
+    while (recentWorktrees.size() > maxWorktrees)
+    {
+        delete worktrees.take(recentWorktrees.takeFirst());
+    }
+
+    return root;
+}
+
+void NativeGitRepository::setEntry(TreeNode* root, const QByteArray& path, int mode, const QByteArray& id)
+{
+    QList<QByteArray> parts = pathParts(path);
+
+    if (parts.isEmpty()) 
+    {
+        // only a copied tree can replace the root
+        if (mode == treeMode) 
+        {
+            foreach (const TreeEntry& entry, root->entries)
+            {
+                delete entry.tree;
+            }
+            
+            root->entries.clear();
+            root->id = id;
+            root->loaded = false;
+        }
+        
+        return;
+    }
+
+    TreeNode* node = root;
+    
+    for (int i = 0; i < parts.size() - 1; ++i) 
+    {
+        loadTree(node);
+        node->id.clear();
+
+        TreeEntry& entry = node->entries[parts.at(i)];
+        
+        if (entry.mode != treeMode) 
+        {
+            // a file in the way becomes a directory
+            delete entry.tree;
+            entry.tree = new TreeNode;
+            entry.mode = treeMode;
+            entry.id.clear();
+        }
+        else if (!entry.tree)
+        {
+            entry.tree = new TreeNode(entry.id);
+        }
+
+        node = entry.tree;
+    }
+
+    loadTree(node);
+    node->id.clear();
+
+    TreeEntry& entry = node->entries[parts.last()];
+    delete entry.tree;
+    entry.tree = 0;
+    entry.mode = mode;
+    entry.id = id;
+}
+
+void NativeGitRepository::removeEntry(TreeNode* root, const QByteArray& path)
+{
+    QList<QByteArray> parts = pathParts(path);
+
+    if (parts.isEmpty()) 
+    {
+        foreach (const TreeEntry& entry, root->entries)
+        {
+            delete entry.tree;
+        }
+        
+        root->entries.clear();
+        root->id.clear();
+        root->loaded = true;
+        
+        return;
+    }
+
+    QList<TreeNode*> nodes;
+    TreeNode* node = root;
+    
+    for (int i = 0; i < parts.size() - 1; ++i) 
+    {
+        loadTree(node);
+        nodes.append(node);
+
+        QMap<QByteArray, TreeEntry>::Iterator it = node->entries.find(parts.at(i));
+        
+        if (it == node->entries.end() || it->mode != treeMode)
+        {
+            return;
+        }
+
+        if (!it->tree)
+        {
+            it->tree = new TreeNode(it->id);
+        }
+
+        node = it->tree;
+    }
+
+    loadTree(node);
+    nodes.append(node);
+
+    QMap<QByteArray, TreeEntry>::Iterator it = node->entries.find(parts.last());
+    
+    if (it == node->entries.end())
+    {
+        return;
+    }
+
+    delete it->tree;
+    node->entries.erase(it);
+
+    foreach (TreeNode* changed, nodes)
+    {
+        changed->id.clear();
+    }
+}
+
+QByteArray NativeGitRepository::writeTree(TreeNode* node)
+{
+    // unchanged since it was loaded or written
+    if (!node->id.isEmpty())
+    {
+        return node->id;
+    }
+
+    // git sorts directories as if their names ended in a slash
+    QMap<QByteArray, QByteArray> sorted;
+    QMap<QByteArray, TreeEntry>::Iterator it = node->entries.begin();
+    
+    while (it != node->entries.end()) 
+    {
+        if (it->tree)
+        {
+            it->id = writeTree(it->tree);
+        }
+
+        if (it->mode == treeMode && it->id == emptyTreeId) 
+        {
+            delete it->tree;
+            it = node->entries.erase(it);
+            continue;
+        }
+
+        QByteArray key = it.key();
+        
+        if (it->mode == treeMode)
+        {
+            key += '/';
+        }
+
+        sorted.insert(key, QByteArray::number(it->mode, 8) + ' ' + it.key() + '\0' + it->id);
+        ++it;
+    }
+
+    QByteArray data;
+    
+    foreach (const QByteArray& entry, sorted)
+    {
+        data += entry;
+    }
+
+    node->id = pack.write(GitTree, data);
+    
+    return node->id;
+}
+
+QByteArray NativeGitRepository::writeCommit(const QByteArray& tree, const QList<QByteArray>& parents, const QByteArray& author, uint dt, const QByteArray& message)
+{
+    QByteArray data = "tree " + tree.toHex() + "\n";
+
+    foreach (const QByteArray& parent, parents)
+    {
+        data += "parent " + parent.toHex() + "\n";
+    }
+
+    // git-fast-import uses the committer as the author when there is none
+    const QByteArray ident = author + ' ' + QByteArray::number(dt) + " +0000\n";
+    data += "author " + ident + "committer " + ident + "\n" + message;
+
+    QByteArray id = pack.write(GitCommit, data);
+    commitTrees.insert(id, tree);
+    
+    return id;
+}
+
+void NativeGitRepository::loadNotes()
+{
+    if (notesLoaded)
+    {
+        return;
+    }
+
+    notesLoaded = true;
+    
+    QByteArray tree;
+    QByteArray id;
+    QByteArray type;
+    QByteArray data;
+
+    // notes from an earlier run
+    if (catObject("refs/notes/commits", &id, &type, &data) && type == "commit" && data.startsWith("tree ")) 
+    {
+        notesCommit = id;
+        tree = QByteArray::fromHex(data.mid(5, 40));
+
+        // whoever made the last notes commit until addNote() says otherwise
+        int committer = data.indexOf("\ncommitter ");
+        
+        if (committer != -1) 
+        {
+            QList<QByteArray> ident = data.mid(committer + 11, data.indexOf('\n', committer + 1) - committer - 11).split(' ');
+            
+            if (ident.size() > 2) 
+            {
+                ident.removeLast();
+                notesTime = ident.takeLast().toUInt();
+                notesAuthor = ident.join(" ");
+            }
+        }
+    }
+
+    notesTree = new TreeNode(tree);
+}
+
+void NativeGitRepository::dropNotes(const QList<QByteArray>& commits, int cutoff)
+{
+    loadNotes();
+
+    if (notesCommit.isEmpty())
+    {
+        return;
+    }
+
+    const QByteArray before = writeTree(notesTree);
+
+    foreach (const QByteArray& commit, commits) 
+    {
+        const QByteArray hex = commit.toHex();
+        removeEntry(notesTree, hex);
+        removeEntry(notesTree, hex.left(2) + '/' + hex.mid(2));
+    }
+
+    if (writeTree(notesTree) == before)
+    {
+        return;
+    }
+
+    // on top of the old notes, only the tree matters to git notes
+    notesMessage = "Removing the Git notes of the commits from r" + QByteArray::number(cutoff) + " on\n";
+    pendingNoteCount = 1;
+    flushNotes();
+}
+
+void NativeGitRepository::addNote(const QByteArray& commit, const QByteArray& text, const QByteArray& author, uint dt, const QByteArray& message)
+{
+    loadNotes();
+
+    // one level of fan-out like git-notes, the flat name is what git-fast-import starts with
+    const QByteArray hex = commit.toHex();
+    removeEntry(notesTree, hex);
+    setEntry(notesTree, hex.left(2) + '/' + hex.mid(2), 0100644, pack.write(GitBlob, text));
+
+    notesAuthor = author;
+    notesTime = dt;
+    notesMessage = message;
+
+    if (++pendingNoteCount >= notesInterval)
+    {
+        flushNotes();
+    }
+}
+
+void NativeGitRepository::flushNotes()
+{
+    if (!pendingNoteCount)
+    {
+        return;
+    }
+
+    QList<QByteArray> parents;
+    
+    if (!notesCommit.isEmpty())
+    {
+        parents << notesCommit;
+    }
+
+    QByteArray message = notesMessage;
+    
+    if (pendingNoteCount > 1)
+    {
+        message = "Adding Git notes for " + QByteArray::number(pendingNoteCount) + " commits\n\n";
+    }
+
+    notesCommit = writeCommit(writeTree(notesTree), parents, notesAuthor, notesTime, message);
+    refUpdates["refs/notes/commits"] = notesCommit;
+    pendingNoteCount = 0;
+}
+
+int NativeGitRepository::idFrom(const QString& branchFrom, int branchRevNum, QByteArray* id, QByteArray& branchFromDesc)
+{
+    Branch &brFrom = branches[branchFrom];
+    
+    if (!brFrom.created || brFrom.commits.isEmpty())
+    {
+        return -1;
+    }
+
+    if (branchRevNum == brFrom.commits.last()) 
+    {
+        *id = brFrom.ids.last();
+        return id->isEmpty() ? 0 : 1;
+    }
+
+    QVector<int>::const_iterator it = qUpperBound(brFrom.commits, branchRevNum);
+    
+    if (it == brFrom.commits.begin()) 
+    {
+        return 0;
+    }
+
+    int closestCommit = *--it;
+
+    if (!branchFromDesc.isEmpty()) 
+    {
+        branchFromDesc += " at r" + QByteArray::number(branchRevNum);
+        
+        if (closestCommit != branchRevNum) 
+        {
+            branchFromDesc += " => r" + QByteArray::number(closestCommit);
+        }
+    }
+
+    *id = brFrom.ids[it - brFrom.commits.begin()];
+    
+    return id->isEmpty() ? 0 : 1;
+}
+
+int NativeGitRepository::createBranch(const QString& branch, int revnum, const QString& branchFrom, int branchRevNum)
+{
+    QByteArray branchFromDesc = "from branch " + branchFrom.toUtf8();
+    QByteArray id;
+    
+    if (idFrom(branchFrom, branchRevNum, &id, branchFromDesc) == -1) 
+    {
+        qCritical() << branch << "in repository" << name << "is branching from branch" << branchFrom << "but the latter doesn't exist. Can't continue.";
+        return EXIT_FAILURE;
+    }
+
+    if (id.isEmpty()) 
+    {
+        qWarning() << "WARN:" << branch << "in repository" << name << "is branching but no exported commits exist in repository creating an empty branch.";
+        
+        // whatever the source branch points to now, like a reset from its ref
+        const Branch& source = branches[branchFrom];
+        
+        if (!source.ids.isEmpty())
+        {
+            id = source.ids.last();
+        }
+        
+        branchFromDesc += ", deleted/unknown";
+    }
+
+    qDebug() << "Creating branch:" << branch << "from" << branchFrom << "(" << branchRevNum << branchFromDesc << ")";
+
+    // Preserve note
+    branches[branch].note = branches.value(branchFrom).note;
+
+    return resetBranch(branch, revnum, id, branchFromDesc);
+}
+
+int NativeGitRepository::deleteBranch(const QString& branch, int revnum)
+{
+    return resetBranch(branch, revnum, QByteArray(), "delete");
+}
+
+int NativeGitRepository::resetBranch(const QString& branch, int revnum, const QByteArray& id, const QByteArray& comment)
+{
+    QByteArray ref = branchRef(branch);
+    Branch &br = branches[branch];
+    
+    if (br.created && br.created != revnum && !br.ids.isEmpty() && !br.ids.last().isEmpty()) 
+    {
+        QByteArray backupBranch;
+        
+        if ((comment == "delete") && ref.startsWith("refs/heads/"))
+        {
+            backupBranch = "refs/tags/backups/" + ref.mid(11) + "@" + QByteArray::number(revnum);
+        }
+        else
+        {
+            backupBranch = "refs/backups/r" + QByteArray::number(revnum) + ref.mid(4);
+        }
+        
+        qWarning() << "WARN: backing up branch" << branch << "to" << backupBranch;
+
+        refUpdates[backupBranch] = br.ids.last();
+    }
+
+    br.created = revnum;
+    br.commits.append(revnum);
+    br.ids.append(id);
+    refUpdates[ref] = id;
+
+    // the next commit starts from the new tip
+    delete worktrees.take(branch);
+    recentWorktrees.removeAll(branch);
+
+    pendingLog += "progress SVN r" + QByteArray::number(revnum) + " branch " + branch.toUtf8() + " = " + (id.isEmpty() ? QByteArray(40, '0') : id.toHex()) + " # " + comment + "\n";
+
+    return EXIT_SUCCESS;
+}
+
+void NativeGitRepository::commit()
+{
+    completeCheckpoint(false);
+
+    // the resets are in refUpdates already; this is the last point before
+    // the commits of a revision, so a good one to start a new pack
+    if (maxPackSize > 0 && pack.size() >= maxPackSize)
+    {
+        checkpoint();
+    }
+}
+
+GitRepositoryTransaction* NativeGitRepository::newTransaction(const QString& branch, const QString& svnprefix, int revnum)
+{
+    if (!branches.contains(branch)) 
+    {
+        qWarning() << "WARN: Transaction:" << branch << "is not a known branch in repository" << name << endl << "Going to create it automatically";
+    }
+
+    NativeGitRepositoryTransaction *txn = new NativeGitRepositoryTransaction;
+    txn->repository = this;
+    txn->branch = branch.toUtf8();
+    txn->svnprefix = svnprefix.toUtf8();
+    txn->datetime = 0;
+    txn->revnum = revnum;
+    txn->treeCopied = false;
+
+    if (CheckpointScheduler::instance()->checkpointDue(checkpoints, packedBytes + pack.size(), 0)) 
+    {
+        checkpoint();
+    }
+    
+    outstandingTransactions++;
+    
+    return txn;
+}
+
+QIODevice* NativeGitRepository::startBlob(NativeGitRepositoryTransaction* txn, int change, qint64 length, const QByteArray& contentKey)
+{
+    finishBlob();
+
+    blobOwner = txn;
+    blobChange = change;
+    blobKey = contentKey;
+    blobDevice.start(&pack, length);
+
+    return &blobDevice;
+}
+
+void NativeGitRepository::finishBlob()
+{
+    if (!blobOwner)
+    {
+        return;
+    }
+
+    if (blobDevice.missing() > 0)
+    {
+        qFatal("Blob for repository %s is %lld bytes short", qPrintable(name), blobDevice.missing());
+    }
+
+    NativeGitRepositoryTransaction::Change &change = blobOwner->modifications[blobChange];
+
+    if (blobDevice.isStreaming()) 
+    {
+        change.id = pack.endObject();
+    }
+    else if (dedupBlobs && !blobKey.isEmpty()) 
+    {
+        // addExistingFile() needs the id right away
+        change.id = pack.write(GitBlob, blobDevice.takeData());
+    }
+    else
+    {
+        change.ticket = pack.add(GitBlob, blobDevice.takeData());
+    }
+
+    if (dedupBlobs && !blobKey.isEmpty())
+    {
+        blobIds.insert(blobKey, change.id);
+    }
+
+    blobOwner = 0;
+    blobChange = -1;
+    blobKey.clear();
+}
+
+void NativeGitRepository::forgetTransaction(NativeGitRepositoryTransaction* txn)
+{
+    if (blobOwner == txn)
+    {
+        finishBlob();
+    }
+
+    --outstandingTransactions;
+}
+
+void NativeGitRepository::createAnnotatedTag(const QString& ref, const QString& svnprefix, int revnum, const QByteArray& author, uint dt, const QByteArray& log)
+{
+    QString tagName = ref;
+    
+    if (tagName.startsWith("refs/tags/"))
+    {
+        tagName.remove(0, 10);
+    }
+
+    if (!annotatedTags.contains(tagName))
+    {
+        printf("Creating annotated tag %s (%s)\n", qPrintable(tagName), qPrintable(ref));
+    }
+    else
+    {
+        printf("Re-creating annotated tag %s\n", qPrintable(tagName));
+    }
+
+    AnnotatedTag &tag = annotatedTags[tagName];
+    tag.supportingRef = ref;
+    tag.svnprefix = svnprefix.toUtf8();
+    tag.revnum = revnum;
+    tag.author = author;
+    tag.log = log;
+    tag.dt = dt;
+}
+
+void NativeGitRepository::close()
+{
+    checkpoint();
+    completeCheckpoint(true);
+
+    if (catFile.state() != QProcess::NotRunning) 
+    {
+        catFile.closeWriteChannel();
+        catFile.waitForFinished(-1);
+    }
+}
+
+void NativeGitRepository::finalizeTags()
+{
+    if (annotatedTags.isEmpty())
+    {
+        return;
+    }
+
+    printf("Finalising tags for %s...", qPrintable(name));
+
+    QHash<QString, AnnotatedTag>::ConstIterator it = annotatedTags.constBegin();
+    for ( ; it != annotatedTags.constEnd(); ++it) 
+    {
+        const QString &tagName = it.key();
+        const AnnotatedTag &tag = it.value();
+
+        QByteArray message = tag.log;
+        if (!message.endsWith('\n'))
+        {
+            message += '\n';
+        }
+        
+        if (CommandLineParser::instance()->contains("add-metadata"))
+        {
+            message += "\n" + formatMetadataMessage(tag.svnprefix, tag.revnum, tagName.toUtf8());
+        }
+
+        const Branch br = branches.value(tag.supportingRef);
+        
+        if (br.ids.isEmpty() || br.ids.last().isEmpty()) 
+        {
+            qWarning() << "WARN: not creating annotated tag" << tagName << "," << tag.supportingRef << "has no commit";
+            continue;
+        }
+
+        QByteArray object = "object " + br.ids.last().toHex() + "\n" + "type commit\n" + "tag " + tagName.toUtf8() + "\n" + "tagger " + tag.author + ' ' + QByteArray::number(tag.dt) + " +0000" + "\n" + "\n" + message;
+        refUpdates["refs/tags/" + tagName.toUtf8()] = pack.write(GitTag, object);
+
+        // Append note to the tip commit of the supporting ref, like the
+        // fast-import backend does.
+        if (CommandLineParser::instance()->contains("add-metadata-notes")) 
+        {
+            GitRepositoryTransaction* txn = newTransaction(tag.supportingRef, tag.svnprefix, tag.revnum);
+            txn->setAuthor(tag.author);
+            txn->setDateTime(tag.dt);
+            txn->commitNote(formatMetadataMessage(tag.svnprefix, tag.revnum, tagName.toUtf8()), true);
+            delete txn;
+        }
+
+        printf(" %s", qPrintable(tagName));
+        
+        fflush(stdout);
+    }
+    
+    printf("\n");
+}
+
+bool NativeGitRepository::branchExists(const QString& branch) const
+{
+    return branches.contains(branch);
+}
+
+bool NativeGitRepository::hasCommitFrom(const QString& branch, int revnum)
+{
+    QByteArray dummy;
+    QByteArray id;
+    return idFrom(branch, revnum, &id, dummy) > 0;
+}
+
+const QByteArray NativeGitRepository::branchNote(const QString& branch) const
+{
+    return branches.value(branch).note;
+}
+
+void NativeGitRepository::setBranchNote(const QString& branch, const QByteArray& noteText)
+{
+    if (branches.contains(branch))
+        branches[branch].note = noteText;
+}
+
+bool NativeGitRepository::hasPrefix() const
+{
+    return !prefix.isEmpty();
+}
+
+const QString& NativeGitRepository::getName() const
+{
+    return name;
+}
+
+GitRepository* NativeGitRepository::getEffectiveRepository()
+{
+    return this;
+}
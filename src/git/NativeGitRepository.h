@@ -0,0 +1,241 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NATIVE_GIT_REPOSITORY_H
+#define NATIVE_GIT_REPOSITORY_H
+
+#include <QMap>
+#include <QHash>
+#include <QVector>
+#include <QProcess>
+#include <QIODevice>
+
+#include "GitRepository.h"
+#include "GitPackWriter.h"
+
+class GitRepositoryTransaction;
+class NativeGitRepositoryTransaction;
+
+/**
+ * What addFile() hands out: takes exactly the announced length of a blob,
+ * the newline the callers write after it for git-fast-import is dropped.
+ * Blobs too large to be buffered are streamed into the pack as they come.
+ */
+class NativeBlobDevice : public QIODevice
+{
+
+public:
+
+    NativeBlobDevice();
+
+    void start(GitPackWriter* pack, qint64 length);
+    bool isStreaming() const;
+    qint64 missing() const;
+    QByteArray takeData();
+
+    bool isSequential() const;
+
+protected:
+
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 length);
+
+private:
+
+    GitPackWriter* pack;
+    QByteArray buffer;
+    qint64 remaining;
+    bool streaming;
+};
+
+/**
+ * Writes the objects of a repository itself instead of going through
+ * git-fast-import (--backend native). Blobs, trees and commits go into
+ * packs written by GitPackWriter; the refs and the log of exported
+ * revisions are only updated after a pack is complete, at checkpoints
+ * and on close(), so a resumed run only ever sees finished packs.
+ */
+class NativeGitRepository : public GitRepository
+{
+
+public:
+
+    struct Branch
+    {
+        Branch();
+        
+        int created;
+        QVector<int> commits;
+        QVector<QByteArray> ids;
+        QByteArray note;
+    };
+
+    NativeGitRepository(const RuleRepository& rule);
+    ~NativeGitRepository();
+
+    int setupIncremental(int& cutoff);
+    void restoreLog();
+    void reloadBranches();
+    int createBranch(const QString& branch, int revnum, const QString& branchFrom, int revFrom);
+    int deleteBranch(const QString& branch, int revnum);
+    GitRepositoryTransaction* newTransaction(const QString& branch, const QString& svnprefix, int revnum);
+    void createAnnotatedTag(const QString& name, const QString& svnprefix, int revnum, const QByteArray& author, uint dt, const QByteArray& log);
+
+    void close();
+    void finalizeTags();
+    void commit();
+
+    bool branchExists(const QString& branch) const;
+    bool hasCommitFrom(const QString& branch, int revnum);
+    const QByteArray branchNote(const QString& branch) const;
+    void setBranchNote(const QString& branch, const QByteArray& noteText);
+    bool hasPrefix() const;
+    const QString& getName() const;
+    GitRepository* getEffectiveRepository();
+
+private:
+
+    struct AnnotatedTag
+    {
+        QString supportingRef;
+        QByteArray svnprefix;
+        QByteArray author;
+        QByteArray log;
+        uint dt;
+        int revnum;
+    };
+
+    struct TreeNode;
+
+    struct TreeEntry
+    {
+        TreeEntry();
+        
+        int mode;
+        QByteArray id;
+
+        // the loaded contents of a directory, null until needed
+        TreeNode* tree;
+    };
+
+    // a directory; its id is null while it has unwritten changes
+    struct TreeNode
+    {
+        TreeNode(const QByteArray& id = QByteArray());
+        ~TreeNode();
+
+        QMap<QByteArray, TreeEntry> entries;
+        QByteArray id;
+        bool loaded;
+    };
+
+    static QString logFileName(QString name);
+    static QByteArray branchRef(const QString& branch);
+
+    void checkpoint();
+
+    // publishes the refs and the log of the last checkpoint once its pack
+    // is in place, waits for that if asked to
+    void completeCheckpoint(bool wait);
+    void updateRefs(const QMap<QByteArray, QByteArray>& updates);
+
+    bool catObject(const QByteArray& name, QByteArray* id, QByteArray* type, QByteArray* data);
+    bool readObject(const QByteArray& id, GitObjectType type, QByteArray* data);
+    bool loadTree(TreeNode* node);
+    QByteArray commitTree(const QByteArray& commit);
+    QByteArray lookup(const QByteArray& tree, const QByteArray& path);
+
+    TreeNode* worktree(const QString& branch);
+    void setEntry(TreeNode* root, const QByteArray& path, int mode, const QByteArray& id);
+    void removeEntry(TreeNode* root, const QByteArray& path);
+    QByteArray writeTree(TreeNode* node);
+    QByteArray writeCommit(const QByteArray& tree, const QList<QByteArray>& parents, const QByteArray& author, uint dt, const QByteArray& message);
+    void loadNotes();
+    void dropNotes(const QList<QByteArray>& commits, int cutoff);
+    void addNote(const QByteArray& commit, const QByteArray& text, const QByteArray& author, uint dt, const QByteArray& message);
+    void flushNotes();
+
+    // -1 if the branch does not exist, 0 if it has no commit yet at that revision
+    int idFrom(const QString& branchFrom, int branchRevNum, QByteArray* id, QByteArray& desc);
+    int resetBranch(const QString& branch, int revnum, const QByteArray& id, const QByteArray& comment);
+
+    // the blob of the last addFile() is complete once the next call comes
+    QIODevice* startBlob(NativeGitRepositoryTransaction* txn, int change, qint64 length, const QByteArray& contentKey);
+    void finishBlob();
+
+    // called when a transaction is deleted
+    void forgetTransaction(NativeGitRepositoryTransaction* t);
+
+    QHash<QString, Branch> branches;
+    QHash<QString, AnnotatedTag> annotatedTags;
+    QString name;
+    QString prefix;
+    int outstandingTransactions;
+    int checkpoints;
+
+    GitPackWriter pack;
+    qint64 maxPackSize;
+
+    /* bytes in the packs finished so far */
+    qint64 packedBytes;
+
+    // reads the objects of earlier packs
+    QProcess catFile;
+
+    // working trees of the branch tips, the most recently committed last
+    QHash<QString, TreeNode*> worktrees;
+    QList<QString> recentWorktrees;
+
+    // null ids delete the ref
+    QMap<QByteArray, QByteArray> refUpdates;
+    QByteArray pendingLog;
+
+    /* waiting for the pack being finished in the background */
+    QMap<QByteArray, QByteArray> checkpointRefs;
+    QByteArray checkpointLog;
+
+    QHash<QByteArray, QByteArray> commitTrees;
+
+    NativeBlobDevice blobDevice;
+    NativeGitRepositoryTransaction* blobOwner;
+    int blobChange;
+    QByteArray blobKey;
+
+    /* ids of the blobs written so far, by content checksum */
+    QHash<QByteArray, QByteArray> blobIds;
+    bool dedupBlobs;
+
+    /* copied directories reuse the git tree of their source */
+    bool copyTrees;
+
+    TreeNode* notesTree;
+    QByteArray notesCommit;
+    bool notesLoaded;
+
+    /* notes in notesTree that no commit records yet */
+    int pendingNoteCount;
+    int notesInterval;
+    QByteArray notesAuthor;
+    uint notesTime;
+    QByteArray notesMessage;
+
+    friend class NativeGitRepositoryTransaction;
+    Q_DISABLE_COPY(NativeGitRepository)
+};
+
+#endif
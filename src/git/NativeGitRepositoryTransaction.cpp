@@ -0,0 +1,332 @@
+#include "NativeGitRepositoryTransaction.h"
+
+#include <QDebug>
+
+#include <stdio.h>
+
+#include "commandline/CommandLineParser.h"
+
+NativeGitRepositoryTransaction::~NativeGitRepositoryTransaction()
+{
+    repository->forgetTransaction(this);
+}
+
+void NativeGitRepositoryTransaction::setAuthor(const QByteArray& a)
+{
+    author = a;
+}
+
+void NativeGitRepositoryTransaction::setDateTime(uint dt)
+{
+    datetime = dt;
+}
+
+void NativeGitRepositoryTransaction::setLog(const QByteArray& l)
+{
+    log = l;
+}
+
+void NativeGitRepositoryTransaction::noteCopyFromBranch(const QString& branchFrom, int branchRevNum)
+{
+    if(branch == branchFrom) 
+    {
+        qWarning() << "WARN: Cannot merge inside a branch";
+        
+        return;
+    }
+    
+    QByteArray dummy;
+    QByteArray id;
+    int found = repository->idFrom(branchFrom, branchRevNum, &id, dummy);
+
+    if (found == -1) 
+    {
+        qWarning() << "WARN:" << branch << "is copying from branch" << branchFrom << "but the latter doesn't exist.  Continuing, assuming the files exist.";
+    } 
+    else if (found == 0) 
+    {
+        qWarning() << "WARN: Unknown revision r" << QByteArray::number(branchRevNum) << ".  Continuing, assuming the files exist.";
+    } 
+    else 
+    {
+        qWarning() << "WARN: repository " + repository->name + " branch " + branch + " has some files copied from " + branchFrom + "@" + QByteArray::number(branchRevNum);
+
+        for (int i = 0; i < merges.size(); ++i) 
+        {
+            if (merges.at(i).second == id) 
+            {
+                qDebug() << "merge point already recorded";
+                return;
+            }
+        }
+
+        merges.append(qMakePair(branchRevNum, id));
+        qDebug() << "adding" << branchFrom + "@" + QByteArray::number(branchRevNum) << ":" << id.toHex() << "as a merge point";
+    }
+}
+
+void NativeGitRepositoryTransaction::deleteFile(const QString& path)
+{
+    QString pathNoSlash = repository->prefix + path;
+    
+    if(pathNoSlash.endsWith('/'))
+    {
+        pathNoSlash.chop(1);
+    }
+
+    if (treeCopied) 
+    {
+        modifyFile(pathNoSlash, 0, QByteArray());
+        return;
+    }
+    
+    deletions.append(pathNoSlash.toUtf8());
+}
+
+QIODevice* NativeGitRepositoryTransaction::addFile(const QString& path, int mode, qint64 length, const QByteArray& contentKey)
+{
+    repository->finishBlob();
+
+    int change = modifyFile(repository->prefix + path, mode, QByteArray());
+
+    return repository->startBlob(this, change, length, contentKey);
+}
+
+bool NativeGitRepositoryTransaction::addExistingFile(const QString& path, int mode, const QByteArray& contentKey)
+{
+    if (!repository->dedupBlobs || contentKey.isEmpty())
+    {
+        return false;
+    }
+
+    // the previous blob may be the one asked for
+    repository->finishBlob();
+
+    QHash<QByteArray, QByteArray>::ConstIterator it = repository->blobIds.constFind(contentKey);
+    
+    if (it == repository->blobIds.constEnd())
+    {
+        return false;
+    }
+
+    modifyFile(repository->prefix + path, mode, *it);
+    
+    return true;
+}
+
+bool NativeGitRepositoryTransaction::copyTree(const QString& branchFrom, int revFrom, const QString& pathFrom, const QString& path)
+{
+    if (!repository->copyTrees)
+    {
+        return false;
+    }
+
+    QByteArray dummy;
+    QByteArray commit;
+    
+    if (repository->idFrom(branchFrom, revFrom, &commit, dummy) <= 0)
+    {
+        return false;
+    }
+
+    QByteArray root = repository->commitTree(commit);
+    
+    if (root.isEmpty())
+    {
+        return false;
+    }
+
+    QByteArray tree = repository->lookup(root, (repository->prefix + pathFrom).toUtf8());
+    
+    if (tree.isEmpty())
+    {
+        return false;
+    }
+
+    QString target = repository->prefix + path;
+    
+    if (target.endsWith('/'))
+    {
+        target.chop(1);
+    }
+
+    repository->finishBlob();
+    modifyFile(target, 040000, tree);
+    treeCopied = true;
+    
+    return true;
+}
+
+int NativeGitRepositoryTransaction::modifyFile(const QString& path, int mode, const QByteArray& id)
+{
+    Change change;
+    change.path = path.toUtf8();
+    change.mode = mode;
+    change.id = id;
+    change.ticket = -1;
+
+    modifications.append(change);
+    
+    return modifications.size() - 1;
+}
+
+void NativeGitRepositoryTransaction::commitNote(const QByteArray& noteText, bool append, const QByteArray& commit)
+{
+    const QByteArray branchRef = NativeGitRepository::branchRef(QString::fromUtf8(branch));
+    const QByteArray &commitRef = commit.isNull() ? branchRef : commit;
+    QByteArray message = "Adding Git note for current " + commitRef + "\n";
+    QByteArray text = noteText;
+
+    if (append && commit.isNull() && repository->branchExists(branch) && !repository->branchNote(branch).isEmpty())
+    {
+        text = repository->branchNote(branch) + text;
+        message = "Appending Git note for current " + commitRef + "\n";
+    }
+
+    QByteArray target;
+    
+    if (commit.isNull()) 
+    {
+        const NativeGitRepository::Branch br = repository->branches.value(branch);
+        
+        if (!br.ids.isEmpty())
+        {
+            target = br.ids.last();
+        }
+    }
+    else if (commit.size() == 40)
+    {
+        target = QByteArray::fromHex(commit);
+    }
+
+    if (target.isEmpty()) 
+    {
+        qWarning() << "WARN: no commit to note for" << commitRef << "in repository" << repository->name;
+        return;
+    }
+
+    repository->addNote(target, text + "\n", author, datetime, message + "\n");
+
+    if (commit.isNull()) 
+    {
+        repository->setBranchNote(QString::fromUtf8(branch), text);
+    }
+}
+
+void NativeGitRepositoryTransaction::commit()
+{
+    repository->finishBlob();
+
+    // create the commit message
+    QByteArray message = log;
+    if (!message.endsWith('\n'))
+    {
+        message += '\n';
+    }
+    
+    if (CommandLineParser::instance()->contains("add-metadata"))
+    {
+        message += "\n" + GitRepository::formatMetadataMessage(svnprefix, revnum);
+    }
+
+    // Call external message filter if provided
+    message = repository->msgFilter(message);
+
+    QList<QByteArray> parents;
+    NativeGitRepository::Branch &br = repository->branches[branch];
+    
+    if (br.created && !br.ids.isEmpty() && !br.ids.last().isEmpty()) 
+    {
+        parents.append(br.ids.last());
+    } 
+    else 
+    {
+        qWarning() << "WARN: Branch" << branch << "in repository" << repository->name << "doesn't exist at revision"
+                   << revnum << "-- did you resume from the wrong revision?";
+        br.created = revnum;
+    }
+
+    // note some of the inferred merges
+    QByteArray desc = "";
+
+    if(log.contains("This commit was manufactured by cvs2svn") && merges.count() > 1) 
+    {
+        qSort(merges);
+        parents.append(merges.last().second);
+        merges.pop_back();
+        qWarning() << "WARN: Discarding all but the highest merge point as a workaround for cvs2svn created branch/tag Discarded revisions:" << merges.size();
+    } 
+    else 
+    {
+        for (int i = 0; i < merges.size(); ++i) 
+        {
+            const QByteArray &merge = merges.at(i).second;
+            
+            if (parents.contains(merge)) 
+            {
+                qDebug() << "Skipping marking" << merge.toHex() << "as a merge point as it matches the parent";
+                continue;
+            }
+
+            if (parents.size() >= 16) 
+            {
+                // like the fast-import backend, don't emit more than 16 parents
+                qWarning() << "WARN: too many merge parents";
+                break;
+            }
+
+            desc += " " + merge.toHex();
+            parents.append(merge);
+        }
+    }
+
+    NativeGitRepository::TreeNode *root = repository->worktree(QString::fromUtf8(branch));
+
+    // write the file deletions
+    if (deletions.contains(""))
+    {
+        repository->removeEntry(root, QByteArray());
+    }
+    else
+    {
+        foreach (const QByteArray &path, deletions)
+        {
+            repository->removeEntry(root, path);
+        }
+    }
+
+    // write the file modifications
+    for (int i = 0; i < modifications.size(); ++i) 
+    {
+        Change &change = modifications[i];
+
+        if (change.mode == 0) 
+        {
+            repository->removeEntry(root, change.path);
+            continue;
+        }
+        
+        if (change.ticket != -1) 
+        {
+            change.id = repository->pack.id(change.ticket);
+            change.ticket = -1;
+        }
+
+        repository->setEntry(root, change.path, change.mode, change.id);
+    }
+
+    QByteArray id = repository->writeCommit(repository->writeTree(root), parents, author, datetime, message);
+
+    br.commits.append(revnum);
+    br.ids.append(id);
+    repository->refUpdates[NativeGitRepository::branchRef(QString::fromUtf8(branch))] = id;
+    repository->pendingLog += "progress SVN r" + QByteArray::number(revnum) + " branch " + branch + " = " + id.toHex() + (desc.isEmpty() ? "" : " # merge from") + desc + "\n";
+    
+    printf(" %d modifications from SVN %s to %s/%s", deletions.count() + modifications.count(), svnprefix.data(), qPrintable(repository->name), branch.data());
+
+    // Commit metadata note if requested
+    if (CommandLineParser::instance()->contains("add-metadata-notes"))
+    {
+        commitNote(GitRepository::formatMetadataMessage(svnprefix, revnum), false, QByteArray());
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NATIVE_GIT_REPOSITORY_TRANSACTION_H
+#define NATIVE_GIT_REPOSITORY_TRANSACTION_H
+
+#include <QList>
+#include <QPair>
+#include <QByteArray>
+
+#include "GitRepositoryTransaction.h"
+
+#include "NativeGitRepository.h"
+
+class NativeGitRepositoryTransaction : public GitRepositoryTransaction
+{
+
+public:
+    
+    Q_DISABLE_COPY(NativeGitRepositoryTransaction)
+
+    ~NativeGitRepositoryTransaction();
+    
+    void commit();
+
+    void setAuthor(const QByteArray &author);
+    void setDateTime(uint dt);
+    void setLog(const QByteArray &log);
+
+    void noteCopyFromBranch (const QString &prevbranch, int revFrom);
+
+    void deleteFile(const QString &path);
+    QIODevice *addFile(const QString &path, int mode, qint64 length, const QByteArray &contentKey = QByteArray());
+    bool addExistingFile(const QString &path, int mode, const QByteArray &contentKey);
+    bool copyTree(const QString &branchFrom, int revFrom, const QString &pathFrom, const QString &path);
+
+    void commitNote(const QByteArray &noteText, bool append, const QByteArray &commit);
+    
+private:
+
+    // a mode of 0 deletes the path
+    struct Change
+    {
+        QByteArray path;
+        int mode;
+        QByteArray id;
+
+        // the pack has not named the blob yet
+        int ticket;
+    };
+    
+    NativeGitRepository *repository;
+    
+    QByteArray branch;
+    QByteArray svnprefix;
+    QByteArray author;
+    QByteArray log;
+    uint datetime;
+    int revnum;
+
+    // the revision the merged commit was exported for, and its id
+    QList<QPair<int, QByteArray> > merges;
+
+    QList<QByteArray> deletions;
+    QList<Change> modifications;
+
+    // once a tree was copied, deletions have to stay in order with the modifications
+    bool treeCopied;
+    
+    int modifyFile(const QString &path, int mode, const QByteArray &id);
+
+    inline NativeGitRepositoryTransaction() {}
+    
+    friend class NativeGitRepository;
+};
+
+#endif
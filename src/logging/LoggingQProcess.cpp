@@ -1,9 +1,21 @@
 #include "LoggingQProcess.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "PipeWriter.h"
 #include "commandline/CommandLineParser.h"
 
-LoggingQProcess::LoggingQProcess(const QString& filename) : QProcess(), log() 
+static const int responseChildFd = 3;
+static const int inputChildFd = 0;
+
+LoggingQProcess::LoggingQProcess(const QString& filename) : QProcess(), log(), sent(0) 
 {
+    responseFds[0] = responseFds[1] = -1;
+    inputFds[0] = inputFds[1] = -1;
+    
     if(CommandLineParser::instance()->contains("debug-rules"))
     {
         logging = true;
@@ -21,6 +33,9 @@ LoggingQProcess::LoggingQProcess(const QString& filename) : QProcess(), log()
     
 LoggingQProcess::~LoggingQProcess() 
 {
+    closeInputChannel();
+    closeResponseChannel();
+
     if(logging) 
     {
         log.close();
@@ -43,7 +58,7 @@ qint64 LoggingQProcess::write(const char* data, qint64 length)
     Q_ASSERT(state() == QProcess::Running);
     if(logging) 
     {
-        log.write(data);
+        log.write(data, length);
     }
         
     return QProcess::write(data, length);
@@ -88,3 +103,210 @@ bool LoggingQProcess::putChar(char c)
         
     return QProcess::putChar(c);
 }
+
+bool LoggingQProcess::openResponseChannel()
+{
+    Q_ASSERT(state() == QProcess::NotRunning);
+    closeResponseChannel();
+
+    if (pipe(responseFds) != 0) 
+    {
+        responseFds[0] = responseFds[1] = -1;
+        return false;
+    }
+
+    // only the child started next gets the write end, and only as fd 3
+    fcntl(responseFds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(responseFds[1], F_SETFD, FD_CLOEXEC);
+    
+    return true;
+}
+
+void LoggingQProcess::closeResponseChannel()
+{
+    for (int i = 0; i < 2; ++i) 
+    {
+        if (responseFds[i] >= 0) 
+        {
+            ::close(responseFds[i]);
+            responseFds[i] = -1;
+        }
+    }
+    
+    responseBuffer.clear();
+}
+
+bool LoggingQProcess::readResponseLine(QByteArray* line)
+{
+    Q_ASSERT(state() == QProcess::Running);
+    
+    if (responseFds[0] < 0)
+    {
+        return false;
+    }
+
+    // the child has its copy by now; without ours a dead child means EOF
+    if (responseFds[1] >= 0) 
+    {
+        ::close(responseFds[1]);
+        responseFds[1] = -1;
+    }
+
+    // the command we want an answer to may still be in our buffer
+    while (bytesToWrite() > 0) 
+    {
+        if (!waitForBytesWritten(-1))
+        {
+            return false;
+        }
+    }
+
+    int newline;
+    
+    while ((newline = responseBuffer.indexOf('\n')) < 0) 
+    {
+        char buf[4096];
+        ssize_t count = ::read(responseFds[0], buf, sizeof buf);
+        
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        
+        if (count <= 0)
+        {
+            return false;
+        }
+        
+        responseBuffer.append(buf, count);
+    }
+
+    *line = responseBuffer.left(newline);
+    responseBuffer.remove(0, newline + 1);
+    
+    return true;
+}
+
+bool LoggingQProcess::openInputChannel()
+{
+    Q_ASSERT(state() == QProcess::NotRunning);
+    closeInputChannel();
+
+    if (pipe(inputFds) != 0) 
+    {
+        inputFds[0] = inputFds[1] = -1;
+        return false;
+    }
+
+    // the write end must not leak into other children, they would keep it open
+    fcntl(inputFds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(inputFds[1], F_SETFD, FD_CLOEXEC);
+    PipeWriter::instance()->addPipe(inputFds[1]);
+    
+    return true;
+}
+
+void LoggingQProcess::closeInputChannel()
+{
+    if (inputFds[0] >= 0) 
+    {
+        ::close(inputFds[0]);
+        inputFds[0] = -1;
+    }
+
+    if (inputFds[1] >= 0) 
+    {
+        // the writer closes it once the queue is written, that is the child's EOF
+        PipeWriter::instance()->closePipe(inputFds[1]);
+        inputFds[1] = -1;
+    }
+    
+    if (state() != QProcess::NotRunning)
+    {
+        closeWriteChannel();
+    }
+}
+
+qint64 LoggingQProcess::bytesToWrite() const
+{
+    if (inputFds[1] >= 0)
+    {
+        return PipeWriter::instance()->pending(inputFds[1]);
+    }
+
+    return QProcess::bytesToWrite();
+}
+
+bool LoggingQProcess::waitForBytesWritten(int msecs)
+{
+    if (inputFds[1] >= 0)
+    {
+        return PipeWriter::instance()->flush(inputFds[1]);
+    }
+
+    return QProcess::waitForBytesWritten(msecs);
+}
+
+qint64 LoggingQProcess::bytesSent() const
+{
+    return sent;
+}
+
+qint64 LoggingQProcess::writeData(const char* data, qint64 length)
+{
+    sent += length;
+
+    if (inputFds[1] < 0) 
+    {
+        qint64 written = QProcess::writeData(data, length);
+        
+        // without an event loop nothing but waiting drains the buffer
+        while (QProcess::bytesToWrite() > 32*1024) 
+        {
+            if (!QProcess::waitForBytesWritten(-1))
+            {
+                qFatal("Failed to write to process: %s", qPrintable(errorString()));
+            }
+        }
+
+        return written;
+    }
+
+    // the child has its copy by now
+    if (inputFds[0] >= 0) 
+    {
+        ::close(inputFds[0]);
+        inputFds[0] = -1;
+    }
+
+    if (!PipeWriter::instance()->write(inputFds[1], data, length))
+    {
+        qFatal("Failed to write to process: %s", strerror(PipeWriter::instance()->error(inputFds[1])));
+    }
+
+    return length;
+}
+
+void LoggingQProcess::setupChildProcess()
+{
+    // runs in the child, between fork and exec
+    if (inputFds[0] >= 0)
+    {
+        // replaces the pipe QProcess made for standard input
+        dup2(inputFds[0], inputChildFd);
+    }
+
+    if (responseFds[1] < 0)
+    {
+        return;
+    }
+
+    if (responseFds[1] == responseChildFd)
+    {
+        fcntl(responseChildFd, F_SETFD, 0);
+    }
+    else
+    {
+        dup2(responseFds[1], responseChildFd);
+    }
+}
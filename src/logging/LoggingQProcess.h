@@ -37,11 +37,35 @@ public:
     qint64 writeNoLog(const char* data, qint64 length);
     qint64 writeNoLog(const QByteArray& data);
     bool putChar(char c);
+
+    // gives the child a pipe on file descriptor 3 to answer on, call before start()
+    bool openResponseChannel();
+    void closeResponseChannel();
+    bool readResponseLine(QByteArray* line);
+
+    // feeds standard input through PipeWriter instead of our own buffer, call before start()
+    bool openInputChannel();
+    void closeInputChannel();
+
+    qint64 bytesToWrite() const;
+    bool waitForBytesWritten(int msecs = 30000);
+
+    // everything written to the child so far, over all its restarts
+    qint64 bytesSent() const;
+
+protected:
+
+    qint64 writeData(const char* data, qint64 length);
+    void setupChildProcess();
     
 private:
     
     QFile log;
     bool logging;
+    int responseFds[2];
+    int inputFds[2];
+    QByteArray responseBuffer;
+    qint64 sent;
 };
 
 #endif
@@ -0,0 +1,367 @@
+#include "PipeWriter.h"
+
+#include <QDebug>
+#include <QVector>
+#include <QMutexLocker>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "commandline/CommandLineParser.h"
+
+// small writes are appended to the last queued chunk up to this size
+static const int coalesceLimit = 64 * 1024;
+
+// writes at least this large bypass an empty queue
+static const qint64 directWriteSize = 256 * 1024;
+
+PipeWriter::Pipe::Pipe() :
+    offset(0),
+    queued(0),
+    closing(false),
+    failed(false),
+    error(0)
+{
+}
+
+PipeWriter* PipeWriter::instance()
+{
+    static PipeWriter writer;
+    return &writer;
+}
+
+PipeWriter::PipeWriter() :
+    queued(0),
+    stopping(false)
+{
+    budget = CommandLineParser::instance()->optionArgument(QLatin1String("write-buffer"), QLatin1String("64")).toLongLong() * 1024 * 1024;
+    
+    if (budget <= 0)
+    {
+        budget = 64 * 1024 * 1024;
+    }
+
+    // a child that exits early must show up as EPIPE, not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pipe(wakeFds) != 0)
+    {
+        qFatal("Failed to create a pipe: %s", strerror(errno));
+    }
+    
+    for (int i = 0; i < 2; ++i) 
+    {
+        fcntl(wakeFds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(wakeFds[i], F_SETFL, fcntl(wakeFds[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    start();
+}
+
+PipeWriter::~PipeWriter()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+    }
+    
+    wakeUp();
+    wait();
+
+    foreach (int fd, pipes.keys())
+    {
+        ::close(fd);
+    }
+    
+    ::close(wakeFds[0]);
+    ::close(wakeFds[1]);
+}
+
+void PipeWriter::addPipe(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    
+    QMutexLocker locker(&mutex);
+    Q_ASSERT(!pipes.contains(fd));
+    pipes.insert(fd, Pipe());
+}
+
+bool PipeWriter::write(int fd, const char* data, qint64 length)
+{
+    QMutexLocker locker(&mutex);
+
+    if (length >= directWriteSize && pipes.contains(fd) && pipes[fd].chunks.isEmpty() && !pipes[fd].failed && !pipes[fd].closing) 
+    {
+        // only this thread queues for the pipe, so it stays empty while we write
+        locker.unlock();
+        return writeDirect(fd, data, length);
+    }
+
+    // one write larger than the budget still goes through on its own
+    while (queued > 0 && queued + length > budget && pipes.contains(fd) && !pipes[fd].failed)
+    {
+        progress.wait(&mutex);
+    }
+
+    if (!pipes.contains(fd) || pipes[fd].failed || pipes[fd].closing)
+    {
+        return false;
+    }
+
+    if (length <= 0)
+    {
+        return true;
+    }
+
+    Pipe& p = pipes[fd];
+    const bool wasEmpty = p.chunks.isEmpty();
+    
+    if (p.chunks.size() > 1 && p.chunks.last().size() + length <= coalesceLimit) 
+    {
+        // not the chunk being written, so its data can't move under the writer
+        p.chunks.last().append(data, length);
+    }
+    else
+    {
+        p.chunks.append(QByteArray(data, length));
+    }
+    
+    p.queued += length;
+    queued += length;
+    locker.unlock();
+
+    if (wasEmpty)
+    {
+        wakeUp();
+    }
+    
+    return true;
+}
+
+int PipeWriter::error(int fd)
+{
+    QMutexLocker locker(&mutex);
+    QHash<int, Pipe>::ConstIterator it = pipes.constFind(fd);
+
+    if (it == pipes.constEnd() || !it->error)
+    {
+        return EPIPE;
+    }
+
+    return it->error;
+}
+
+qint64 PipeWriter::pending(int fd)
+{
+    QMutexLocker locker(&mutex);
+    return pipes.value(fd).queued;
+}
+
+bool PipeWriter::flush(int fd)
+{
+    QMutexLocker locker(&mutex);
+
+    while (pipes.contains(fd) && !pipes[fd].failed && pipes[fd].queued > 0)
+    {
+        progress.wait(&mutex);
+    }
+
+    return pipes.contains(fd) && !pipes[fd].failed;
+}
+
+void PipeWriter::closePipe(int fd)
+{
+    QMutexLocker locker(&mutex);
+    
+    if (!pipes.contains(fd))
+    {
+        return;
+    }
+
+    pipes[fd].closing = true;
+    locker.unlock();
+    
+    wakeUp();
+}
+
+bool PipeWriter::writeDirect(int fd, const char* data, qint64 length)
+{
+    while (length > 0) 
+    {
+        ssize_t count = ::write(fd, data, length);
+
+        if (count < 0 && errno == EAGAIN) 
+        {
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count < 0) 
+        {
+            const int error = errno;
+            qWarning() << "WARN: writing to a child process failed:" << strerror(error);
+            
+            QMutexLocker locker(&mutex);
+            pipes[fd].failed = true;
+            pipes[fd].error = error;
+            progress.wakeAll();
+            
+            return false;
+        }
+
+        data += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+void PipeWriter::wakeUp()
+{
+    char c = 0;
+    
+    // if the pipe is full the loop is going to wake up anyway
+    while (::write(wakeFds[1], &c, 1) < 0 && errno == EINTR)
+    {
+    }
+}
+
+void PipeWriter::release(int fd)
+{
+    // called with the mutex held
+    Pipe& p = pipes[fd];
+    queued -= p.queued;
+    p.queued = 0;
+    p.offset = 0;
+    p.chunks.clear();
+}
+
+void PipeWriter::run()
+{
+    QVector<pollfd> fds;
+
+    forever 
+    {
+        fds.resize(1);
+        fds[0].fd = wakeFds[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        {
+            QMutexLocker locker(&mutex);
+
+            if (stopping)
+            {
+                return;
+            }
+
+            QHash<int, Pipe>::Iterator it = pipes.begin();
+            
+            while (it != pipes.end()) 
+            {
+                if (it->closing && it->chunks.isEmpty()) 
+                {
+                    ::close(it.key());
+                    it = pipes.erase(it);
+                    progress.wakeAll();
+                    continue;
+                }
+
+                if (!it->chunks.isEmpty()) 
+                {
+                    pollfd pfd;
+                    pfd.fd = it.key();
+                    pfd.events = POLLOUT;
+                    pfd.revents = 0;
+                    fds.append(pfd);
+                }
+                
+                ++it;
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) 
+        {
+            if (errno != EINTR)
+            {
+                qFatal("poll() failed: %s", strerror(errno));
+            }
+            
+            continue;
+        }
+
+        if (fds[0].revents) 
+        {
+            char buf[256];
+            
+            while (::read(wakeFds[0], buf, sizeof buf) > 0)
+            {
+            }
+        }
+
+        for (int i = 1; i < fds.size(); ++i) 
+        {
+            if (!fds[i].revents)
+            {
+                continue;
+            }
+
+            const int fd = fds[i].fd;
+            QByteArray chunk;
+            int offset;
+            
+            {
+                QMutexLocker locker(&mutex);
+                chunk = pipes[fd].chunks.first();
+                offset = pipes[fd].offset;
+            }
+
+            // write outside the lock; producers only ever append behind this chunk
+            ssize_t count = ::write(fd, chunk.constData() + offset, chunk.size() - offset);
+            const int error = errno;
+
+            if (count < 0 && (error == EINTR || error == EAGAIN))
+            {
+                continue;
+            }
+
+            QMutexLocker locker(&mutex);
+            Pipe& p = pipes[fd];
+
+            if (count < 0) 
+            {
+                qWarning() << "WARN: writing to a child process failed:" << strerror(error);
+                p.error = error;
+                p.failed = true;
+                release(fd);
+            }
+            else 
+            {
+                p.offset += count;
+                p.queued -= count;
+                queued -= count;
+
+                if (p.offset == p.chunks.first().size()) 
+                {
+                    p.chunks.removeFirst();
+                    p.offset = 0;
+                }
+            }
+            
+            progress.wakeAll();
+        }
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIPE_WRITER_H
+#define PIPE_WRITER_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QByteArray>
+#include <QWaitCondition>
+
+/**
+ * Feeds the standard input of all child processes from one thread.
+ * Every pipe has its own queue; a poll loop writes to whichever pipes
+ * can take data, so several git-fast-import processes work at the same
+ * time instead of in turn. Writers only block while the data queued
+ * for all pipes together is over the budget (--write-buffer).
+ * Large writes to a pipe with nothing queued skip the queue and go
+ * straight to the pipe from the calling thread.
+ */
+class PipeWriter : public QThread
+{
+
+public:
+
+    static PipeWriter* instance();
+
+    // takes over the write end of a pipe
+    void addPipe(int fd);
+
+    // queues data, false if the pipe is broken
+    bool write(int fd, const char* data, qint64 length);
+
+    // the errno that broke the pipe, EPIPE if it was closed or is unknown
+    int error(int fd);
+
+    // bytes queued for the pipe and not written yet
+    qint64 pending(int fd);
+
+    // waits until everything queued for the pipe is written
+    bool flush(int fd);
+
+    // closes the pipe once its queue is written, does not wait for that
+    void closePipe(int fd);
+
+protected:
+
+    void run();
+
+private:
+
+    struct Pipe
+    {
+        Pipe();
+
+        QList<QByteArray> chunks;
+        int offset;
+        qint64 queued;
+        bool closing;
+        bool failed;
+        int error;
+    };
+
+    PipeWriter();
+    ~PipeWriter();
+
+    bool writeDirect(int fd, const char* data, qint64 length);
+    void wakeUp();
+    void release(int fd);
+
+    QMutex mutex;
+    QWaitCondition progress;
+    QHash<int, Pipe> pipes;
+    qint64 queued;
+    qint64 budget;
+    int wakeFds[2];
+    bool stopping;
+
+    Q_DISABLE_COPY(PipeWriter)
+};
+
+#endif
@@ -31,6 +31,7 @@
 #include <QFile>
 #include <QStringList>
 #include <QTextStream>
+#include <QTime>
 #include <QDebug>
 
 #include <limits.h>
@@ -45,6 +46,7 @@
 #include "git/GitRepository.h"
 
 #include "svn/Svn.h"
+#include "svn/SvnPlanner.h"
 
 QHash<QByteArray, QByteArray> loadIdentityMapFile(const QString &fileName)
 {
@@ -108,10 +110,12 @@ QHash<QByteArray, QByteArray> loadIdentityMapFile(const QString &fileName)
     return result;
 }
 
-QSet<int> loadRevisionsFile( const QString &fileName, Svn &svn )
+// a range up to HEAD is left open, everything from *openFrom on is wanted
+QSet<int> loadRevisionsFile( const QString &fileName, int *openFrom )
 {
     QRegExp revint("(\\d+)\\s*(?:-\\s*(\\d+|HEAD))?");
     QSet<int> revisions;
+    *openFrom = INT_MAX;
     
     if(fileName.isEmpty())
     {
@@ -155,17 +159,14 @@ QSet<int> loadRevisionsFile( const QString &fileName, Svn &svn )
                 continue;
             }
             
-            int lastrev = 0;
-            
             if(revint.cap(2) == "HEAD") 
             {
-                lastrev = svn.youngestRevision();
-                ok = true;
+                // a dump may still be loading, HEAD is wherever it ends
+                *openFrom = qMin(*openFrom, rev);
+                continue;
             } 
-            else 
-            {
-                lastrev = revint.cap(2).toInt(&ok);
-            }
+
+            int lastrev = revint.cap(2).toInt(&ok);
             
             if(!ok) 
             {
@@ -196,14 +197,33 @@ static const CommandLineOption options[] =
     {"--revisions-file FILENAME", "provide a file with revision number that should be processed"},
     {"--rules FILENAME[,FILENAME]", "the rules file(s) that determines what goes where"},
     {"--msg-filter FILENAME", "External program / script to modify svn log message"},
+    {"--msg-filter-server FILENAME", "like --msg-filter, but started once: it reads \"<length>\\n<message>\" from stdin and answers the same way on stdout for every message"},
     {"--add-metadata", "if passed, each git commit will have svn commit info"},
     {"--add-metadata-notes", "if passed, each git commit will have notes with svn commit info"},
+    {"--notes-interval NUMBER", "write the notes of --add-metadata-notes as one commit per NUMBER notes and at every checkpoint (default 1000)"},
     {"--resume-from revision", "start importing at svn revision number"},
     {"--max-rev revision", "stop importing at svn revision number"},
+    {"--prefetch NUMBER", "read the changes of up to NUMBER revisions ahead in background threads"},
+    {"--read-threads NUMBER", "read file contents with NUMBER threads while exporting directories"},
+    {"--dedup-blobs", "send file contents that were already sent in this run only once, by their SVN checksum"},
+    {"--from-dump FILENAME", "load an svnadmin/svnrdump dump (- for stdin) into the repository path while exporting it"},
+    {"--blob-index FILENAME", "remember the git ids of sent file contents in FILENAME across runs, and name them instead of sending them again when the repository (or its alternates) has them"},
+    {"--copy-trees", "attach the git tree of the source of a directory copy instead of sending all its files again"},
+    {"--backend NAME", "fast-import (default), or native to write the packs without git-fast-import"},
+    {"--pack-threads NUMBER", "compress the objects of the native backend on NUMBER threads (default: one per CPU)"},
+    {"--write-buffer MB", "queue up to MB megabytes for all git-fast-import processes together before waiting for them (default 64)"},
+    {"--diff-dirs", "when a directory is exported again, only send what differs from its previous revision or copy source"},
+    {"--plan", "scan the change lists first, skip revisions that only touch ignored paths and report progress with an ETA"},
+    {"--plan-only", "only print what --plan found, don't export anything"},
     {"--dry-run", "don't actually write anything"},
     {"--create-dump", "don't create the repository but a dump file suitable for piping into fast-import"},
     {"--debug-rules", "print what rule is being used for each file"},
+    {"--jit-rules", "match the rules with PCRE2's JIT compiler where the pattern allows it (needs a build with PCRE2)"},
     {"--commit-interval NUMBER", "if passed the cache will be flushed to git every NUMBER of commits"},
+    {"--checkpoint-interval SECONDS", "also flush a repository to git when SECONDS passed since its last checkpoint"},
+    {"--checkpoint-bytes MB", "also flush a repository to git after sending it MB megabytes"},
+    {"--checkpoint-memory MB", "also flush a repository to git once its git-fast-import grew by MB megabytes"},
+    {"--checkpoint-gap MSECS", "put off a due checkpoint while another repository checkpointed less than MSECS milliseconds ago (default 1000)"},
     {"--max-packsize NUMBER", "maximum pack file size (e.g. 512m) at which a checkpoint is created automatically. Default is unlimited (see commit-interval)."},
     {"--stats", "after a run print some statistics about the rules"},
     {"--svn-branches", "Use the contents of SVN when creating branches, Note: SVN tags are branches as well"},
@@ -280,6 +300,7 @@ int main(int argc, char **argv)
     // Load the configuration
     RuleList ruleList(args->optionArgument(QLatin1String("rules")));
     ruleList.load();
+    GitRepository::setLogSubstitutions(ruleList.getAllLogSubstitutions());
 
     int resume_from = args->optionArgument(QLatin1String("resume-from")).toInt();
     int max_rev = args->optionArgument(QLatin1String("max-rev")).toInt();
@@ -368,18 +389,101 @@ int main(int argc, char **argv)
 
     if (max_rev < 1)
     {
-        max_rev = svn.youngestRevision();
+        // a dump is exported while it loads, up to wherever it ends
+        max_rev = args->contains(QLatin1String("from-dump")) ? INT_MAX : svn.youngestRevision();
     }
 
     bool errors = false;
-    QSet<int> revisions = loadRevisionsFile(args->optionArgument(QLatin1String("revisions-file")), svn);
-    const bool filerRevisions = !revisions.isEmpty();
+    int openFrom;
+    QSet<int> revisions = loadRevisionsFile(args->optionArgument(QLatin1String("revisions-file")), &openFrom);
+    const bool filerRevisions = !revisions.isEmpty() || openFrom != INT_MAX;
+
+    if (openFrom != INT_MAX && max_rev != INT_MAX) 
+    {
+        for (int rev = openFrom; rev <= max_rev; ++rev)
+        {
+            revisions.insert(rev);
+        }
+
+        openFrom = INT_MAX;
+    }
+
+    if (filerRevisions && max_rev == INT_MAX && openFrom == INT_MAX) 
+    {
+        // nothing to wait for after the last listed revision
+        max_rev = 0;
+        
+        foreach (int rev, revisions)
+        {
+            max_rev = qMax(max_rev, rev);
+        }
+    }
+
+    bool planning = args->contains(QLatin1String("plan")) || args->contains(QLatin1String("plan-only"));
+
+    if (planning && args->contains(QLatin1String("from-dump")))
+    {
+        qWarning() << "WARN: --plan needs all revisions up front, ignored with --from-dump";
+        planning = false;
+    }
+
+    if (planning) 
+    {
+        SvnPlan plan;
+        svn.plan(min_rev, max_rev, revisions, &plan);
+        SvnPlanner::printReport(plan);
+
+        if (!args->contains(QLatin1String("plan-only")) && !plan.revisions.isEmpty()) 
+        {
+            svn.startPrefetch(plan.revisions.first(), plan.revisions.last(), plan.revisions.toSet());
+
+            QTime timer;
+            timer.start();
+            qint64 bytesDone = 0;
+
+            for (int done = 0; done < plan.revisions.size(); ++done) 
+            {
+                if (done % 100 == 0 && done > 0)
+                {
+                    SvnPlanner::printProgress(plan, done, bytesDone, timer.elapsed());
+                }
+
+                const int i = plan.revisions.at(done);
+
+                if (!svn.exportRevision(i)) 
+                {
+                    errors = true;
+                    break;
+                }
+
+                bytesDone += plan.bytes.value(i);
+            }
+
+            if (!errors)
+            {
+                SvnPlanner::printProgress(plan, plan.revisions.size(), bytesDone, timer.elapsed());
+            }
+        }
+
+        // nothing left for the loop below
+        max_rev = min_rev - 1;
+    }
+    else
+    {
+        // the prefetcher can't tell an open range, it fetches everything then
+        svn.startPrefetch(min_rev, max_rev, openFrom == INT_MAX ? revisions : QSet<int>());
+    }
     
     for (int i = min_rev; i <= max_rev; ++i) 
     {
+        if (!svn.waitForRevision(i))
+        {
+            break;
+        }
+
         if(filerRevisions) 
         {
-            if( !revisions.contains(i) ) 
+            if( !revisions.contains(i) && i < openFrom ) 
             {
                 printf(".");
                 continue;
@@ -403,6 +507,8 @@ int main(int argc, char **argv)
 	repo->close();
         delete repo;
     }
+
+    GitRepository::closeMsgFilterServer();
 	
     
     RuleStats::instance()->printStats();
@@ -0,0 +1,412 @@
+#include "CompiledRegExp.h"
+
+#include <QDebug>
+#include <QStringList>
+#include <QThreadStorage>
+
+#include "commandline/CommandLineParser.h"
+
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 16
+#include <pcre2.h>
+
+// enough for \1 to \99 and the whole match
+static const int maxCaptures = 100;
+
+struct CompiledRegExp::Code
+{
+    Code() :
+        code(0),
+        anchored(0),
+        captureCount(0)
+    {
+    }
+
+    ~Code()
+    {
+        pcre2_code_free(code);
+        pcre2_code_free(anchored);
+    }
+
+    // the JIT code ignores PCRE2_ANCHORED given to pcre2_match(), so
+    // matching at the start has a compiled pattern of its own
+    pcre2_code* code;
+    pcre2_code* anchored;
+    int captureCount;
+};
+
+/**
+ * Match data of one thread, large enough for any pattern.
+ */
+struct MatchData
+{
+    MatchData() :
+        data(pcre2_match_data_create(maxCaptures, 0))
+    {
+    }
+
+    ~MatchData()
+    {
+        pcre2_match_data_free(data);
+    }
+
+    pcre2_match_data* data;
+};
+
+static pcre2_match_data* matchData()
+{
+    static QThreadStorage<MatchData*> storage;
+
+    if (!storage.hasLocalData())
+    {
+        storage.setLocalData(new MatchData);
+    }
+
+    return storage.localData()->data;
+}
+#else
+struct CompiledRegExp::Code
+{
+};
+#endif
+
+// whether a group's alternatives are literal text, none the start of another
+static bool literalAlternatives(const QStringList& alternatives)
+{
+    static const QString special = QLatin1String("\\^$.[](){}*+?");
+
+    foreach (const QString& alternative, alternatives)
+    {
+        foreach (const QChar& c, alternative)
+        {
+            if (special.contains(c))
+            {
+                return false;
+            }
+        }
+    }
+
+    for (int i = 0; i < alternatives.size(); ++i)
+    {
+        for (int j = 0; j < alternatives.size(); ++j)
+        {
+            if (i != j && alternatives.at(j).startsWith(alternatives.at(i)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+CompiledRegExp::CompiledRegExp()
+{
+}
+
+CompiledRegExp::CompiledRegExp(const QRegExp& regExp) :
+    rx(regExp)
+{
+    static const bool enabled = CommandLineParser::instance()->contains("jit-rules");
+
+    if (!enabled)
+    {
+        return;
+    }
+
+#ifdef HAVE_PCRE2
+    reason = check(rx);
+
+    if (!reason.isEmpty())
+    {
+        return;
+    }
+
+    // QRegExp's '.' takes newlines and its '$' only matches at the very end
+    uint32_t options = PCRE2_UTF | PCRE2_UCP | PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY;
+
+    if (rx.caseSensitivity() == Qt::CaseInsensitive)
+    {
+        options |= PCRE2_CASELESS;
+    }
+
+    const QString pattern = rx.pattern();
+    int error;
+    PCRE2_SIZE offset;
+
+    QSharedPointer<Code> compiled(new Code);
+    compiled->code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.utf16()), pattern.size(), options, &error, &offset, 0);
+
+    if (compiled->code)
+    {
+        compiled->anchored = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.utf16()), pattern.size(), options | PCRE2_ANCHORED, &error, &offset, 0);
+    }
+
+    if (!compiled->anchored)
+    {
+        PCRE2_UCHAR message[256];
+        pcre2_get_error_message(error, message, sizeof message / sizeof *message);
+        reason = QString("PCRE2 does not take it: %1 at %2").arg(QString::fromUtf16(reinterpret_cast<const ushort*>(message))).arg(offset);
+
+        return;
+    }
+
+    uint32_t captures = 0;
+    pcre2_pattern_info(compiled->code, PCRE2_INFO_CAPTURECOUNT, &captures);
+
+    if (int(captures) >= maxCaptures || int(captures) != rx.captureCount())
+    {
+        reason = "the captures are counted differently";
+        return;
+    }
+
+    // without the JIT compiler pcre2_match() interprets, which still works
+    pcre2_jit_compile(compiled->code, PCRE2_JIT_COMPLETE);
+    pcre2_jit_compile(compiled->anchored, PCRE2_JIT_COMPLETE);
+    compiled->captureCount = captures;
+    code = compiled;
+#else
+    static bool warned = false;
+
+    if (!warned)
+    {
+        qWarning() << "WARN: built without PCRE2, --jit-rules has no effect";
+        warned = true;
+    }
+#endif
+}
+
+bool CompiledRegExp::isCompiled() const
+{
+    return !code.isNull();
+}
+
+const QString& CompiledRegExp::incompatibility() const
+{
+    return reason;
+}
+
+int CompiledRegExp::matchAtStart(const QString& subject) const
+{
+#ifdef HAVE_PCRE2
+    if (code)
+    {
+        pcre2_match_data* data = matchData();
+
+        // the paths are decoded with QString::fromUtf8(), which leaves no
+        // unpaired surrogates, so PCRE2 needn't scan them for that first
+        if (pcre2_match(code->anchored, reinterpret_cast<PCRE2_SPTR>(subject.utf16()), subject.size(), 0, PCRE2_NO_UTF_CHECK, data, 0) < 0)
+        {
+            return -1;
+        }
+
+        return pcre2_get_ovector_pointer(data)[1];
+    }
+#endif
+
+    if (rx.indexIn(subject) != 0)
+    {
+        return -1;
+    }
+
+    return rx.matchedLength();
+}
+
+QString& CompiledRegExp::replace(QString& subject, const QString& after) const
+{
+#ifdef HAVE_PCRE2
+    if (code)
+    {
+        pcre2_match_data* data = matchData();
+        const PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(data);
+        const PCRE2_SPTR text = reinterpret_cast<PCRE2_SPTR>(subject.utf16());
+
+        QString result;
+        int copied = 0;
+        int index = 0;
+        uint32_t options = PCRE2_NO_UTF_CHECK;
+
+        while (index <= subject.size())
+        {
+            if (pcre2_match(code->code, text, subject.size(), index, options, data, 0) < 0)
+            {
+                break;
+            }
+
+            const int start = ovector[0];
+            const int end = ovector[1];
+            result += subject.midRef(copied, start - copied);
+
+            // like QString::replace: a backslash and one or two digits name
+            // a capture if there is one with that number, else they stay
+            for (int i = 0; i < after.size(); ++i)
+            {
+                int no = i + 1 < after.size() && after.at(i) == '\\' ? after.at(i + 1).digitValue() : -1;
+
+                if (no <= 0 || no > code->captureCount)
+                {
+                    result += after.at(i);
+                    continue;
+                }
+
+                int length = 2;
+
+                if (i + 2 < after.size())
+                {
+                    const int second = after.at(i + 2).digitValue();
+
+                    if (second != -1 && no * 10 + second <= code->captureCount)
+                    {
+                        no = no * 10 + second;
+                        ++length;
+                    }
+                }
+
+                // a group that took no part in the match is empty
+                if (ovector[2 * no] != PCRE2_UNSET)
+                {
+                    result += subject.midRef(ovector[2 * no], ovector[2 * no + 1] - ovector[2 * no]);
+                }
+
+                i += length - 1;
+            }
+
+            copied = end;
+            index = end > start ? end : start + 1;
+
+            // never start a match inside a surrogate pair, nothing checks that now
+            if (end == start && index < subject.size() && subject.at(index).isLowSurrogate())
+            {
+                ++index;
+            }
+
+            // '^' only matches where the search started the first time
+            options = PCRE2_NO_UTF_CHECK | PCRE2_NOTBOL;
+        }
+
+        result += subject.midRef(copied);
+        subject = result;
+
+        return subject;
+    }
+#endif
+
+    return subject.replace(rx, after);
+}
+
+QString CompiledRegExp::check(const QRegExp& rx)
+{
+    if (rx.patternSyntax() != QRegExp::RegExp && rx.patternSyntax() != QRegExp::RegExp2)
+    {
+        return "it is not a regular expression";
+    }
+
+    if (rx.isMinimal())
+    {
+        return "it matches minimally";
+    }
+
+    const QString pattern = rx.pattern();
+
+    // the alternatives of the groups that are open, the whole pattern first
+    QList<QStringList> groups;
+    QList<int> starts;
+    groups.append(QStringList());
+    starts.append(0);
+
+    for (int i = 0; i < pattern.size(); ++i)
+    {
+        const QChar c = pattern.at(i);
+        const QChar next = i + 1 < pattern.size() ? pattern.at(i + 1) : QChar();
+
+        if (c == '\\')
+        {
+            // escapes that mean the same to both
+            if (next.isLetter() && !QString("dDsSwWbBnrtfa").contains(next))
+            {
+                return QString("PCRE2 reads \\%1 differently").arg(next);
+            }
+
+            if (next == '0' || (next.isDigit() && i + 2 < pattern.size() && pattern.at(i + 2).isDigit()))
+            {
+                return "PCRE2 reads octal escapes and back references differently";
+            }
+
+            ++i;
+        }
+        else if (c == '[')
+        {
+            for (++i; i < pattern.size(); ++i)
+            {
+                if (pattern.at(i) == '\\')
+                {
+                    ++i;
+                    continue;
+                }
+
+                if (pattern.at(i) == '[' && i + 1 < pattern.size() && QString(":.=").contains(pattern.at(i + 1)))
+                {
+                    return "QRegExp has no POSIX classes";
+                }
+
+                // a ']' right at the start of the class is part of it
+                if (pattern.at(i) == ']' && pattern.at(i - 1) != '[' && !(pattern.at(i - 1) == '^' && pattern.at(i - 2) == '['))
+                {
+                    break;
+                }
+            }
+        }
+        else if (c == '(')
+        {
+            if (next == '?' && (i + 2 >= pattern.size() || !QString(":=!").contains(pattern.at(i + 2))))
+            {
+                return "PCRE2 has group kinds QRegExp doesn't";
+            }
+
+            groups.append(QStringList());
+            starts.append(next == '?' ? i + 3 : i + 1);
+        }
+        else if (c == '|' || c == ')')
+        {
+            groups.last().append(pattern.mid(starts.last(), i - starts.last()));
+            starts.last() = i + 1;
+
+            if (c == ')' && groups.size() > 1)
+            {
+                // QRegExp takes the longest alternative, PCRE2 the first that fits
+                if (groups.last().size() > 1 && !literalAlternatives(groups.last()))
+                {
+                    return "its alternatives may match differently";
+                }
+
+                groups.removeLast();
+                starts.removeLast();
+
+                // the longest and the greediest repetition of a group can differ
+                if (rx.patternSyntax() == QRegExp::RegExp && QString("*+?{").contains(next))
+                {
+                    return "it repeats a group";
+                }
+            }
+        }
+        else if (c == '{' && next == ',')
+        {
+            return "PCRE2 reads {,n} as text";
+        }
+
+        // lazy and possessive quantifiers
+        if (i > 0 && QString("*+?}").contains(c) && (next == '?' || next == '+'))
+        {
+            return "PCRE2 has quantifiers QRegExp doesn't";
+        }
+    }
+
+    groups.last().append(pattern.mid(starts.last()));
+
+    if (groups.last().size() > 1 && !literalAlternatives(groups.last()))
+    {
+        return "its alternatives may match differently";
+    }
+
+    return QString();
+}
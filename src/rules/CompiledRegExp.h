@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPILED_REG_EXP_H
+#define COMPILED_REG_EXP_H
+
+#include <QString>
+#include <QRegExp>
+#include <QSharedPointer>
+
+/**
+ * A rule pattern compiled once with PCRE2's JIT compiler (--jit-rules),
+ * matching QString's UTF-16 directly. Patterns that PCRE2 would read
+ * or match differently than QRegExp stay on QRegExp; incompatibility()
+ * tells why. Without PCRE2 in the build everything stays on QRegExp.
+ */
+class CompiledRegExp
+{
+
+public:
+
+    CompiledRegExp();
+    explicit CompiledRegExp(const QRegExp& rx);
+
+    // the length of the match at the start of subject, -1 if there is none
+    int matchAtStart(const QString& subject) const;
+
+    // QString::replace(QRegExp, QString), \1 to \99 name the captures
+    QString& replace(QString& subject, const QString& after) const;
+
+    bool isCompiled() const;
+    const QString& incompatibility() const;
+
+    // why PCRE2 could behave differently on the pattern, empty if it can't
+    static QString check(const QRegExp& rx);
+
+private:
+
+    struct Code;
+
+    QRegExp rx;
+    QSharedPointer<Code> code;
+    QString reason;
+};
+
+#endif
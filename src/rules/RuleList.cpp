@@ -29,6 +29,7 @@ void RuleList::load()
         
         QList<RuleMatch> matchRules = rules->getMatchRules();
         this->allMatchRules.append( QList<RuleMatch>(matchRules));
+        this->allLogSubstitutions.append(rules->getLogSubstitutions());
     }
 }
 
@@ -42,6 +43,11 @@ const QList<QList<RuleMatch> > RuleList::getAllMatchRules() const
     return allMatchRules;
 }
 
+const QList<RuleMatchSubstitution> RuleList::getAllLogSubstitutions() const
+{
+    return allLogSubstitutions;
+}
+
 const QList<Rules*> RuleList::getRules() const
 {
     return rules;
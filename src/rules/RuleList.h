@@ -17,6 +17,7 @@ public:
 
   const QList<RuleRepository> getAllRepositories() const;
   const QList<QList<RuleMatch> > getAllMatchRules() const;
+  const QList<RuleMatchSubstitution> getAllLogSubstitutions() const;
   const QList<Rules*> getRules() const;
   void load();
 
@@ -26,5 +27,6 @@ private:
   QList<Rules*> rules;
   QList<RuleRepository> allrepositories;
   QList<QList<RuleMatch> > allMatchRules;
+  QList<RuleMatchSubstitution> allLogSubstitutions;
   
 };
@@ -24,6 +24,7 @@
 #include "Rule.h"
 #include "RuleMatchSubstitution.h"
 #include "RuleMatchAction.h"
+#include "CompiledRegExp.h"
 
 class QString;
 class QRegExp;
@@ -39,6 +40,7 @@ public:
     const QString info() const;
     
     QRegExp rx;
+    CompiledRegExp compiled;
     QString repository;
     QList<RuleMatchSubstitution> repo_substs;
     QString branch;
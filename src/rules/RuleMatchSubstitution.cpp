@@ -7,5 +7,5 @@ bool RuleMatchSubstitution::isValid()
 
 QString& RuleMatchSubstitution::apply(QString& string) 
 { 
-    return string.replace(pattern, replacement); 
+    return compiled.replace(string, replacement); 
 }
@@ -21,6 +21,8 @@
 
 #include <QString>
 #include <QRegExp>
+
+#include "CompiledRegExp.h"
     
 class  RuleMatchSubstitution
 {
@@ -31,6 +33,7 @@ public:
     QString& apply(QString& string);
     
     QRegExp pattern;
+    CompiledRegExp compiled;
     QString replacement;
 };
 
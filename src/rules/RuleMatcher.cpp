@@ -0,0 +1,512 @@
+#include "RuleMatcher.h"
+
+#include <algorithm>
+
+#include <QRegExp>
+#include <QString>
+#include <QtAlgorithms>
+
+// directories remembered over all epochs before the memo starts over
+static const int maxMemoSize = 100000;
+
+// whether an alternative outside any group lets the pattern start anywhere
+static bool hasTopLevelAlternative(const QString& pattern)
+{
+    int depth = 0;
+    
+    for (int i = 0; i < pattern.size(); ++i) 
+    {
+        const QChar c = pattern.at(i);
+
+        if (c == '\\') 
+        {
+            ++i;
+        }
+        else if (c == '[') 
+        {
+            // a ']' right at the start of a class is part of it
+            ++i;
+            
+            if (i < pattern.size() && pattern.at(i) == '^')
+            {
+                ++i;
+            }
+            
+            if (i < pattern.size() && pattern.at(i) == ']')
+            {
+                ++i;
+            }
+            
+            while (i < pattern.size() && pattern.at(i) != ']') 
+            {
+                if (pattern.at(i) == '\\')
+                {
+                    ++i;
+                }
+                
+                ++i;
+            }
+        }
+        else if (c == '(') 
+        {
+            ++depth;
+        }
+        else if (c == ')') 
+        {
+            --depth;
+        }
+        else if (c == '|' && depth <= 0) 
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+RuleMatcher::RuleMatcher() :
+    nodeRules(1),
+    epochs(1),
+    memoSize(0)
+{
+    epochs[0].firstUndetermined = 0;
+}
+
+RuleMatcher::RuleMatcher(const QList<RuleMatch>& rules) :
+    matchRules(rules),
+    nodeRules(1),
+    memoSize(0)
+{
+    for (int i = 0; i < matchRules.size(); ++i) 
+    {
+        const RuleMatch& rule = matchRules.at(i);
+        depths.append(slashDepth(rule.rx));
+
+        if (rule.minRevision > 0)
+        {
+            epochStarts.append(rule.minRevision);
+        }
+
+        if (rule.maxRevision != -1)
+        {
+            epochStarts.append(rule.maxRevision + 1);
+        }
+
+        const QString prefix = literalPrefix(matchRules.at(i).rx);
+        int node = 0;
+
+        for (int j = 0; j < prefix.size(); ++j) 
+        {
+            const quint64 key = (quint64(node) << 16) | prefix.at(j).unicode();
+            int child = edges.value(key, -1);
+            
+            if (child < 0) 
+            {
+                child = nodeRules.size();
+                nodeRules.resize(child + 1);
+                edges.insert(key, child);
+            }
+            
+            node = child;
+        }
+
+        nodeRules[node].append(i);
+    }
+
+    qSort(epochStarts);
+    epochStarts.erase(std::unique(epochStarts.begin(), epochStarts.end()), epochStarts.end());
+
+    // most rules of a history with reorganizations only apply for a while
+    epochs.resize(epochStarts.size() + 1);
+
+    for (int e = 0; e < epochs.size(); ++e) 
+    {
+        const int revnum = e > 0 ? epochStarts.at(e - 1) : epochStarts.value(0, 1) - 1;
+        Epoch& epoch = epochs[e];
+        epoch.actions.resize(matchRules.size());
+        epoch.firstUndetermined = matchRules.size();
+
+        for (int i = 0; i < matchRules.size(); ++i) 
+        {
+            const RuleMatch& rule = matchRules.at(i);
+            const bool applies = rule.minRevision <= revnum && (rule.maxRevision == -1 || rule.maxRevision >= revnum);
+            epoch.actions[i] = applies ? qint8(rule.action) : qint8(-1);
+
+            if (applies && depths.at(i) < 0 && epoch.firstUndetermined == matchRules.size())
+            {
+                epoch.firstUndetermined = i;
+            }
+        }
+    }
+}
+
+const QList<RuleMatch>& RuleMatcher::rules() const
+{
+    return matchRules;
+}
+
+void RuleMatcher::candidates(const QString& path, QVarLengthArray<int, 64>* result, int epoch) const
+{
+    result->resize(0);
+
+    int node = 0;
+    int lists = 0;
+    int i = 0;
+
+    forever 
+    {
+        const QVector<int>& here = nodeRules.at(node);
+        
+        if (!here.isEmpty()) 
+        {
+            result->append(here.constData(), here.size());
+            ++lists;
+        }
+
+        if (i == path.size())
+        {
+            break;
+        }
+
+        node = edges.value((quint64(node) << 16) | path.at(i++).unicode(), -1);
+        
+        if (node < 0)
+        {
+            break;
+        }
+    }
+
+    if (epoch >= 0) 
+    {
+        const qint8* actions = epochs.at(epoch).actions.constData();
+        int kept = 0;
+
+        for (int j = 0; j < result->size(); ++j) 
+        {
+            if (actions[result->at(j)] >= 0)
+            {
+                (*result)[kept++] = result->at(j);
+            }
+        }
+
+        result->resize(kept);
+    }
+
+    // each list is in rule order already
+    if (lists > 1)
+    {
+        qSort(result->data(), result->data() + result->size());
+    }
+}
+
+int RuleMatcher::epoch(int revnum) const
+{
+    return qUpperBound(epochStarts.constBegin(), epochStarts.constEnd(), revnum) - epochStarts.constBegin();
+}
+
+int RuleMatcher::action(int epoch, int index) const
+{
+    return epochs.at(epoch).actions.at(index);
+}
+
+bool RuleMatcher::recall(int epoch, int ruleMask, const QString& directory, int* index, int* length) const
+{
+    QHash<quint64, QHash<QString, QPair<int, int> > >::ConstIterator directories = memo.constFind((quint64(epoch) << 8) | ruleMask);
+    
+    if (directories == memo.constEnd())
+    {
+        return false;
+    }
+
+    QHash<QString, QPair<int, int> >::ConstIterator it = directories->constFind(directory);
+    
+    if (it == directories->constEnd())
+    {
+        return false;
+    }
+
+    *index = it->first;
+    *length = it->second;
+    
+    return true;
+}
+
+void RuleMatcher::remember(int epoch, int ruleMask, const QString& directory, int index, int length) const
+{
+    // every rule that applies up to the answer must have decided on the
+    // directory alone; a rule that matches more slashes than the directory
+    // has can't match anything directly in it, so it decided too
+    const int firstUndetermined = epochs.at(epoch).firstUndetermined;
+
+    if (index < 0 ? firstUndetermined < matchRules.size() : index >= firstUndetermined)
+    {
+        return;
+    }
+
+    if (memoSize >= maxMemoSize) 
+    {
+        memo.clear();
+        memoSize = 0;
+    }
+
+    memo[(quint64(epoch) << 8) | ruleMask].insert(directory, qMakePair(index, length));
+    ++memoSize;
+}
+
+QString RuleMatcher::literalPrefix(const QRegExp& rx)
+{
+    if (rx.caseSensitivity() != Qt::CaseSensitive)
+    {
+        return QString();
+    }
+
+    if (rx.patternSyntax() != QRegExp::RegExp && rx.patternSyntax() != QRegExp::RegExp2)
+    {
+        return QString();
+    }
+
+    const QString pattern = rx.pattern();
+    
+    if (hasTopLevelAlternative(pattern))
+    {
+        return QString();
+    }
+
+    static const QString special = QLatin1String("^$.[]()|*+?{}");
+    
+    QString prefix;
+    int i = pattern.startsWith('^') ? 1 : 0;
+
+    while (i < pattern.size()) 
+    {
+        QChar c = pattern.at(i);
+        int next = i + 1;
+
+        if (c == '\\') 
+        {
+            // classes, anchors and back references are no literal text
+            if (next == pattern.size() || pattern.at(next).isLetterOrNumber())
+            {
+                break;
+            }
+            
+            c = pattern.at(next++);
+        }
+        else if (special.contains(c)) 
+        {
+            break;
+        }
+
+        if (next < pattern.size()) 
+        {
+            const QChar quantifier = pattern.at(next);
+
+            // the character may not be there at all
+            if (quantifier == '*' || quantifier == '?' || quantifier == '{')
+            {
+                break;
+            }
+
+            // it is there at least once, but what follows may be more of it
+            if (quantifier == '+') 
+            {
+                prefix += c;
+                break;
+            }
+        }
+
+        prefix += c;
+        i = next;
+    }
+
+    return prefix;
+}
+
+int RuleMatcher::slashDepth(const QRegExp& rx)
+{
+    if (rx.patternSyntax() != QRegExp::RegExp && rx.patternSyntax() != QRegExp::RegExp2)
+    {
+        return -1;
+    }
+
+    const QString pattern = rx.pattern();
+
+    // the slashes so far in the alternative being read, for each open
+    // group and the whole pattern, and the number the alternatives before
+    // it had, which all have to agree
+    QList<int> counts;
+    QList<int> agreed;
+    counts.append(0);
+    agreed.append(-1);
+
+    bool endsInSlash = false;
+
+    for (int i = pattern.startsWith('^') ? 1 : 0; i < pattern.size(); ++i) 
+    {
+        QChar c = pattern.at(i);
+        int slashes = 0;
+
+        if (c == '\\') 
+        {
+            if (++i == pattern.size())
+            {
+                return -1;
+            }
+
+            c = pattern.at(i);
+
+            // only classes without the slash and assertions inside the match
+            if (c.isLetterOrNumber() && !QString("dswbBnrtfv").contains(c))
+            {
+                return -1;
+            }
+
+            slashes = c == '/' ? 1 : 0;
+        }
+        else if (c == '/') 
+        {
+            slashes = 1;
+        }
+        else if (c == '.' || c == '$') 
+        {
+            return -1;
+        }
+        else if (c == '[') 
+        {
+            bool negated = false;
+            bool slash = false;
+
+            if (++i < pattern.size() && pattern.at(i) == '^') 
+            {
+                negated = true;
+                ++i;
+            }
+
+            // a ']' right at the start of a class is part of it
+            for (const int start = i; i < pattern.size() && (pattern.at(i) != ']' || i == start); ++i) 
+            {
+                QChar d = pattern.at(i);
+
+                if (d == '\\') 
+                {
+                    if (++i == pattern.size())
+                    {
+                        return -1;
+                    }
+
+                    d = pattern.at(i);
+
+                    if (d.isLetterOrNumber() && !QString("dswnrtfv").contains(d))
+                    {
+                        return -1;
+                    }
+                }
+
+                if (d == '/') 
+                {
+                    slash = true;
+                }
+                else if (i + 2 < pattern.size() && pattern.at(i + 1) == '-' && pattern.at(i + 2) != ']') 
+                {
+                    if (pattern.at(i + 2) == '\\')
+                    {
+                        return -1;
+                    }
+
+                    slash = slash || (d < '/' && pattern.at(i + 2) >= '/');
+                    i += 2;
+                }
+            }
+
+            if (i == pattern.size() || slash != negated)
+            {
+                return -1;
+            }
+        }
+        else if (c == '(') 
+        {
+            // lookaheads see past the match
+            if (i + 1 < pattern.size() && pattern.at(i + 1) == '?') 
+            {
+                if (i + 2 == pattern.size() || pattern.at(i + 2) != ':')
+                {
+                    return -1;
+                }
+
+                i += 2;
+            }
+
+            counts.append(0);
+            agreed.append(-1);
+            endsInSlash = false;
+            continue;
+        }
+        else if (c == '|' || c == ')') 
+        {
+            if (agreed.last() != -1 && agreed.last() != counts.last())
+            {
+                return -1;
+            }
+
+            agreed.last() = counts.last();
+            counts.last() = 0;
+
+            if (c == '|') 
+            {
+                // each match has to end in a slash, whatever alternative it took
+                if (counts.size() == 1 && !endsInSlash)
+                {
+                    return -1;
+                }
+
+                endsInSlash = false;
+                continue;
+            }
+
+            if (counts.size() == 1)
+            {
+                return -1;
+            }
+
+            slashes = agreed.last();
+            counts.removeLast();
+            agreed.removeLast();
+        }
+        else if (c == '{') 
+        {
+            while (i < pattern.size() && pattern.at(i) != '}')
+            {
+                ++i;
+            }
+
+            endsInSlash = false;
+            continue;
+        }
+        else if (c == '*' || c == '+' || c == '?') 
+        {
+            endsInSlash = false;
+            continue;
+        }
+
+        // a repeated slash makes the number vary
+        if (slashes > 0 && i + 1 < pattern.size() && QString("*+?{").contains(pattern.at(i + 1)))
+        {
+            return -1;
+        }
+
+        counts.last() += slashes;
+        endsInSlash = slashes > 0 && c == '/';
+    }
+
+    if (counts.size() != 1 || !endsInSlash)
+    {
+        return -1;
+    }
+
+    if (agreed.last() != -1 && agreed.last() != counts.last())
+    {
+        return -1;
+    }
+
+    return counts.last();
+}
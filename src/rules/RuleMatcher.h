@@ -0,0 +1,106 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RULE_MATCHER_H
+#define RULE_MATCHER_H
+
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QVarLengthArray>
+
+#include "RuleMatch.h"
+
+class QString;
+
+/**
+ * The match rules of one rules file, with a trie of the literal text
+ * each pattern starts with. Only the rules whose literal prefix the
+ * path starts with can match it at its start, so candidates() hands out
+ * those, in the order of the rules file; rules without a literal prefix
+ * are always among them.
+ *
+ * It also remembers which rule matched in a directory: when the rules up
+ * to that one only ever match whole directories, a fixed number of them,
+ * the answer holds for everything else directly in that directory.
+ */
+class RuleMatcher
+{
+
+public:
+
+    RuleMatcher();
+    explicit RuleMatcher(const QList<RuleMatch>& rules);
+
+    const QList<RuleMatch>& rules() const;
+
+    // indexes into rules() of the rules that may match at the start of
+    // path, only those that apply in the epoch unless it is -1
+    void candidates(const QString& path, QVarLengthArray<int, 64>* result, int epoch = -1) const;
+
+    // the stretch of revisions revnum is in; the same rules apply in all of it
+    int epoch(int revnum) const;
+
+    // the action of a rule in an epoch, -1 if the rule doesn't apply then
+    int action(int epoch, int index) const;
+
+    // the rule and match length remembered for a directory, index -1 for none
+    bool recall(int epoch, int ruleMask, const QString& directory, int* index, int* length) const;
+    void remember(int epoch, int ruleMask, const QString& directory, int index, int length) const;
+
+    // the text every match of the pattern starts with, empty if unknown
+    static QString literalPrefix(const QRegExp& rx);
+
+    // the number of slashes in every match if each one ends in a slash, else -1
+    static int slashDepth(const QRegExp& rx);
+
+private:
+
+    QList<RuleMatch> matchRules;
+
+    // (node << 16) | character -> child node, node 0 is the root
+    QHash<quint64, int> edges;
+
+    // the rules whose prefix ends at a node
+    QVector<QVector<int> > nodeRules;
+
+    // slashDepth() of each rule
+    QVector<int> depths;
+
+    // the revisions at which a rule starts or stops to apply, sorted
+    QVector<int> epochStarts;
+
+    // the rules of one epoch, flat so the scan doesn't touch the RuleMatch
+    struct Epoch
+    {
+        // the action of each rule, -1 for the ones that don't apply
+        QVector<qint8> actions;
+
+        // the first applying rule with a slashDepth() of -1
+        int firstUndetermined;
+    };
+
+    QVector<Epoch> epochs;
+
+    // (epoch << 8) | ruleMask -> directory -> (rule, match length)
+    mutable QHash<quint64, QHash<QString, QPair<int, int> > > memo;
+    mutable int memoSize;
+};
+
+#endif
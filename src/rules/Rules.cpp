@@ -26,6 +26,11 @@ const QList<RuleMatch> Rules::getMatchRules() const
     return matchRules;
 }
 
+const QList<RuleMatchSubstitution> Rules::getLogSubstitutions() const
+{
+    return logSubstitutions;
+}
+
 const RuleMatchSubstitution Rules::parseSubstitution(const QString& string)
 {
     if (string.at(0) != 's' || string.length() < 5)
@@ -81,6 +86,12 @@ const RuleMatchSubstitution Rules::parseSubstitution(const QString& string)
     }
     
     subst.replacement = string.mid(end + 1, string.length() - 1 - end - 1);
+    subst.compiled = CompiledRegExp(subst.pattern);
+
+    if (!subst.compiled.incompatibility().isEmpty())
+    {
+        qWarning() << "WARN: substitution" << string << "stays on QRegExp," << subst.compiled.incompatibility();
+    }
 
     return subst;
 }
@@ -112,8 +123,10 @@ void Rules::load(const QString& filename)
     QRegExp declareLine("declare\\s+("+varRegex+")\\s*=\\s*(\\S+)", Qt::CaseInsensitive);
     QRegExp variableLine("\\$\\{("+varRegex+")(\\|[^}$]*)?\\}", Qt::CaseInsensitive);
     QRegExp includeLine("include\\s+(.*)", Qt::CaseInsensitive);
+    QRegExp filterLogLine("filter log", Qt::CaseInsensitive);
+    QRegExp filterSubstLine("substitute\\s+(.+)$", Qt::CaseInsensitive);
 
-    enum { ReadingNone, ReadingRepository, ReadingMatch } state = ReadingNone;
+    enum { ReadingNone, ReadingRepository, ReadingMatch, ReadingLogFilter } state = ReadingNone;
     RuleRepository repo;
     RuleMatch match;
     int lineNumber = 0;
@@ -331,6 +344,27 @@ void Rules::load(const QString& filename)
                     continue;
                 }
             }
+            else if (state == ReadingLogFilter) 
+            {
+                if (filterSubstLine.exactMatch(line)) 
+                {
+                    RuleMatchSubstitution subst = parseSubstitution(filterSubstLine.cap(1));
+                    
+                    if (!subst.isValid()) 
+                    {
+                        qFatal("Malformed substitution in rules file: line %d: %s",
+                            lineNumber, qPrintable(origLine));
+                    }
+                    
+                    logSubstitutions += subst;
+                    continue;
+                } 
+                else if (line == "end filter") 
+                {
+                    state = ReadingNone;
+                    continue;
+                }
+            }
 
             bool isRepositoryRule = repoLine.exactMatch(line);
             bool isMatchRule = matchLine.exactMatch(line);
@@ -356,10 +390,22 @@ void Rules::load(const QString& filename)
                 {
                     qFatal("Malformed regular expression '%s' in file:'%s':%d, Error: %s", qPrintable(matchLine.cap(1)), qPrintable(filename), lineNumber, qPrintable(match.rx.errorString()));
                 }
+
+                match.compiled = CompiledRegExp(match.rx);
+
+                if (!match.compiled.incompatibility().isEmpty())
+                {
+                    qWarning() << "WARN:" << qPrintable(filename) << "line" << lineNumber << ": match" << matchLine.cap(1) << "stays on QRegExp," << match.compiled.incompatibility();
+                }
                 
                 match.setLineNumber(lineNumber);
                 match.setFilename(filename);
             } 
+            else if (filterLogLine.exactMatch(line)) 
+            {
+                // substitutions applied to every log message, in order
+                state = ReadingLogFilter;
+            } 
             else if (isVariableRule) 
             {
                 QString variable = declareLine.cap(1);
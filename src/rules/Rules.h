@@ -37,6 +37,7 @@ public:
 
     const QList<RuleRepository> getRepositories() const;
     const QList<RuleMatch> getMatchRules() const;
+    const QList<RuleMatchSubstitution> getLogSubstitutions() const;
     const RuleMatchSubstitution parseSubstitution(const QString &string);
     void load();
 
@@ -46,6 +47,7 @@ private:
     QString filename;
     QList<RuleRepository> repositories;
     QList<RuleMatch> matchRules;
+    QList<RuleMatchSubstitution> logSubstitutions;
     QMap<QString,QString> variables;
 };
 
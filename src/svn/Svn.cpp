@@ -27,6 +27,9 @@
 #include <apr_getopt.h>
 #include <apr_general.h>
 
+#include <svn_fs.h>
+#include <svn_pools.h>
+
 #include "SvnPrivate.h"
 
 void Svn::initialize()
@@ -38,6 +41,14 @@ void Svn::initialize()
         exit(1);
     }
 
+    // libsvn_fs has to be initialized before any thread opens a repository,
+    // its pool is never destroyed
+    if (svn_fs_initialize(svn_pool_create(NULL)) != SVN_NO_ERROR) 
+    {
+        fprintf(stderr, "You lose at svn_fs_initialize().\n");
+        exit(1);
+    }
+
     // static destructor
     static struct Destructor { ~Destructor() { apr_terminate(); } } destructor;
 }
@@ -53,7 +64,12 @@ Svn::~Svn()
 
 void Svn::setMatchRules(const QList<QList<RuleMatch> >& allMatchRules)
 {
-    privateClass->allMatchRules = allMatchRules;
+    privateClass->allMatchRules.clear();
+
+    foreach (const QList<RuleMatch>& matchRules, allMatchRules)
+    {
+        privateClass->allMatchRules.append(RuleMatcher(matchRules));
+    }
 }
 
 void Svn::setRepositories(const QHash<QString, GitRepository*>& repositories)
@@ -76,6 +92,21 @@ int Svn::youngestRevision()
     return privateClass->youngestRevision();
 }
 
+bool Svn::waitForRevision(int revnum)
+{
+    return privateClass->waitForRevision(revnum);
+}
+
+void Svn::plan(int first, int last, const QSet<int>& revisions, SvnPlan* plan)
+{
+    privateClass->plan(first, last, revisions, plan);
+}
+
+void Svn::startPrefetch(int first, int last, const QSet<int>& revisions)
+{
+    privateClass->startPrefetch(first, last, revisions);
+}
+
 bool Svn::exportRevision(int revnum)
 {
     return privateClass->exportRevision(revnum) == EXIT_SUCCESS;
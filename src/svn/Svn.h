@@ -19,6 +19,7 @@
 #ifndef SVN_H
 #define SVN_H
 
+#include <QSet>
 #include <QHash>
 #include <QList>
 #include <QString>
@@ -28,6 +29,7 @@
 
 class SvnPrivate;
 class GitRepository;
+struct SvnPlan;
 
 class Svn
 {
@@ -45,6 +47,9 @@ public:
     void setIdentityDomain(const QString& identityDomain);
 
     int youngestRevision();
+    bool waitForRevision(int revnum);
+    void plan(int first, int last, const QSet<int>& revisions, SvnPlan* plan);
+    void startPrefetch(int first, int last, const QSet<int>& revisions);
     bool exportRevision(int revnum);
 
 private:
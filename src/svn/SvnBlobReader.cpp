@@ -0,0 +1,355 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnBlobReader.h"
+
+#include <QIODevice>
+#include <QMutexLocker>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <svn_fs.h>
+#include <svn_pools.h>
+
+#include "AprAutoPool.h"
+#include "SvnHelper.h"
+#include "SvnPropertyCache.h"
+#include "git/GitBlobIndex.h"
+#include "git/GitRepositoryTransaction.h"
+
+// files bigger than this are not buffered, the writer streams them itself
+static const qint64 maxBufferedBlob = 16 * 1024 * 1024;
+// upper bound for the contents waiting to be written
+static const qint64 maxBufferedBytes = 128 * 1024 * 1024;
+
+SvnBlobReader::Worker::Worker(SvnBlobReader* r) :
+    reader(r)
+{
+}
+
+void SvnBlobReader::Worker::run()
+{
+    AprAutoPool pool;
+    svn_fs_t* fs = NULL;
+    svn_error_t* err = SvnHelper::openFilesystem(&fs, reader->path, pool);
+
+    if (err != SVN_NO_ERROR) 
+    {
+        // every job claimed by this thread is then read by the writer
+        svn_error_clear(err);
+        fs = NULL;
+    }
+
+    AprAutoPool rootpool(pool);
+    AprAutoPool blobpool(pool);
+    svn_fs_root_t* fs_root = NULL;
+    svn_revnum_t rootRevision = SVN_INVALID_REVNUM;
+
+    int generation;
+    int index;
+    svn_revnum_t revnum;
+    QByteArray path;
+    
+    while (reader->claim(&generation, &index, &revnum, &path)) 
+    {
+        Blob blob;
+        blob.path = path;
+        blob.state = Failed;
+
+        if (fs && revnum != rootRevision) 
+        {
+            rootpool.clear();
+            fs_root = NULL;
+            rootRevision = SVN_INVALID_REVNUM;
+            err = svn_fs_revision_root(&fs_root, fs, revnum, rootpool);
+            
+            if (err == SVN_NO_ERROR) 
+            {
+                rootRevision = revnum;
+            }
+            else
+            {
+                svn_error_clear(err);
+                fs_root = NULL;
+            }
+        }
+
+        if (fs_root) 
+        {
+            blobpool.clear();
+            err = readBlob(&blob, fs_root, blobpool);
+            
+            if (err != SVN_NO_ERROR) 
+            {
+                svn_error_clear(err);
+                blob.state = Failed;
+                blob.data.clear();
+            }
+        }
+
+        reader->deliver(generation, index, blob);
+    }
+}
+
+SvnBlobReader::SvnBlobReader(const QString& pathToRepository, int threads) :
+    path(pathToRepository),
+    window(qMax(threads, 1) * 8),
+    revision(SVN_INVALID_REVNUM),
+    generation(0),
+    nextJob(0),
+    consumed(0),
+    bufferedBytes(0),
+    stopping(false)
+{
+    for (int i = 0; i < threads; ++i) 
+    {
+        Worker* worker = new Worker(this);
+        workers.append(worker);
+        worker->start();
+    }
+}
+
+SvnBlobReader::~SvnBlobReader()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        workCondition.wakeAll();
+    }
+
+    foreach (Worker* worker, workers) 
+    {
+        worker->wait();
+        delete worker;
+    }
+}
+
+int SvnBlobReader::dumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
+{
+    QList<QPair<QByteArray, QString> > files;
+
+    // The listing stays on this thread: the directory entries are read from the
+    // same root and cost little next to the contents, and walking the
+    // subtrees in the workers would only need merging back into this order.
+    if (SvnHelper::listFiles(fs_root, pathname, finalPathName, &files, pool) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (files.isEmpty())
+    {
+        return EXIT_SUCCESS;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        ++generation;
+        revision = svn_fs_revision_root_revision(fs_root);
+        jobs.resize(files.size());
+        
+        for (int i = 0; i < files.size(); ++i) 
+        {
+            jobs[i].path = files.at(i).first;
+            jobs[i].state = Pending;
+        }
+        
+        nextJob = 0;
+        consumed = 0;
+        bufferedBytes = 0;
+        workCondition.wakeAll();
+    }
+
+    AprAutoPool dumppool(pool);
+    int result = EXIT_SUCCESS;
+    
+    for (int i = 0; i < files.size(); ++i) 
+    {
+        Blob blob;
+        
+        {
+            QMutexLocker locker(&mutex);
+            
+            while (jobs.at(i).state == Pending) 
+            {
+                doneCondition.wait(&mutex);
+            }
+
+            blob = jobs.at(i);
+            bufferedBytes -= blob.data.size();
+            jobs[i].data = QByteArray();
+            consumed = i + 1;
+            workCondition.wakeAll();
+        }
+
+        printf("+");
+        fflush(stdout);
+
+        if (blob.state == Loaded) 
+        {
+            if (txn->addExistingFile(files.at(i).second, blob.mode, blob.key))
+            {
+                continue;
+            }
+
+            QIODevice* io = txn->addFile(files.at(i).second, blob.mode, blob.length, blob.key);
+            
+            // write through a stream so the same throttling applies as
+            // when dumping straight from the repository
+            dumppool.clear();
+            svn_stream_t* out_stream = SvnHelper::streamForDevice(io, dumppool);
+            apr_size_t len = blob.data.size();
+            svn_error_t* err = svn_stream_write(out_stream, blob.data.constData(), &len);
+            
+            if (err != SVN_NO_ERROR) 
+            {
+                svn_handle_error2(err, stderr, FALSE, "svn: ");
+                svn_error_clear(err);
+                result = EXIT_FAILURE;
+                break;
+            }
+            
+            io->putChar('\n');
+        }
+        else
+        {
+            // too large to buffer, known to the blob index, or the worker
+            // could not read it: go the serial way, which also reports the
+            // error if there is one
+            dumppool.clear();
+            
+            if (SvnHelper::dumpBlob(txn, fs_root, blob.path, files.at(i).second, dumppool) == EXIT_FAILURE)
+            {
+                result = EXIT_FAILURE;
+                break;
+            }
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    // workers still busy with this batch drop their results
+    ++generation;
+    jobs.clear();
+    bufferedBytes = 0;
+
+    return result;
+}
+
+svn_error_t* SvnBlobReader::readBlob(Blob* blob, svn_fs_root_t* fs_root, apr_pool_t* pool)
+{
+    SvnProperties props;
+    SVN_ERR(SvnPropertyCache::instance()->properties(&props, fs_root, blob->path, pool));
+    blob->mode = SvnHelper::pathMode(props);
+
+    // maybe it's a symlink?
+    bool special = props.contains("svn:special");
+
+    if (!special)
+    {
+        blob->key = SvnHelper::contentKey(fs_root, blob->path, pool);
+
+        // most likely the repository has it already, which dumpBlob()
+        // checks before it reads anything
+        if (GitBlobIndex::instance()->contains(blob->key)) 
+        {
+            blob->state = Indexed;
+            return SVN_NO_ERROR;
+        }
+    }
+
+    svn_filesize_t stream_length;
+    SVN_ERR(svn_fs_file_length(&stream_length, fs_root, blob->path, pool));
+
+    if (stream_length > maxBufferedBlob) 
+    {
+        blob->state = TooLarge;
+        return SVN_NO_ERROR;
+    }
+
+    svn_stream_t* in_stream;
+    SVN_ERR(svn_fs_file_contents(&in_stream, fs_root, blob->path, pool));
+
+    apr_size_t len = stream_length;
+    blob->data.resize(len);
+    SVN_ERR(svn_stream_read_full(in_stream, blob->data.data(), &len));
+    
+    if (len != apr_size_t(stream_length)) 
+    {
+        // let the writer deal with it
+        blob->data.clear();
+        blob->state = Failed;
+        return SVN_NO_ERROR;
+    }
+
+    if (special) 
+    {
+        if (blob->data.startsWith("link ")) 
+        {
+            blob->mode = 0120000;
+            blob->data.remove(0, strlen("link "));
+        } 
+        else 
+        {
+            //this can happen if a link changed into a file in one commit
+            qWarning("file %s is svn:special but not a symlink", blob->path.constData());
+        }
+    }
+
+    blob->length = blob->data.size();
+    blob->state = Loaded;
+
+    return SVN_NO_ERROR;
+}
+
+bool SvnBlobReader::claim(int* gen, int* index, svn_revnum_t* revnum, QByteArray* blobPath)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!stopping && (nextJob >= jobs.size() || nextJob - consumed >= window || bufferedBytes >= maxBufferedBytes))
+    {
+        workCondition.wait(&mutex);
+    }
+
+    if (stopping)
+    {
+        return false;
+    }
+
+    *gen = generation;
+    *index = nextJob;
+    *revnum = revision;
+    *blobPath = jobs.at(nextJob).path;
+    ++nextJob;
+
+    return true;
+}
+
+void SvnBlobReader::deliver(int gen, int index, const Blob& blob)
+{
+    QMutexLocker locker(&mutex);
+
+    if (gen != generation) 
+    {
+        return;
+    }
+
+    jobs[index] = blob;
+    bufferedBytes += blob.data.size();
+    doneCondition.wakeAll();
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_BLOB_READER_H
+#define SVN_BLOB_READER_H
+
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QByteArray>
+#include <QWaitCondition>
+
+#include <svn_types.h>
+
+class GitRepositoryTransaction;
+
+struct svn_fs_root_t;
+struct apr_pool_t;
+
+/**
+ * Dumps directory trees with a pool of threads reading file contents
+ * ahead of the writer. Every thread has its own svn_fs_t; the contents
+ * are buffered in memory, bounded in count and size, and handed to
+ * GitRepositoryTransaction::addFile in the same sorted order as
+ * SvnHelper::recursiveDumpDir, so the resulting commits are identical.
+ * Only the contents are read in parallel; the tree is listed up front
+ * by the calling thread.
+ */
+class SvnBlobReader
+{
+
+public:
+
+    SvnBlobReader(const QString& pathToRepository, int threads);
+    ~SvnBlobReader();
+
+    int dumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool);
+
+private:
+
+    // Indexed: an earlier run sent the contents, see GitBlobIndex
+    enum BlobState { Pending, Loaded, TooLarge, Indexed, Failed };
+
+    struct Blob
+    {
+        QByteArray path;
+        BlobState state;
+        int mode;
+        qint64 length;
+        QByteArray key;
+        QByteArray data;
+    };
+
+    class Worker : public QThread
+    {
+
+    public:
+
+        Worker(SvnBlobReader* reader);
+
+    protected:
+
+        void run();
+
+    private:
+
+        SvnBlobReader* reader;
+    };
+
+    static svn_error_t* readBlob(Blob* blob, svn_fs_root_t* fs_root, apr_pool_t* pool);
+
+    bool claim(int* generation, int* index, svn_revnum_t* revnum, QByteArray* path);
+    void deliver(int generation, int index, const Blob& blob);
+
+    QString path;
+    QList<Worker*> workers;
+    int window;
+
+    QMutex mutex;
+    QWaitCondition workCondition;
+    QWaitCondition doneCondition;
+    QVector<Blob> jobs;
+    svn_revnum_t revision;
+    int generation;
+    int nextJob;
+    int consumed;
+    qint64 bufferedBytes;
+    bool stopping;
+
+    Q_DISABLE_COPY(SvnBlobReader)
+};
+
+#endif
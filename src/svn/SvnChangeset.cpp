@@ -0,0 +1,256 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnChangeset.h"
+
+#include <QMap>
+#include <QMapIterator>
+
+#include <svn_pools.h>
+#include <svn_version.h>
+
+#include "AprAutoPool.h"
+
+SvnChange::SvnChange() :
+    kind(svn_fs_path_change_modify),
+    textMod(false),
+    propMod(false),
+    isDir(false),
+    copyFromRev(SVN_INVALID_REVNUM),
+    copyFromIsDir(false),
+    size(-1)
+{
+}
+
+SvnChangeset::SvnChangeset() :
+    revnum(0)
+{
+}
+
+svn_error_t* SvnChangeset::fetch(svn_fs_t* fs, int rev, apr_pool_t* pool, bool withSizes)
+{
+    revnum = rev;
+    changeList.clear();
+    index.clear();
+    nodeKinds.clear();
+
+    AprAutoPool subpool(pool);
+    svn_fs_root_t* fs_root;
+    SVN_ERR(svn_fs_revision_root(&fs_root, fs, revnum, subpool));
+
+    // find out what was changed in this revision:
+    QMap<QByteArray, ChangeRecord> map;
+    SVN_ERR(fetchRecords(&map, fs_root, subpool));
+
+    svn_fs_root_t* prev_root = NULL;
+    AprAutoPool iterpool(subpool);
+    QMapIterator<QByteArray, ChangeRecord> i(map);
+    
+    while (i.hasNext()) 
+    {
+        iterpool.clear();
+        i.next();
+        const char* key = i.key().constData();
+        const ChangeRecord& change = i.value();
+
+        SvnChange entry;
+        entry.path = i.key();
+        entry.kind = change.kind;
+        entry.textMod = change.textMod;
+        entry.propMod = change.propMod;
+
+        if (change.kind == svn_fs_path_change_delete) 
+        {
+            // the record has the kind of the deleted node, if the library knows it
+            svn_node_kind_t kind = change.nodeKind;
+            
+            if (kind != svn_node_dir && kind != svn_node_file) 
+            {
+                // the path no longer exists in this revision, so look at the previous one
+                if (!prev_root)
+                {
+                    SVN_ERR(svn_fs_revision_root(&prev_root, fs, revnum - 1, subpool));
+                }
+
+                SVN_ERR(svn_fs_check_path(&kind, prev_root, key, iterpool));
+            }
+            
+            entry.isDir = kind == svn_node_dir;
+            nodeKinds.insert(qMakePair(revnum - 1, entry.path), entry.isDir);
+        } 
+        else 
+        {
+            if (change.nodeKind == svn_node_dir || change.nodeKind == svn_node_file) 
+            {
+                entry.isDir = change.nodeKind == svn_node_dir;
+            }
+            else
+            {
+                svn_boolean_t is_dir;
+                SVN_ERR(svn_fs_is_dir(&is_dir, fs_root, key, iterpool));
+                entry.isDir = is_dir;
+            }
+            
+            nodeKinds.insert(qMakePair(revnum, entry.path), entry.isDir);
+
+            // was this copied from somewhere?
+            svn_revnum_t rev_from = change.copyFromRev;
+            QByteArray path_from = change.copyFromPath;
+            
+            if (!change.copyFromKnown) 
+            {
+                const char* copied_from;
+                SVN_ERR(svn_fs_copied_from(&rev_from, &copied_from, fs_root, key, iterpool));
+                path_from = copied_from ? QByteArray(copied_from) : QByteArray();
+            }
+
+            if (!path_from.isNull()) 
+            {
+                entry.copyFromPath = path_from;
+                entry.copyFromRev = rev_from;
+
+                // a copy never changes the kind of the node
+                entry.copyFromIsDir = entry.isDir;
+                nodeKinds.insert(qMakePair(int(rev_from), entry.copyFromPath), entry.copyFromIsDir);
+            }
+
+            if (withSizes && !entry.isDir && (entry.textMod || !path_from.isNull())) 
+            {
+                svn_filesize_t length;
+                SVN_ERR(svn_fs_file_length(&length, fs_root, key, iterpool));
+                entry.size = length;
+            }
+        }
+
+        index.insert(entry.path, changeList.size());
+        changeList.append(entry);
+    }
+
+    apr_hash_t* revprops;
+    SVN_ERR(svn_fs_revision_proplist(&revprops, fs, revnum, subpool));
+    svn_string_t* svnauthor = (svn_string_t*)apr_hash_get(revprops, "svn:author", APR_HASH_KEY_STRING);
+    svn_string_t* svndate = (svn_string_t*)apr_hash_get(revprops, "svn:date", APR_HASH_KEY_STRING);
+    svn_string_t* svnlog = (svn_string_t*)apr_hash_get(revprops, "svn:log", APR_HASH_KEY_STRING);
+
+    author = svnauthor ? QByteArray(svnauthor->data) : QByteArray();
+    date = svndate ? QByteArray(svndate->data) : QByteArray();
+    log = svnlog ? QByteArray(svnlog->data) : QByteArray();
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t* SvnChangeset::fetchRecords(QMap<QByteArray, ChangeRecord>* records, svn_fs_root_t* fs_root, apr_pool_t* pool)
+{
+    // While we get a hash, put it in a map for sorted lookup, so we can
+    // repeat the conversions and get the same git commit hashes.
+#if SVN_VER_MAJOR > 1 || SVN_VER_MINOR >= 10
+    svn_fs_path_change_iterator_t* iterator;
+    SVN_ERR(svn_fs_paths_changed3(&iterator, fs_root, pool, pool));
+
+    svn_fs_path_change3_t* change;
+    SVN_ERR(svn_fs_path_change_get(&change, iterator));
+    
+    while (change) 
+    {
+        // the record is only valid until the next call
+        ChangeRecord record;
+        record.kind = change->change_kind;
+        record.nodeKind = change->node_kind;
+        record.textMod = change->text_mod;
+        record.propMod = change->prop_mod;
+        record.copyFromKnown = change->copyfrom_known;
+        record.copyFromRev = change->copyfrom_rev;
+        
+        if (change->copyfrom_known && change->copyfrom_path)
+        {
+            record.copyFromPath = change->copyfrom_path;
+        }
+        
+        records->insert(QByteArray(change->path.data, change->path.len), record);
+        SVN_ERR(svn_fs_path_change_get(&change, iterator));
+    }
+#else
+    apr_hash_t* changes;
+    SVN_ERR(svn_fs_paths_changed2(&changes, fs_root, pool));
+    
+    for (apr_hash_index_t *i = apr_hash_first(pool, changes); i; i = apr_hash_next(i)) 
+    {
+        const void *vkey;
+        void *value;
+        apr_hash_this(i, &vkey, NULL, &value);
+        const svn_fs_path_change2_t* change = reinterpret_cast<svn_fs_path_change2_t *>(value);
+
+        ChangeRecord record;
+        record.kind = change->change_kind;
+        record.nodeKind = change->node_kind;
+        record.textMod = change->text_mod;
+        record.propMod = change->prop_mod;
+        record.copyFromKnown = change->copyfrom_known;
+        record.copyFromRev = change->copyfrom_rev;
+        
+        if (change->copyfrom_known && change->copyfrom_path)
+        {
+            record.copyFromPath = change->copyfrom_path;
+        }
+        
+        records->insert(QByteArray(reinterpret_cast<const char *>(vkey)), record);
+    }
+#endif
+
+    return SVN_NO_ERROR;
+}
+
+int SvnChangeset::revision() const
+{
+    return revnum;
+}
+
+const QList<SvnChange>& SvnChangeset::changes() const
+{
+    return changeList;
+}
+
+const SvnChange* SvnChangeset::find(const QByteArray& path) const
+{
+    QHash<QByteArray, int>::ConstIterator it = index.constFind(path);
+    
+    if (it == index.constEnd())
+    {
+        return NULL;
+    }
+    
+    return &changeList.at(it.value());
+}
+
+const QHash<QPair<int, QByteArray>, bool>& SvnChangeset::knownKinds() const
+{
+    return nodeKinds;
+}
+
+bool SvnChangeset::knownIsDir(int rev, const QByteArray& path, bool* isDir) const
+{
+    QHash<QPair<int, QByteArray>, bool>::ConstIterator it = nodeKinds.constFind(qMakePair(rev, path));
+    
+    if (it == nodeKinds.constEnd())
+    {
+        return false;
+    }
+    
+    *isDir = it.value();
+    return true;
+}
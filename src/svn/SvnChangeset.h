@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_CHANGESET_H
+#define SVN_CHANGESET_H
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QByteArray>
+
+#include <svn_fs.h>
+
+struct SvnChange
+{
+    SvnChange();
+
+    QByteArray path;
+    svn_fs_path_change_kind_t kind;
+    bool textMod;
+    bool propMod;
+
+    // for deletions this is the kind the path had in the previous revision
+    bool isDir;
+
+    // null if the path was not copied
+    QByteArray copyFromPath;
+    svn_revnum_t copyFromRev;
+    bool copyFromIsDir;
+
+    // length of a changed file, only filled in when asked for; -1 otherwise
+    qint64 size;
+};
+
+/**
+ * Everything SvnRevision needs to know about a revision that does not
+ * involve reading file contents: the sorted change list with node kinds
+ * and copy sources, and the unprocessed revision properties.
+ * Contains only Qt types so it can be built on another thread and
+ * handed over once complete.
+ */
+class SvnChangeset
+{
+
+public:
+
+    SvnChangeset();
+
+    svn_error_t* fetch(svn_fs_t* fs, int revnum, apr_pool_t* pool, bool withSizes = false);
+
+    int revision() const;
+    const QList<SvnChange>& changes() const;
+    const SvnChange* find(const QByteArray& path) const;
+    bool knownIsDir(int revnum, const QByteArray& path, bool* isDir) const;
+    const QHash<QPair<int, QByteArray>, bool>& knownKinds() const;
+
+    // null if the revision property is not set
+    QByteArray author;
+    QByteArray date;
+    QByteArray log;
+
+private:
+
+    // one change as the library reports it, the kinds may be unknown
+    struct ChangeRecord
+    {
+        svn_fs_path_change_kind_t kind;
+        svn_node_kind_t nodeKind;
+        bool textMod;
+        bool propMod;
+        bool copyFromKnown;
+        svn_revnum_t copyFromRev;
+        QByteArray copyFromPath;
+    };
+
+    static svn_error_t* fetchRecords(QMap<QByteArray, ChangeRecord>* records, svn_fs_root_t* fs_root, apr_pool_t* pool);
+
+    int revnum;
+    QList<SvnChange> changeList;
+    QHash<QByteArray, int> index;
+    QHash<QPair<int, QByteArray>, bool> nodeKinds;
+};
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnDumpLoader.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QMutexLocker>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <svn_fs.h>
+#include <svn_pools.h>
+#include <svn_repos.h>
+#include <svn_error.h>
+#include <svn_io.h>
+
+#include "AprAutoPool.h"
+
+SvnDumpLoader::SvnDumpLoader(const QString& pathToRepository, const QString& file) :
+    path(pathToRepository),
+    dumpFile(file),
+    youngest(0),
+    finished(false),
+    stopping(false),
+    fd(-1)
+{
+    while (path.endsWith('/')) // no trailing slash allowed
+    {
+        path.chop(1);
+    }
+
+    if (pipe(wakeup) != 0)
+    {
+        qFatal("Failed to create a pipe: %s", strerror(errno));
+    }
+}
+
+SvnDumpLoader::~SvnDumpLoader()
+{
+    stop();
+    wait();
+
+    ::close(wakeup[0]);
+    ::close(wakeup[1]);
+}
+
+void SvnDumpLoader::stop()
+{
+    QMutexLocker locker(&mutex);
+
+    if (!stopping)
+    {
+        stopping = true;
+
+        // wakes up a read waiting on a stalled pipe
+        if (::write(wakeup[1], "", 1) != 1)
+        {
+            qWarning() << "WARN: failed to interrupt the dump loader:" << strerror(errno);
+        }
+    }
+}
+
+int SvnDumpLoader::startLoading()
+{
+    AprAutoPool pool;
+    svn_repos_t* repos;
+
+    if (QDir(path).exists()) 
+    {
+        SVN_INT_ERR(svn_repos_open3(&repos, QFile::encodeName(path), NULL, pool, pool));
+        
+        svn_revnum_t youngest_rev;
+        SVN_INT_ERR(svn_fs_youngest_rev(&youngest_rev, svn_repos_fs(repos), pool));
+        youngest = youngest_rev;
+    } 
+    else 
+    {
+        printf("Creating repository %s for the dump\n", qPrintable(path));
+        SVN_INT_ERR(svn_repos_create(&repos, QFile::encodeName(path), NULL, NULL, NULL, NULL, pool));
+    }
+
+    start();
+
+    return EXIT_SUCCESS;
+}
+
+bool SvnDumpLoader::waitForRevision(int revnum)
+{
+    QMutexLocker locker(&mutex);
+
+    while (youngest < revnum && !finished)
+    {
+        loadedCondition.wait(&mutex);
+    }
+
+    return youngest >= revnum;
+}
+
+int SvnDumpLoader::waitForEnd()
+{
+    QMutexLocker locker(&mutex);
+
+    while (!finished)
+    {
+        loadedCondition.wait(&mutex);
+    }
+
+    return youngest;
+}
+
+void SvnDumpLoader::run()
+{
+    AprAutoPool pool;
+    svn_repos_t* repos;
+    svn_stream_t* dumpstream;
+    svn_error_t* err = svn_repos_open3(&repos, QFile::encodeName(path), NULL, pool, pool);
+
+    if (err == SVN_NO_ERROR) 
+    {
+        fd = dumpFile == QLatin1String("-") ? STDIN_FILENO : ::open(QFile::encodeName(dumpFile), O_RDONLY);
+
+        if (fd < 0) 
+        {
+            err = svn_error_wrap_apr(apr_get_os_error(), "Can't open '%s'", qPrintable(dumpFile));
+        }
+        else 
+        {
+            // our own reads, svn's would block stop() until more data comes
+            dumpstream = svn_stream_create(this, pool);
+            svn_stream_set_read2(dumpstream, read, readFull);
+        }
+    }
+
+    if (err == SVN_NO_ERROR) 
+    {
+        // an existing repository only gets what it does not have yet
+        svn_revnum_t start_rev = SVN_INVALID_REVNUM;
+        svn_revnum_t end_rev = SVN_INVALID_REVNUM;
+        
+        if (youngest > 0) 
+        {
+            start_rev = youngest + 1;
+            end_rev = LONG_MAX;
+        }
+
+        err = svn_repos_load_fs5(repos, dumpstream, start_rev, end_rev, svn_repos_load_uuid_default, NULL,
+                                 FALSE, FALSE, FALSE, FALSE, notify, this, cancel, this, pool);
+    }
+
+    if (err != SVN_NO_ERROR && !svn_error_find_cause(err, SVN_ERR_CANCELLED))
+    {
+        svn_handle_error2(err, stderr, FALSE, "svn: ");
+        qCritical() << "Loading the dump" << dumpFile << "stopped after revision" << youngest;
+    }
+    
+    svn_error_clear(err);
+
+    if (fd > STDIN_FILENO)
+    {
+        ::close(fd);
+    }
+
+    QMutexLocker locker(&mutex);
+    finished = true;
+    loadedCondition.wakeAll();
+}
+
+void SvnDumpLoader::notify(void* baton, const svn_repos_notify_t* notify, apr_pool_t*)
+{
+    if (notify->action != svn_repos_notify_load_txn_committed)
+    {
+        return;
+    }
+
+    SvnDumpLoader* loader = reinterpret_cast<SvnDumpLoader*>(baton);
+    QMutexLocker locker(&loader->mutex);
+    loader->youngest = notify->new_revision;
+    loader->loadedCondition.wakeAll();
+}
+
+svn_error_t* SvnDumpLoader::cancel(void* baton)
+{
+    SvnDumpLoader* loader = reinterpret_cast<SvnDumpLoader*>(baton);
+    QMutexLocker locker(&loader->mutex);
+
+    if (loader->stopping)
+    {
+        return svn_error_create(SVN_ERR_CANCELLED, NULL, "export finished before the dump was loaded");
+    }
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t* SvnDumpLoader::read(void* baton, char* buffer, apr_size_t* len)
+{
+    SvnDumpLoader* loader = reinterpret_cast<SvnDumpLoader*>(baton);
+
+    struct pollfd fds[2];
+    fds[0].fd = loader->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = loader->wakeup[0];
+    fds[1].events = POLLIN;
+
+    forever 
+    {
+        if (poll(fds, 2, -1) < 0) 
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return svn_error_wrap_apr(apr_get_os_error(), "Can't read the dump");
+        }
+
+        if (fds[1].revents)
+        {
+            return svn_error_create(SVN_ERR_CANCELLED, NULL, "export finished before the dump was loaded");
+        }
+
+        ssize_t got = ::read(loader->fd, buffer, *len);
+
+        if (got < 0) 
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+
+            return svn_error_wrap_apr(apr_get_os_error(), "Can't read the dump");
+        }
+
+        *len = got;
+        return SVN_NO_ERROR;
+    }
+}
+
+svn_error_t* SvnDumpLoader::readFull(void* baton, char* buffer, apr_size_t* len)
+{
+    apr_size_t done = 0;
+
+    while (done < *len) 
+    {
+        apr_size_t got = *len - done;
+        SVN_ERR(read(baton, buffer + done, &got));
+
+        // end of the dump
+        if (got == 0)
+        {
+            break;
+        }
+
+        done += got;
+    }
+
+    *len = done;
+    return SVN_NO_ERROR;
+}
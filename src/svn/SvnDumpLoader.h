@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_DUMP_LOADER_H
+#define SVN_DUMP_LOADER_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+struct svn_error_t;
+struct svn_repos_notify_t;
+struct apr_pool_t;
+
+typedef size_t apr_size_t;
+
+/**
+ * Loads an svnadmin/svnrdump dump stream into the repository the export
+ * reads from, on a background thread, so the export of a revision can
+ * start as soon as it is committed instead of after the whole load.
+ * The repository is created if it does not exist yet; an existing one
+ * only gets the revisions of the dump that are newer than its youngest.
+ */
+class SvnDumpLoader : public QThread
+{
+
+public:
+
+    SvnDumpLoader(const QString& pathToRepository, const QString& dumpFile);
+    ~SvnDumpLoader();
+
+    // creates or opens the repository and starts loading
+    int startLoading();
+
+    // false once it is clear the revision is not in the dump
+    bool waitForRevision(int revnum);
+
+    // waits for the whole dump, returns the youngest revision loaded
+    int waitForEnd();
+
+    // makes the load stop at the next chance it gets, even in a read
+    void stop();
+
+protected:
+
+    void run();
+
+private:
+
+    static void notify(void* baton, const svn_repos_notify_t* notify, apr_pool_t* pool);
+    static svn_error_t* cancel(void* baton);
+    static svn_error_t* read(void* baton, char* buffer, apr_size_t* len);
+    static svn_error_t* readFull(void* baton, char* buffer, apr_size_t* len);
+
+    QString path;
+    QString dumpFile;
+
+    QMutex mutex;
+    QWaitCondition loadedCondition;
+    int youngest;
+    bool finished;
+    bool stopping;
+
+    // the dump, and a pipe stop() writes to so a read doesn't block it
+    int fd;
+    int wakeup[2];
+
+    Q_DISABLE_COPY(SvnDumpLoader)
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include "SvnHelper.h"
 
 #include <QMap>
+#include <QFile>
 #include <QIODevice>
 #include <QMapIterator>
 
@@ -28,57 +29,95 @@
 #include <svn_types.h>
 
 #include "AprAutoPool.h"
+#include "SvnPropertyCache.h"
 
 #include "rules/RuleStats.h"
 
+#include "git/GitBlobIndex.h"
 #include "git/GitRepositoryTransaction.h"
 
 #include "commandline/CommandLineParser.h"
 
-QList<RuleMatch>::ConstIterator SvnHelper::findMatchRule(const QList<RuleMatch>& matchRules, int revnum, const QString& current, int ruleMask)
+// the index of the first rule that matches, -1 for none
+static int firstMatch(const RuleMatcher& matcher, int epoch, const QString& current, int ruleMask, int* length)
 {
-    QList<RuleMatch>::ConstIterator it = matchRules.constBegin(), end = matchRules.constEnd();
-    
-    for ( ; it != end; ++it) 
+    QVarLengthArray<int, 64> candidates;
+    matcher.candidates(current, &candidates, epoch);
+
+    for (int i = 0; i < candidates.size(); ++i) 
     {
-        if (it->minRevision > revnum)
-        {
-            continue;
-        }
+        const int action = matcher.action(epoch, candidates[i]);
         
-        if (it->maxRevision != -1 && it->maxRevision < revnum)
+        if (action == Ignore && ruleMask & NoIgnoreRule)
         {
             continue;
         }
         
-        if (it->action == Ignore && ruleMask & NoIgnoreRule)
+        if (action == Recurse && ruleMask & NoRecurseRule)
         {
             continue;
         }
         
-        if (it->action == Recurse && ruleMask & NoRecurseRule)
-        {
-            continue;
-        }
+        *length = matcher.rules().at(candidates[i]).compiled.matchAtStart(current);
         
-        if (it->rx.indexIn(current) == 0) 
+        if (*length >= 0) 
         {
-            RuleStats::instance()->ruleMatched(*it, revnum);
-            return it;
+            return candidates[i];
         }
     }
 
-    // no match
-    return end;
+    return -1;
+}
+
+QList<RuleMatch>::ConstIterator SvnHelper::findMatchRule(const RuleMatcher& matcher, int revnum, const QString& current, int ruleMask, int* matchedLength)
+{
+    const int epoch = matcher.epoch(revnum);
+    const QString directory = current.left(current.lastIndexOf('/') + 1);
+    int index;
+    int length;
+
+    // the other paths in the directory mostly end up at the same rule
+    if (!matcher.recall(epoch, ruleMask, directory, &index, &length)) 
+    {
+        length = -1;
+        index = firstMatch(matcher, epoch, current, ruleMask, &length);
+        matcher.remember(epoch, ruleMask, directory, index, length);
+    }
+
+    if (index < 0)
+    {
+        // no match
+        return matcher.rules().constEnd();
+    }
+
+    QList<RuleMatch>::ConstIterator it = matcher.rules().constBegin() + index;
+
+    if (!(ruleMask & NoStatsRule))
+    {
+        RuleStats::instance()->ruleMatched(*it, revnum);
+    }
+
+    if (matchedLength)
+    {
+        *matchedLength = length;
+    }
+    
+    return it;
 }
 
 int SvnHelper::pathMode(svn_fs_root_t* fs_root, const char* pathname, apr_pool_t* pool)
 {
-    svn_string_t *propvalue;
-    SVN_INT_ERR(svn_fs_node_prop(&propvalue, fs_root, pathname, "svn:executable", pool));
+    SvnProperties props;
+    SVN_INT_ERR(SvnPropertyCache::instance()->properties(&props, fs_root, pathname, pool));
+
+    return pathMode(props);
+}
+
+int SvnHelper::pathMode(const SvnProperties& props)
+{
     int mode = 0100644;
     
-    if (propvalue)
+    if (props.contains("svn:executable"))
     {
         mode = 0100755;
     }
@@ -89,15 +128,11 @@ int SvnHelper::pathMode(svn_fs_root_t* fs_root, const char* pathname, apr_pool_t
 svn_error_t* SvnHelper::deviceWrite(void* baton, const char* data, apr_size_t* len)
 {
     QIODevice *device = reinterpret_cast<QIODevice *>(baton);
-    device->write(data, *len);
 
-    while (device->bytesToWrite() > 32*1024) 
+    // the device applies its own back pressure, see LoggingQProcess::writeData
+    if (device->write(data, *len) != qint64(*len)) 
     {
-        if (!device->waitForBytesWritten(-1)) 
-        {
-            qFatal("Failed to write to process: %s", qPrintable(device->errorString()));
-            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "Failed to write to process: %s", qPrintable(device->errorString()));
-        }
+        return svn_error_createf(APR_EOF, SVN_NO_ERROR, "Failed to write to process: %s", qPrintable(device->errorString()));
     }
     
     return SVN_NO_ERROR;
@@ -106,15 +141,11 @@ svn_error_t* SvnHelper::deviceWrite(void* baton, const char* data, apr_size_t* l
 svn_error_t* SvnHelper::QIODevice_write(void* baton, const char* data, apr_size_t* len)
 {
     QIODevice *device = reinterpret_cast<QIODevice *>(baton);
-    device->write(data, *len);
 
-    while (device->bytesToWrite() > 32*1024) 
+    // the device applies its own back pressure, see LoggingQProcess::writeData
+    if (device->write(data, *len) != qint64(*len)) 
     {
-        if (!device->waitForBytesWritten(-1)) 
-        {
-            qFatal("Failed to write to process: %s", qPrintable(device->errorString()));
-            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "Failed to write to process: %s", qPrintable(device->errorString()));
-        }
+        return svn_error_createf(APR_EOF, SVN_NO_ERROR, "Failed to write to process: %s", qPrintable(device->errorString()));
     }
     
     return SVN_NO_ERROR;
@@ -128,29 +159,111 @@ svn_stream_t* SvnHelper::streamForDevice(QIODevice* device, apr_pool_t* pool)
     return stream;
 }
 
+svn_error_t* SvnHelper::copyStream(svn_stream_t* in_stream, QIODevice* device, qint64 length)
+{
+    // svn_stream_copy3 goes in 16k steps; big reads let big files go
+    // to the pipe in one write each, see PipeWriter
+    static const qint64 chunkSize = 1024 * 1024;
+    QByteArray buffer;
+    buffer.resize(int(qBound(qint64(1), length, chunkSize)));
+    apr_size_t len;
+
+    do 
+    {
+        len = buffer.size();
+        SVN_ERR(svn_stream_read_full(in_stream, buffer.data(), &len));
+
+        if (len > 0 && device->write(buffer.constData(), len) != qint64(len))
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "Failed to write to process: %s", qPrintable(device->errorString()));
+        }
+    } 
+    while (len == apr_size_t(buffer.size()));
+
+    return svn_stream_close(in_stream);
+}
+
+QByteArray SvnHelper::contentKey(svn_fs_root_t* fs_root, const char* pathname, apr_pool_t* pool)
+{
+    if (!CommandLineParser::instance()->contains("dedup-blobs") && !GitBlobIndex::instance()->isEnabled())
+    {
+        return QByteArray();
+    }
+
+    // the length goes into the key too, keys outlive a run in the blob index
+    svn_filesize_t length;
+    svn_error_t *err = svn_fs_file_length(&length, fs_root, pathname, pool);
+    
+    if (err != SVN_NO_ERROR) 
+    {
+        svn_error_clear(err);
+        return QByteArray();
+    }
+
+    // only use the checksums the repository already has, computing them
+    // would mean reading the contents we are trying not to read
+    static const svn_checksum_kind_t kinds[] = { svn_checksum_sha1, svn_checksum_md5 };
+
+    for (unsigned i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) 
+    {
+        svn_checksum_t *checksum;
+        err = svn_fs_file_checksum(&checksum, kinds[i], fs_root, pathname, FALSE, pool);
+        
+        if (err != SVN_NO_ERROR) 
+        {
+            svn_error_clear(err);
+            return QByteArray();
+        }
+
+        if (checksum) 
+        {
+            QByteArray key(1, char(checksum->kind));
+            key.append(reinterpret_cast<const char *>(checksum->digest), svn_checksum_size(checksum));
+            key.append(QByteArray::number(qint64(length)));
+            return key;
+        }
+    }
+
+    return QByteArray();
+}
+
 int SvnHelper::dumpBlob(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const char* pathname, const QString& finalPathName, apr_pool_t* pool)
 {
     AprAutoPool dumppool(pool);
     // what type is it?
     
-    int mode = pathMode(fs_root, pathname, dumppool);
+    SvnProperties props;
+    SVN_INT_ERR(SvnPropertyCache::instance()->properties(&props, fs_root, pathname, dumppool));
+    int mode = pathMode(props);
+
+    // maybe it's a symlink?
+    bool special = props.contains("svn:special");
+
+    // symlinks are tiny, and what is sent depends on more than the checksum
+    QByteArray key;
+    
+    if (!special) 
+    {
+        key = contentKey(fs_root, pathname, dumppool);
+        
+        if (txn->addExistingFile(finalPathName, mode, key))
+        {
+            return EXIT_SUCCESS;
+        }
+    }
 
     svn_filesize_t stream_length;
 
     SVN_INT_ERR(svn_fs_file_length(&stream_length, fs_root, pathname, dumppool));
 
-    svn_stream_t *in_stream, *out_stream;
+    svn_stream_t *in_stream;
     if (!CommandLineParser::instance()->contains("dry-run")) 
     {
         // open the file
         SVN_INT_ERR(svn_fs_file_contents(&in_stream, fs_root, pathname, dumppool));
     }
-
-    // maybe it's a symlink?
-    svn_string_t *propvalue;
-    SVN_INT_ERR(svn_fs_node_prop(&propvalue, fs_root, pathname, "svn:special", dumppool));
     
-    if (propvalue) 
+    if (special) 
     {
         apr_size_t len = strlen("link ");
         
@@ -176,13 +289,11 @@ int SvnHelper::dumpBlob(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, c
         }
     }
 
-    QIODevice *io = txn->addFile(finalPathName, mode, stream_length);
+    QIODevice *io = txn->addFile(finalPathName, mode, stream_length, key);
 
     if (!CommandLineParser::instance()->contains("dry-run")) 
     {
-        // open a generic svn_stream_t for the QIODevice
-        out_stream = streamForDevice(io, dumppool);
-        SVN_INT_ERR(svn_stream_copy3(in_stream, out_stream, NULL, NULL, dumppool));
+        SVN_INT_ERR(copyStream(in_stream, io, stream_length));
 
         // print an ending newline
         io->putChar('\n');
@@ -191,7 +302,7 @@ int SvnHelper::dumpBlob(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, c
     return EXIT_SUCCESS;
 }
 
-int SvnHelper::recursiveDumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
+int SvnHelper::walkDir(svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, FileVisitor visit, void* baton, apr_pool_t* pool)
 {
     // get the dir listing
     apr_hash_t* entries;
@@ -222,17 +333,14 @@ int SvnHelper::recursiveDumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs
         if (i.value() == svn_node_dir) 
         {
             entryFinalName += '/';
-            if (recursiveDumpDir(txn, fs_root, entryName, entryFinalName, dirpool) == EXIT_FAILURE)
+            if (walkDir(fs_root, entryName, entryFinalName, visit, baton, dirpool) == EXIT_FAILURE)
             {
                 return EXIT_FAILURE;
             }
         } 
         else if (i.value() == svn_node_file) 
         {
-            printf("+");
-            fflush(stdout);
-            
-            if (dumpBlob(txn, fs_root, entryName, entryFinalName, dirpool) == EXIT_FAILURE)
+            if (visit(baton, entryName, entryFinalName, dirpool) == EXIT_FAILURE)
             {
                 return EXIT_FAILURE;
             }
@@ -242,6 +350,41 @@ int SvnHelper::recursiveDumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs
     return EXIT_SUCCESS;
 }
 
+struct DumpBaton
+{
+    GitRepositoryTransaction* txn;
+    svn_fs_root_t* fs_root;
+};
+
+static int dumpFile(void* baton, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
+{
+    DumpBaton* dump = reinterpret_cast<DumpBaton *>(baton);
+
+    printf("+");
+    fflush(stdout);
+
+    return SvnHelper::dumpBlob(dump->txn, dump->fs_root, pathname, finalPathName, pool);
+}
+
+int SvnHelper::recursiveDumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
+{
+    DumpBaton baton = { txn, fs_root };
+
+    return walkDir(fs_root, pathname, finalPathName, dumpFile, &baton, pool);
+}
+
+static int listFile(void* baton, const QByteArray& pathname, const QString& finalPathName, apr_pool_t*)
+{
+    reinterpret_cast<QList<QPair<QByteArray, QString> > *>(baton)->append(qMakePair(pathname, finalPathName));
+
+    return EXIT_SUCCESS;
+}
+
+int SvnHelper::listFiles(svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, QList<QPair<QByteArray, QString> >* files, apr_pool_t* pool)
+{
+    return walkDir(fs_root, pathname, finalPathName, listFile, files, pool);
+}
+
 bool SvnHelper::wasDir(svn_fs_t* fs, int revnum, const char* pathname, apr_pool_t* pool)
 {
     AprAutoPool subpool(pool);
@@ -262,6 +405,23 @@ bool SvnHelper::wasDir(svn_fs_t* fs, int revnum, const char* pathname, apr_pool_
     return is_dir;
 }
 
+svn_error_t* SvnHelper::openFilesystem(svn_fs_t** fs, const QString& pathToRepository, apr_pool_t* pool)
+{
+    svn_repos_t* repos;
+    QString path = pathToRepository;
+    
+    while (path.endsWith('/')) // no trailing slash allowed
+    {
+        path = path.mid(0, path.length() - 1);
+    }
+    
+    AprAutoPool scratch_pool(pool);
+    SVN_ERR(svn_repos_open3(&repos, QFile::encodeName(path), NULL, pool, scratch_pool));
+    *fs = svn_repos_fs(repos);
+
+    return SVN_NO_ERROR;
+}
+
 time_t SvnHelper::getEpoch(const char* svn_date)
 {
     struct tm tm;
@@ -20,9 +20,13 @@
 #define SVN_HELPER_H
 
 #include <QList>
+#include <QPair>
 #include <QString>
+#include <QByteArray>
 
-#include "rules/RuleMatch.h"
+#include "rules/RuleMatcher.h"
+
+#include "SvnPropertyCache.h"
 
 class QIODevice;
 class GitRepositoryTransaction;
@@ -35,20 +39,29 @@ struct apr_pool_t;
 
 typedef size_t apr_size_t;
 
-enum RuleType { AnyRule = 0, NoIgnoreRule = 0x01, NoRecurseRule = 0x02 };
+enum RuleType { AnyRule = 0, NoIgnoreRule = 0x01, NoRecurseRule = 0x02, NoStatsRule = 0x04 };
 
 class SvnHelper
 {
     
 public:
+
+    // called for each file walkDir finds
+    typedef int (*FileVisitor)(void* baton, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool);
     
-    static QList<RuleMatch>::ConstIterator findMatchRule(const QList<RuleMatch>& matchRules, int revnum, const QString& current, int ruleMask = AnyRule);
+    static QList<RuleMatch>::ConstIterator findMatchRule(const RuleMatcher& matcher, int revnum, const QString& current, int ruleMask = AnyRule, int* matchedLength = 0);
     static int pathMode(svn_fs_root_t* fs_root, const char *pathname, apr_pool_t* pool);
+    static int pathMode(const SvnProperties& props);
     svn_error_t* deviceWrite(void* baton, const char* data, apr_size_t* len); 
     static svn_stream_t* streamForDevice(QIODevice* device, apr_pool_t* pool);
+    static svn_error_t* copyStream(svn_stream_t* in_stream, QIODevice* device, qint64 length);
+    static QByteArray contentKey(svn_fs_root_t* fs_root, const char* pathname, apr_pool_t* pool);
     static int dumpBlob(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const char* pathname, const QString& finalPathName, apr_pool_t* pool);
+    static int walkDir(svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, FileVisitor visit, void* baton, apr_pool_t* pool);
     static int recursiveDumpDir(GitRepositoryTransaction* txn, svn_fs_root_t* fs_root, const QByteArray &pathname, const QString &finalPathName, apr_pool_t* pool);
+    static int listFiles(svn_fs_root_t* fs_root, const QByteArray& pathname, const QString& finalPathName, QList<QPair<QByteArray, QString> >* files, apr_pool_t* pool);
     static bool wasDir(svn_fs_t* fs, int revnum, const char* pathname, apr_pool_t* pool);
+    static svn_error_t* openFilesystem(svn_fs_t** fs, const QString& pathToRepository, apr_pool_t* pool);
     static time_t getEpoch(const char* svn_date);
     static svn_error_t* QIODevice_write(void* baton, const char* data, apr_size_t* len);
 };
@@ -0,0 +1,189 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnNodeCache.h"
+
+#include <svn_fs.h>
+#include <svn_pools.h>
+
+// forget all kinds at once when there are more than this many
+static const int maxKinds = 256 * 1024;
+
+SvnNodeCache::SvnNodeCache(svn_fs_t* f, apr_pool_t* parent_pool, int max) :
+    fs(f),
+    pool(parent_pool),
+    maxRoots(qMax(max, 1))
+{
+}
+
+SvnNodeCache::~SvnNodeCache()
+{
+    foreach (const Root& root, roots)
+    {
+        delete root.pool;
+    }
+}
+
+svn_error_t* SvnNodeCache::revisionRoot(svn_fs_root_t** root, int revnum)
+{
+    for (int i = 0; i < roots.size(); ++i) 
+    {
+        if (roots.at(i).revnum == revnum) 
+        {
+            if (i > 0)
+            {
+                roots.move(i, 0);
+            }
+            
+            *root = roots.first().root;
+            return SVN_NO_ERROR;
+        }
+    }
+
+    Root entry;
+    entry.revnum = revnum;
+    entry.pins = 0;
+    entry.pool = new AprAutoPool(pool);
+    svn_error_t* err = svn_fs_revision_root(&entry.root, fs, revnum, *entry.pool);
+    
+    if (err != SVN_NO_ERROR) 
+    {
+        delete entry.pool;
+        return err;
+    }
+
+    // the least recently used root nobody holds on to
+    for (int i = roots.size() - 1; i >= 0 && roots.size() >= maxRoots; --i) 
+    {
+        if (roots.at(i).pins == 0)
+        {
+            delete roots.takeAt(i).pool;
+        }
+    }
+
+    roots.prepend(entry);
+    *root = entry.root;
+    
+    return SVN_NO_ERROR;
+}
+
+void SvnNodeCache::unpin(int revnum)
+{
+    for (int i = 0; i < roots.size(); ++i) 
+    {
+        if (roots.at(i).revnum == revnum) 
+        {
+            --roots[i].pins;
+            return;
+        }
+    }
+}
+
+svn_error_t* SvnNodeCache::checkPath(svn_node_kind_t* kind, int revnum, const QByteArray& path, apr_pool_t* scratch_pool)
+{
+    QHash<QPair<int, QByteArray>, svn_node_kind_t>::ConstIterator it = kinds.constFind(qMakePair(revnum, path));
+    
+    if (it != kinds.constEnd()) 
+    {
+        *kind = *it;
+        return SVN_NO_ERROR;
+    }
+
+    svn_fs_root_t* root;
+    SVN_ERR(revisionRoot(&root, revnum));
+    SVN_ERR(svn_fs_check_path(kind, root, path, scratch_pool));
+    addKind(revnum, path, *kind);
+    
+    return SVN_NO_ERROR;
+}
+
+bool SvnNodeCache::isDir(int revnum, const QByteArray& path, apr_pool_t* scratch_pool)
+{
+    svn_node_kind_t kind;
+    svn_error_t* err = checkPath(&kind, revnum, path, scratch_pool);
+    
+    if (err != SVN_NO_ERROR) 
+    {
+        // same as SvnHelper::wasDir
+        svn_error_clear(err);
+        return false;
+    }
+
+    return kind == svn_node_dir;
+}
+
+void SvnNodeCache::addKind(int revnum, const QByteArray& path, svn_node_kind_t kind)
+{
+    if (kinds.size() >= maxKinds)
+    {
+        kinds.clear();
+    }
+
+    kinds.insert(qMakePair(revnum, path), kind);
+}
+
+void SvnNodeCache::addKinds(const QHash<QPair<int, QByteArray>, bool>& known)
+{
+    QHash<QPair<int, QByteArray>, bool>::ConstIterator it = known.constBegin();
+    
+    for ( ; it != known.constEnd(); ++it)
+    {
+        addKind(it.key().first, it.key().second, it.value() ? svn_node_dir : svn_node_file);
+    }
+}
+
+void SvnNodeCache::addDirEntries(int revnum, const QByteArray& path, apr_hash_t* entries, apr_pool_t* scratch_pool)
+{
+    addKind(revnum, path, svn_node_dir);
+
+    for (apr_hash_index_t *i = apr_hash_first(scratch_pool, entries); i; i = apr_hash_next(i)) 
+    {
+        const void *vkey;
+        void *value;
+        apr_hash_this(i, &vkey, NULL, &value);
+        svn_fs_dirent_t *dirent = reinterpret_cast<svn_fs_dirent_t *>(value);
+        addKind(revnum, path + '/' + dirent->name, dirent->kind);
+    }
+}
+
+SvnRootPin::SvnRootPin(SvnNodeCache* c) :
+    cache(c),
+    revnum(-1)
+{
+}
+
+SvnRootPin::~SvnRootPin()
+{
+    if (revnum >= 0)
+    {
+        cache->unpin(revnum);
+    }
+}
+
+svn_error_t* SvnRootPin::pin(svn_fs_root_t** root, int rev)
+{
+    Q_ASSERT(revnum < 0);
+
+    SVN_ERR(cache->revisionRoot(root, rev));
+
+    // revisionRoot() just put it first
+    ++cache->roots[0].pins;
+    revnum = rev;
+
+    return SVN_NO_ERROR;
+}
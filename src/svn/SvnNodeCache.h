@@ -0,0 +1,105 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_NODE_CACHE_H
+#define SVN_NODE_CACHE_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QByteArray>
+
+#include <svn_types.h>
+
+#include "AprAutoPool.h"
+
+struct svn_fs_t;
+struct svn_fs_root_t;
+struct svn_error_t;
+struct apr_hash_t;
+
+/**
+ * Revision roots and node kinds of older revisions, kept across
+ * SvnRevision instances. A root returned by revisionRoot() is only good
+ * until the next call; whoever holds on to one longer pins it with an
+ * SvnRootPin. Pinned roots are never evicted, the cache grows past
+ * maxRoots instead.
+ */
+class SvnNodeCache
+{
+
+public:
+
+    SvnNodeCache(svn_fs_t* fs, apr_pool_t* parent_pool, int maxRoots = 8);
+    ~SvnNodeCache();
+
+    svn_error_t* revisionRoot(svn_fs_root_t** root, int revnum);
+    svn_error_t* checkPath(svn_node_kind_t* kind, int revnum, const QByteArray& path, apr_pool_t* pool);
+    bool isDir(int revnum, const QByteArray& path, apr_pool_t* pool);
+
+    void addKind(int revnum, const QByteArray& path, svn_node_kind_t kind);
+    void addKinds(const QHash<QPair<int, QByteArray>, bool>& kinds);
+    void addDirEntries(int revnum, const QByteArray& path, apr_hash_t* entries, apr_pool_t* pool);
+
+private:
+
+    friend class SvnRootPin;
+
+    struct Root
+    {
+        int revnum;
+        int pins;
+        AprAutoPool* pool;
+        svn_fs_root_t* root;
+    };
+
+    void unpin(int revnum);
+
+    svn_fs_t* fs;
+    AprAutoPool pool;
+    int maxRoots;
+
+    // most recently used first
+    QList<Root> roots;
+    QHash<QPair<int, QByteArray>, svn_node_kind_t> kinds;
+
+    Q_DISABLE_COPY(SvnNodeCache)
+};
+
+/**
+ * A root of an SvnNodeCache that stays valid while this is in scope.
+ */
+class SvnRootPin
+{
+
+public:
+
+    explicit SvnRootPin(SvnNodeCache* cache);
+    ~SvnRootPin();
+
+    svn_error_t* pin(svn_fs_root_t** root, int revnum);
+
+private:
+
+    SvnNodeCache* cache;
+    int revnum;
+
+    Q_DISABLE_COPY(SvnRootPin)
+};
+
+#endif
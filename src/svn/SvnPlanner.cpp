@@ -0,0 +1,214 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnPlanner.h"
+
+#include <QThread>
+
+#include <stdio.h>
+
+#include "SvnHelper.h"
+#include "SvnChangeset.h"
+#include "SvnPrefetcher.h"
+
+// how many change lists the scan keeps ahead of the routing
+static const int planDepth = 256;
+
+static QString formatBytes(qint64 bytes)
+{
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MB";
+}
+
+static QString formatDuration(qint64 msecs)
+{
+    qint64 secs = msecs / 1000;
+    
+    return QString("%1:%2:%3").arg(secs / 3600).arg((secs / 60) % 60, 2, 10, QChar('0')).arg(secs % 60, 2, 10, QChar('0'));
+}
+
+SvnPlan::Workload::Workload() :
+    revisions(0),
+    changes(0),
+    bytes(0)
+{
+}
+
+SvnPlan::SvnPlan() :
+    scanned(0),
+    totalBytes(0)
+{
+}
+
+SvnPlanner::SvnPlanner(const QString& pathToRepository, const QList<RuleMatcher>& rules) :
+    path(pathToRepository),
+    allMatchRules(rules)
+{
+}
+
+void SvnPlanner::run(int first, int last, const QSet<int>& filter, SvnPlan* plan)
+{
+    SvnPrefetcher prefetcher(path, planDepth, QThread::idealThreadCount(), true);
+    prefetcher.start(first, last, filter);
+
+    printf("Planning revisions %d to %d", first, last);
+    fflush(stdout);
+    
+    for (int revnum = first; revnum <= last; ++revnum) 
+    {
+        if (!filter.isEmpty() && !filter.contains(revnum))
+        {
+            continue;
+        }
+
+        ++plan->scanned;
+        
+        if (plan->scanned % 1000 == 0) 
+        {
+            printf(".");
+            fflush(stdout);
+        }
+
+        SvnChangeset* changeset = prefetcher.take(revnum);
+        
+        if (!changeset) 
+        {
+            // could not read it, let the export find out why
+            plan->revisions.append(revnum);
+            continue;
+        }
+
+        if (route(*changeset, plan))
+        {
+            plan->revisions.append(revnum);
+        }
+        
+        delete changeset;
+    }
+    
+    printf("\n");
+}
+
+bool SvnPlanner::route(const SvnChangeset& changeset, SvnPlan* plan)
+{
+    const int revnum = changeset.revision();
+    bool relevant = false;
+    qint64 revisionBytes = 0;
+    QSet<QString> touched;
+
+    foreach (const SvnChange& change, changeset.changes()) 
+    {
+        QString current = QString::fromUtf8(change.path);
+        
+        if (change.isDir)
+        {
+            current += '/';
+        }
+
+        foreach (const RuleMatcher& matchRules, allMatchRules) 
+        {
+            int matchedLength;
+            QList<RuleMatch>::ConstIterator match = SvnHelper::findMatchRule(matchRules, revnum, current, NoStatsRule, &matchedLength);
+            
+            if (match == matchRules.rules().constEnd()) 
+            {
+                // auto-recursion or an error, either way the export has to see it
+                relevant = true;
+                continue;
+            }
+
+            if (match->action == Ignore)
+            {
+                continue;
+            }
+
+            relevant = true;
+            
+            if (match->action != Export)
+            {
+                continue;
+            }
+
+            // the repository part of SvnRevision::splitPathName
+            QString repository = current.left(matchedLength);
+            match->compiled.replace(repository, match->repository);
+            
+            foreach (RuleMatchSubstitution subst, match->repo_substs) 
+            {
+                subst.apply(repository);
+            }
+
+            SvnPlan::Workload& workload = plan->repositories[repository];
+            ++workload.changes;
+            
+            if (change.size > 0) 
+            {
+                workload.bytes += change.size;
+                revisionBytes += change.size;
+            }
+
+            if (!touched.contains(repository)) 
+            {
+                touched.insert(repository);
+                ++workload.revisions;
+            }
+        }
+    }
+
+    if (relevant) 
+    {
+        plan->bytes.insert(revnum, revisionBytes);
+        plan->totalBytes += revisionBytes;
+    }
+
+    return relevant;
+}
+
+void SvnPlanner::printReport(const SvnPlan& plan)
+{
+    printf("Plan: %d of %d revisions to export, %d skipped, about %s of changed files\n",
+           plan.revisions.size(), plan.scanned, plan.scanned - plan.revisions.size(), qPrintable(formatBytes(plan.totalBytes)));
+
+    QMapIterator<QString, SvnPlan::Workload> i(plan.repositories);
+    
+    while (i.hasNext()) 
+    {
+        i.next();
+        printf("  %-40s %8d revisions %10d changes %12s\n", qPrintable(i.key()), i.value().revisions, i.value().changes, qPrintable(formatBytes(i.value().bytes)));
+    }
+}
+
+void SvnPlanner::printProgress(const SvnPlan& plan, int revisionsDone, qint64 bytesDone, qint64 msecs)
+{
+    if (plan.revisions.isEmpty())
+    {
+        return;
+    }
+
+    // revisions and bytes both cost time, weigh them the same
+    double done = double(revisionsDone) / plan.revisions.size();
+    
+    if (plan.totalBytes > 0)
+    {
+        done = (done + double(bytesDone) / plan.totalBytes) / 2;
+    }
+
+    QString eta = done > 0 ? formatDuration(qint64(msecs * (1 - done) / done)) : QString("unknown");
+    
+    printf("Progress: %d/%d revisions, %s/%s, elapsed %s, ETA %s\n", revisionsDone, plan.revisions.size(),
+           qPrintable(formatBytes(bytesDone)), qPrintable(formatBytes(plan.totalBytes)), qPrintable(formatDuration(msecs)), qPrintable(eta));
+}
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_PLANNER_H
+#define SVN_PLANNER_H
+
+#include <QSet>
+#include <QMap>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include "rules/RuleMatcher.h"
+
+class SvnChangeset;
+
+/**
+ * What an export of a revision range is going to do: the revisions
+ * that have anything to export, and an estimate of the work per
+ * revision and per repository. Sizes only count changed files, not
+ * the contents of copied directories.
+ */
+struct SvnPlan
+{
+    struct Workload
+    {
+        Workload();
+
+        int revisions;
+        int changes;
+        qint64 bytes;
+    };
+
+    SvnPlan();
+
+    QList<int> revisions;
+    QHash<int, qint64> bytes;
+    QMap<QString, Workload> repositories;
+    int scanned;
+    qint64 totalBytes;
+};
+
+/**
+ * Scans the change lists of a revision range on background threads and
+ * routes the changed paths through the rules without reading any
+ * contents. A revision is left out of the plan only when all of its
+ * paths hit ignore rules, everything else is decided by the export.
+ */
+class SvnPlanner
+{
+
+public:
+
+    SvnPlanner(const QString& pathToRepository, const QList<RuleMatcher>& allMatchRules);
+
+    void run(int first, int last, const QSet<int>& filter, SvnPlan* plan);
+
+    static void printReport(const SvnPlan& plan);
+    static void printProgress(const SvnPlan& plan, int revisionsDone, qint64 bytesDone, qint64 msecs);
+
+private:
+
+    bool route(const SvnChangeset& changeset, SvnPlan* plan);
+
+    QString path;
+    QList<RuleMatcher> allMatchRules;
+};
+
+#endif
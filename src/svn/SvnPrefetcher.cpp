@@ -0,0 +1,228 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnPrefetcher.h"
+
+#include <QMutexLocker>
+
+#include <svn_fs.h>
+#include <svn_pools.h>
+
+#include "AprAutoPool.h"
+#include "SvnHelper.h"
+#include "SvnChangeset.h"
+#include "SvnDumpLoader.h"
+
+SvnPrefetcher::Worker::Worker(SvnPrefetcher* p) :
+    prefetcher(p)
+{
+}
+
+void SvnPrefetcher::Worker::run()
+{
+    // every thread gets its own pool and filesystem handle, libsvn_fs
+    // objects must not be shared between threads
+    AprAutoPool pool;
+    svn_fs_t* fs = NULL;
+    svn_error_t* err = SvnHelper::openFilesystem(&fs, prefetcher->path, pool);
+
+    if (err != SVN_NO_ERROR) 
+    {
+        // the consumer falls back to fetching the revisions itself
+        svn_error_clear(err);
+        fs = NULL;
+    }
+
+    AprAutoPool iterpool(pool);
+    int revnum;
+    
+    while (prefetcher->claim(&revnum)) 
+    {
+        iterpool.clear();
+        SvnChangeset* changeset = NULL;
+
+        if (fs && (!prefetcher->loader || prefetcher->loader->waitForRevision(revnum))) 
+        {
+            changeset = new SvnChangeset;
+            err = changeset->fetch(fs, revnum, iterpool, prefetcher->sizes);
+            
+            if (err != SVN_NO_ERROR) 
+            {
+                svn_error_clear(err);
+                delete changeset;
+                changeset = NULL;
+            }
+        }
+
+        prefetcher->deliver(revnum, changeset);
+    }
+}
+
+SvnPrefetcher::SvnPrefetcher(const QString& pathToRepository, int d, int threads, bool s) :
+    path(pathToRepository),
+    loader(NULL),
+    sizes(s),
+    depth(qMax(d, 1)),
+    threadCount(qBound(1, threads, depth)),
+    first(0),
+    last(-1),
+    next(0),
+    taken(0),
+    outstanding(0),
+    stopping(false)
+{
+}
+
+SvnPrefetcher::~SvnPrefetcher()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        spaceCondition.wakeAll();
+    }
+
+    foreach (Worker* worker, workers) 
+    {
+        worker->wait();
+        delete worker;
+    }
+
+    qDeleteAll(ready);
+}
+
+void SvnPrefetcher::setLoader(SvnDumpLoader* l)
+{
+    Q_ASSERT(workers.isEmpty());
+    loader = l;
+}
+
+void SvnPrefetcher::start(int firstRevision, int lastRevision, const QSet<int>& revisions)
+{
+    Q_ASSERT(workers.isEmpty());
+
+    first = firstRevision;
+    last = lastRevision;
+    filter = revisions;
+    taken = first - 1;
+    next = nextScheduled(first);
+
+    for (int i = 0; i < threadCount; ++i) 
+    {
+        Worker* worker = new Worker(this);
+        workers.append(worker);
+        worker->start();
+    }
+}
+
+SvnChangeset* SvnPrefetcher::take(int revnum)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!isScheduled(revnum) || revnum <= taken)
+    {
+        return NULL;
+    }
+
+    // the consumer skipped ahead, drop whatever it is not going to ask for
+    foreach (int rev, ready.keys()) 
+    {
+        if (rev < revnum) 
+        {
+            delete ready.take(rev);
+            --outstanding;
+        }
+    }
+    
+    taken = revnum;
+    
+    if (next < revnum)
+    {
+        next = revnum;
+    }
+    
+    spaceCondition.wakeAll();
+
+    while (!ready.contains(revnum))
+    {
+        readyCondition.wait(&mutex);
+    }
+
+    SvnChangeset* changeset = ready.take(revnum);
+    --outstanding;
+    spaceCondition.wakeAll();
+
+    return changeset;
+}
+
+bool SvnPrefetcher::claim(int* revnum)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!stopping && next <= last && outstanding >= depth)
+    {
+        spaceCondition.wait(&mutex);
+    }
+
+    if (stopping || next > last)
+    {
+        return false;
+    }
+
+    *revnum = next;
+    ++outstanding;
+    next = nextScheduled(next + 1);
+
+    return true;
+}
+
+void SvnPrefetcher::deliver(int revnum, SvnChangeset* changeset)
+{
+    QMutexLocker locker(&mutex);
+
+    if (revnum < taken) 
+    {
+        // nobody is going to ask for this one anymore
+        delete changeset;
+        --outstanding;
+        spaceCondition.wakeAll();
+        return;
+    }
+
+    ready.insert(revnum, changeset);
+    readyCondition.wakeAll();
+}
+
+bool SvnPrefetcher::isScheduled(int revnum) const
+{
+    if (revnum < first || revnum > last)
+    {
+        return false;
+    }
+
+    return filter.isEmpty() || filter.contains(revnum);
+}
+
+int SvnPrefetcher::nextScheduled(int revnum) const
+{
+    while (revnum <= last && !isScheduled(revnum))
+    {
+        ++revnum;
+    }
+
+    return revnum;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_PREFETCHER_H
+#define SVN_PREFETCHER_H
+
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+class SvnChangeset;
+class SvnDumpLoader;
+
+/**
+ * Resolves the changesets of upcoming revisions on background threads,
+ * each with its own svn_fs_t, so that reading the repository overlaps
+ * with feeding git fast-import. At most 'depth' revisions are held
+ * ahead of the consumer, which must take() them in increasing order.
+ */
+class SvnPrefetcher
+{
+
+public:
+
+    SvnPrefetcher(const QString& pathToRepository, int depth, int threads, bool sizes = false);
+    ~SvnPrefetcher();
+
+    // revisions are only fetched once the loader has them
+    void setLoader(SvnDumpLoader* loader);
+    void start(int first, int last, const QSet<int>& filter);
+
+    // returns 0 if the revision was not prefetched, or if fetching it failed
+    SvnChangeset* take(int revnum);
+
+private:
+
+    class Worker : public QThread
+    {
+
+    public:
+
+        Worker(SvnPrefetcher* prefetcher);
+
+    protected:
+
+        void run();
+
+    private:
+
+        SvnPrefetcher* prefetcher;
+    };
+
+    bool claim(int* revnum);
+    void deliver(int revnum, SvnChangeset* changeset);
+    bool isScheduled(int revnum) const;
+    int nextScheduled(int revnum) const;
+
+    QString path;
+    SvnDumpLoader* loader;
+    bool sizes;
+    int depth;
+    int threadCount;
+    QList<Worker*> workers;
+
+    QMutex mutex;
+    QWaitCondition readyCondition;
+    QWaitCondition spaceCondition;
+    QHash<int, SvnChangeset*> ready;
+    QSet<int> filter;
+    int first;
+    int last;
+    int next;
+    int taken;
+    int outstanding;
+    bool stopping;
+
+    Q_DISABLE_COPY(SvnPrefetcher)
+};
+
+#endif
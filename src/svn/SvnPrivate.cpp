@@ -18,19 +18,46 @@
 
 #include "SvnPrivate.h"
 
-#include <QFile>
 #include <QDebug>
+#include <QThread>
 
 #include <svn_fs.h>
 #include <svn_pools.h>
 #include <svn_repos.h>
 
+#include "SvnHelper.h"
 #include "SvnRevision.h"
+#include "SvnChangeset.h"
+#include "SvnPrefetcher.h"
+#include "SvnBlobReader.h"
+#include "SvnNodeCache.h"
+#include "SvnDumpLoader.h"
+#include "SvnPlanner.h"
+
+#include "commandline/CommandLineParser.h"
 
 SvnPrivate::SvnPrivate(const QString& pathToRepository) :
     global_pool(NULL), 
-    scratch_pool(NULL)
+    scratch_pool(NULL),
+    repositoryPath(pathToRepository),
+    loader(NULL),
+    prefetcher(NULL),
+    blobReader(NULL),
+    nodeCache(NULL)
 {
+    const QString dumpFile = CommandLineParser::instance()->optionArgument(QLatin1String("from-dump"));
+    
+    if (!dumpFile.isEmpty()) 
+    {
+        loader = new SvnDumpLoader(pathToRepository, dumpFile);
+        
+        if (loader->startLoading() != EXIT_SUCCESS) 
+        {
+            qCritical() << "Failed to load the dump into the repository";
+            exit(1);
+        }
+    }
+
     if( openRepository(pathToRepository) != EXIT_SUCCESS) 
     {
         qCritical() << "Failed to open repository";
@@ -39,32 +66,77 @@ SvnPrivate::SvnPrivate(const QString& pathToRepository) :
 
     // get the youngest revision
     svn_fs_youngest_rev(&youngest_rev, fs, global_pool);
+
+    nodeCache = new SvnNodeCache(fs, global_pool);
+
+    int readThreads = CommandLineParser::instance()->optionArgument(QLatin1String("read-threads"), QLatin1String("0")).toInt();
+    
+    // a dry run does not read any contents
+    if (readThreads > 1 && !CommandLineParser::instance()->contains(QLatin1String("dry-run"))) 
+    {
+        blobReader = new SvnBlobReader(repositoryPath, readThreads);
+    }
 }
 
 SvnPrivate::~SvnPrivate()
 {
-    
+    // prefetch threads may be waiting for revisions that will never come
+    if (loader)
+    {
+        loader->stop();
+    }
+
+    delete nodeCache;
+    delete blobReader;
+    delete prefetcher;
+    delete loader;
 }
 
 int SvnPrivate::youngestRevision()
 {
+    if (loader)
+    {
+        return loader->waitForEnd();
+    }
+
     return youngest_rev;
 }
 
+bool SvnPrivate::waitForRevision(int revnum)
+{
+    if (loader)
+    {
+        return loader->waitForRevision(revnum);
+    }
+
+    return true;
+}
+
 int SvnPrivate::openRepository(const QString& pathToRepository)
 {
-    svn_repos_t* repos;
-    QString path = pathToRepository;
+    SVN_INT_ERR(SvnHelper::openFilesystem(&fs, pathToRepository, global_pool));
+
+    return EXIT_SUCCESS;
+}
+
+void SvnPrivate::plan(int first, int last, const QSet<int>& revisions, SvnPlan* plan)
+{
+    SvnPlanner planner(repositoryPath, allMatchRules);
+    planner.run(first, last, revisions, plan);
+}
+
+void SvnPrivate::startPrefetch(int first, int last, const QSet<int>& revisions)
+{
+    int depth = CommandLineParser::instance()->optionArgument(QLatin1String("prefetch"), QLatin1String("0")).toInt();
     
-    while (path.endsWith('/')) // no trailing slash allowed
+    if (depth < 1 || prefetcher)
     {
-        path = path.mid(0, path.length() - 1);
+        return;
     }
-    
-    SVN_INT_ERR(svn_repos_open3(&repos, QFile::encodeName(path), NULL, global_pool, scratch_pool));
-    fs = svn_repos_fs(repos);
 
-    return EXIT_SUCCESS;
+    prefetcher = new SvnPrefetcher(repositoryPath, depth, QThread::idealThreadCount());
+    prefetcher->setLoader(loader);
+    prefetcher->start(first, last, revisions);
 }
 
 int SvnPrivate::exportRevision(int revnum)
@@ -74,6 +146,19 @@ int SvnPrivate::exportRevision(int revnum)
     rev.repositories = repositories;
     rev.identities = identities;
     rev.userdomain = userdomain;
+    rev.blobReader = blobReader;
+    rev.nodeCache = nodeCache;
+
+    if (prefetcher) 
+    {
+        SvnChangeset* changeset = prefetcher->take(revnum);
+        
+        if (changeset) 
+        {
+            rev.setChangeset(*changeset);
+            delete changeset;
+        }
+    }
 
     // open this revision:
     printf("Exporting revision %d ", revnum);
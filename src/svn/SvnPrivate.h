@@ -19,6 +19,7 @@
 #ifndef SVN_PRIVATE_H
 #define SVN_PRIVATE_H
 
+#include <QSet>
 #include <QList>
 #include <QHash>
 #include <QString>
@@ -28,9 +29,14 @@
 
 #include "AprAutoPool.h"
 
-#include "rules/RuleMatch.h"
+#include "rules/RuleMatcher.h"
 
 class GitRepository;
+class SvnPrefetcher;
+class SvnBlobReader;
+class SvnNodeCache;
+class SvnDumpLoader;
+struct SvnPlan;
 
 struct svn_fs_t;
 
@@ -43,10 +49,13 @@ public:
     ~SvnPrivate();
     
     int youngestRevision();
+    bool waitForRevision(int revnum);
     int exportRevision(int revnum);
     int openRepository(const QString& pathToRepository);
+    void plan(int first, int last, const QSet<int>& revisions, SvnPlan* plan);
+    void startPrefetch(int first, int last, const QSet<int>& revisions);
     
-    QList<QList<RuleMatch> > allMatchRules;
+    QList<RuleMatcher> allMatchRules;
     QHash<QString, GitRepository*> repositories;
     QHash<QByteArray, QByteArray> identities;
     QString userdomain;
@@ -56,6 +65,11 @@ private:
     AprAutoPool global_pool;
     AprAutoPool scratch_pool;
     
+    QString repositoryPath;
+    SvnDumpLoader* loader;
+    SvnPrefetcher* prefetcher;
+    SvnBlobReader* blobReader;
+    SvnNodeCache* nodeCache;
     svn_fs_t* fs;
     svn_revnum_t youngest_rev;
 };
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SvnPropertyCache.h"
+
+#include <QMutexLocker>
+
+#include <svn_fs.h>
+#include <svn_pools.h>
+
+// forget everything at once when there are more nodes than this
+static const int maxNodes = 64 * 1024;
+
+SvnPropertyCache::SvnPropertyCache()
+{
+}
+
+SvnPropertyCache* SvnPropertyCache::instance()
+{
+    static SvnPropertyCache self;
+    return &self;
+}
+
+svn_error_t* SvnPropertyCache::properties(SvnProperties* props, svn_fs_root_t* fs_root, const char* pathname, apr_pool_t* pool)
+{
+    const svn_fs_id_t* id;
+    SVN_ERR(svn_fs_node_id(&id, fs_root, pathname, pool));
+    svn_string_t* unparsed = svn_fs_unparse_id(id, pool);
+    QByteArray key(unparsed->data, unparsed->len);
+
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QByteArray, SvnProperties>::ConstIterator it = cache.constFind(key);
+        
+        if (it != cache.constEnd()) 
+        {
+            *props = *it;
+            return SVN_NO_ERROR;
+        }
+    }
+
+    apr_hash_t* table;
+    SVN_ERR(svn_fs_node_proplist(&table, fs_root, pathname, pool));
+    props->clear();
+    
+    for (apr_hash_index_t* hi = apr_hash_first(pool, table); hi; hi = apr_hash_next(hi)) 
+    {
+        const void* propKey;
+        void* propVal;
+        apr_hash_this(hi, &propKey, NULL, &propVal);
+        const svn_string_t* value = reinterpret_cast<const svn_string_t*>(propVal);
+        props->insert(QByteArray(reinterpret_cast<const char*>(propKey)), QByteArray(value->data, value->len));
+    }
+
+    QMutexLocker locker(&mutex);
+    
+    if (cache.size() >= maxNodes)
+    {
+        cache.clear();
+    }
+    
+    cache.insert(key, *props);
+
+    return SVN_NO_ERROR;
+}
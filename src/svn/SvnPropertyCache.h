@@ -0,0 +1,57 @@
+/*
+ *  Copyright (C) 2007  Thiago Macieira <thiago@kde.org>
+ *  Copyright (C) 2016  Daniel Dewald <daniel.dewald@innogames.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SVN_PROPERTY_CACHE_H
+#define SVN_PROPERTY_CACHE_H
+
+#include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QByteArray>
+
+struct svn_fs_root_t;
+struct svn_error_t;
+struct apr_pool_t;
+
+typedef QMap<QByteArray, QByteArray> SvnProperties;
+
+/**
+ * The properties of a node, read with one svn_fs_node_proplist call and
+ * kept by node-revision id, so a node reached again through another
+ * revision or another copy is not read again. Shared by all threads.
+ */
+class SvnPropertyCache
+{
+
+public:
+
+    static SvnPropertyCache* instance();
+
+    svn_error_t* properties(SvnProperties* props, svn_fs_root_t* fs_root, const char* pathname, apr_pool_t* pool);
+
+private:
+
+    SvnPropertyCache();
+
+    QMutex mutex;
+    QHash<QByteArray, SvnProperties> cache;
+
+    Q_DISABLE_COPY(SvnPropertyCache)
+};
+
+#endif
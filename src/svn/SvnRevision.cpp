@@ -31,15 +31,22 @@
 #include "git/GitRepositoryTransaction.h"
 
 #include "SvnHelper.h"
+#include "SvnBlobReader.h"
+#include "SvnNodeCache.h"
+#include "SvnPropertyCache.h"
 
 #include "commandline/CommandLineParser.h"
 
 SvnRevision::SvnRevision(int revision, svn_fs_t* f, apr_pool_t* parent_pool) : 
     pool(parent_pool), 
+    blobReader(NULL),
+    nodeCache(NULL),
     fs(f), 
     fs_root(0), 
     revnum(revision), 
-    propsFetched(false)
+    changesFetched(false),
+    propsFetched(false),
+    needCommit(false)
 {
     ruledebug = CommandLineParser::instance()->contains( QLatin1String("debug-rules"));
 }
@@ -50,104 +57,296 @@ int SvnRevision::open()
     return EXIT_SUCCESS;
 }
 
-void SvnRevision::splitPathName(const RuleMatch& rule, const QString& pathName, QString* svnprefix_p, QString* repository_p, QString* effectiveRepository_p, QString* branch_p, QString* path_p)
+void SvnRevision::setChangeset(const SvnChangeset& prefetched)
 {
-    QString svnprefix = pathName;
-    svnprefix.truncate(rule.rx.matchedLength());
+    Q_ASSERT(prefetched.revision() == revnum);
+    changeset = prefetched;
+    changesFetched = true;
+}
+
+int SvnRevision::fetchChanges()
+{
+    if (changesFetched)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    SVN_INT_ERR(changeset.fetch(fs, revnum, pool));
+    changesFetched = true;
+
+    return EXIT_SUCCESS;
+}
+
+bool SvnRevision::wasDir(int rev, const char* pathname, apr_pool_t* pool)
+{
+    bool isDir;
+    
+    if (changeset.knownIsDir(rev, pathname, &isDir))
+    {
+        return isDir;
+    }
+
+    if (nodeCache)
+    {
+        return nodeCache->isDir(rev, pathname, pool);
+    }
+
+    return SvnHelper::wasDir(fs, rev, pathname, pool);
+}
+
+void SvnRevision::splitPathName(const RuleMatch& rule, int matchedLength, const QString& pathName, QString* svnprefix_p, QString* repository_p, QString* effectiveRepository_p, QString* branch_p, QString* path_p)
+{
+    const QString svnprefix = pathName.left(matchedLength);
 
     if (svnprefix_p) 
     {
         *svnprefix_p = svnprefix;
     }
 
-    if (repository_p) 
+    // all the files of a branch share the svnprefix, resolve it once
+    QHash<QString, SplitPrefix>& resolved = splitPrefixes[&rule];
+    QHash<QString, SplitPrefix>::ConstIterator it = resolved.constFind(svnprefix);
+
+    if (it == resolved.constEnd()) 
     {
-        *repository_p = svnprefix;
-        repository_p->replace(rule.rx, rule.repository);
+        SplitPrefix split;
+
+        split.repository = svnprefix;
+        rule.compiled.replace(split.repository, rule.repository);
         
         foreach (RuleMatchSubstitution subst, rule.repo_substs) 
         {
-            subst.apply(*repository_p);
+            subst.apply(split.repository);
         }
-    }
 
-    if (effectiveRepository_p) 
-    {
-        *effectiveRepository_p = svnprefix;
-        effectiveRepository_p->replace(rule.rx, rule.repository);
+        split.effectiveRepository = split.repository;
+        GitRepository *repository = repositories.value(split.repository, 0);
         
-        foreach (RuleMatchSubstitution subst, rule.repo_substs) 
+        if (repository) 
         {
-            subst.apply(*effectiveRepository_p);
+            split.effectiveRepository = repository->getEffectiveRepository()->getName();
         }
+
+        split.branch = svnprefix;
+        rule.compiled.replace(split.branch, rule.branch);
         
-        GitRepository *repository = repositories.value(*effectiveRepository_p, 0);
-        
-        if (repository) 
+        foreach (RuleMatchSubstitution subst, rule.branch_substs) 
         {
-            *effectiveRepository_p = repository->getEffectiveRepository()->getName();
+            subst.apply(split.branch);
         }
+
+        split.prefix = svnprefix;
+        rule.compiled.replace(split.prefix, rule.prefix);
+
+        it = resolved.insert(svnprefix, split);
+    }
+
+    if (repository_p) 
+    {
+        *repository_p = it->repository;
+    }
+
+    if (effectiveRepository_p) 
+    {
+        *effectiveRepository_p = it->effectiveRepository;
     }
 
     if (branch_p) 
     {
-        *branch_p = svnprefix;
-        branch_p->replace(rule.rx, rule.branch);
-        
-        foreach (RuleMatchSubstitution subst, rule.branch_substs) 
-        {
-            subst.apply(*branch_p);
-        }
+        *branch_p = it->branch;
     }
 
     if (path_p) 
     {
-        QString prefix = svnprefix;
-        prefix.replace(rule.rx, rule.prefix);
-        *path_p = prefix + pathName.mid(svnprefix.length());
+        *path_p = it->prefix + pathName.mid(svnprefix.length());
     }
 }
 
-int SvnRevision::prepareTransactions()
+int SvnRevision::dumpDir(GitRepositoryTransaction* txn, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
 {
-    // find out what was changed in this revision:
-    apr_hash_t *changes;
-    SVN_INT_ERR(svn_fs_paths_changed2(&changes, fs_root, pool));
+    if (blobReader)
+    {
+        return blobReader->dumpDir(txn, fs_root, pathname, finalPathName, pool);
+    }
+
+    return SvnHelper::recursiveDumpDir(txn, fs_root, pathname, finalPathName, pool);
+}
+
+int SvnRevision::dumpDirChanges(GitRepositoryTransaction* txn, int baseRevision, const QByteArray& basePath, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
+{
+    svn_fs_root_t* base_root;
+
+    // the recursion asks the cache for other revisions too
+    SvnRootPin pin(nodeCache);
+    
+    if (nodeCache)
+    {
+        SVN_INT_ERR(pin.pin(&base_root, baseRevision));
+    }
+    else
+    {
+        SVN_INT_ERR(svn_fs_revision_root(&base_root, fs, baseRevision, pool));
+    }
+
+    return dumpDirChanges(txn, base_root, basePath, pathname, finalPathName, pool);
+}
+
+int SvnRevision::dumpDirChanges(GitRepositoryTransaction* txn, svn_fs_root_t* base_root, const QByteArray& basePath, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool)
+{
+    apr_hash_t* entries;
+    apr_hash_t* baseEntries;
+    SVN_INT_ERR(svn_fs_dir_entries(&entries, fs_root, pathname, pool));
+    SVN_INT_ERR(svn_fs_dir_entries(&baseEntries, base_root, basePath, pool));
+    AprAutoPool dirpool(pool);
+
+    // sorted, like recursiveDumpDir
+    QMap<QByteArray, svn_fs_dirent_t*> map;
+    QMap<QByteArray, svn_fs_dirent_t*> baseMap;
+    
+    for (apr_hash_index_t *i = apr_hash_first(pool, entries); i; i = apr_hash_next(i)) 
+    {
+        const void *vkey;
+        void *value;
+        apr_hash_this(i, &vkey, NULL, &value);
+        svn_fs_dirent_t *dirent = reinterpret_cast<svn_fs_dirent_t *>(value);
+        map.insert(QByteArray(dirent->name), dirent);
+    }
 
-    QMap<QByteArray, svn_fs_path_change2_t*> map;
-    for (apr_hash_index_t *i = apr_hash_first(pool, changes); i; i = apr_hash_next(i)) 
+    for (apr_hash_index_t *i = apr_hash_first(pool, baseEntries); i; i = apr_hash_next(i)) 
     {
         const void *vkey;
         void *value;
         apr_hash_this(i, &vkey, NULL, &value);
-        const char *key = reinterpret_cast<const char *>(vkey);
-        svn_fs_path_change2_t *change = reinterpret_cast<svn_fs_path_change2_t *>(value);
-        // If we mix path deletions with path adds/replaces we might erase a
-        // branch after that it has been reset -> history truncated
+        svn_fs_dirent_t *dirent = reinterpret_cast<svn_fs_dirent_t *>(value);
+        baseMap.insert(QByteArray(dirent->name), dirent);
+    }
+
+    // whatever is gone, or is no longer of the same kind
+    QMapIterator<QByteArray, svn_fs_dirent_t*> b(baseMap);
+    
+    while (b.hasNext()) 
+    {
+        b.next();
+        const svn_fs_dirent_t* entry = map.value(b.key());
         
-        if (map.contains(QByteArray(key))) 
+        if (!entry || entry->kind != b.value()->kind)
         {
-            // If the same path is deleted and added, we need to put the
-            // deletions into the map first, then the addition.
-            if (change->change_kind == svn_fs_path_change_delete) 
-            {
-                // XXX
-            }
-            
-            fprintf(stderr, "\nDuplicate key found in rev %d: %s\n", revnum, key);
-            fprintf(stderr, "This needs more code to be handled, file a bug report\n");
-            fflush(stderr);
-            exit(1);
+            txn->deleteFile(finalPathName + QString::fromUtf8(b.key()) + (b.value()->kind == svn_node_dir ? "/" : ""));
         }
-        map.insertMulti(QByteArray(key), change);
     }
 
-    QMapIterator<QByteArray, svn_fs_path_change2_t*> i(map);
+    QMapIterator<QByteArray, svn_fs_dirent_t*> i(map);
     
     while (i.hasNext()) 
     {
+        dirpool.clear();
         i.next();
-        if (exportEntry(i.key(), i.value(), changes) == EXIT_FAILURE)
+        const svn_fs_dirent_t* entry = i.value();
+        const svn_fs_dirent_t* baseEntry = baseMap.value(i.key());
+        QByteArray entryName = pathname + '/' + i.key();
+        QByteArray baseEntryName = basePath + '/' + i.key();
+        QString entryFinalName = finalPathName + QString::fromUtf8(i.key());
+
+        if (baseEntry && baseEntry->kind != entry->kind)
+        {
+            baseEntry = NULL;
+        }
+
+        // the very same node revision, nothing in it can differ
+        if (baseEntry && svn_fs_compare_ids(baseEntry->id, entry->id) == 0)
+        {
+            continue;
+        }
+
+        if (entry->kind == svn_node_dir) 
+        {
+            entryFinalName += '/';
+            int result = baseEntry ? dumpDirChanges(txn, base_root, baseEntryName, entryName, entryFinalName, dirpool)
+                                   : dumpDir(txn, entryName, entryFinalName, dirpool);
+            
+            if (result == EXIT_FAILURE)
+            {
+                return EXIT_FAILURE;
+            }
+        } 
+        else if (entry->kind == svn_node_file) 
+        {
+            if (baseEntry) 
+            {
+                svn_boolean_t different;
+                SVN_INT_ERR(svn_fs_contents_different(&different, base_root, baseEntryName, fs_root, entryName, dirpool));
+                
+                if (!different)
+                {
+                    // the properties decide the mode
+                    SVN_INT_ERR(svn_fs_props_different(&different, base_root, baseEntryName, fs_root, entryName, dirpool));
+                }
+                
+                if (!different)
+                {
+                    continue;
+                }
+            }
+
+            printf("+");
+            fflush(stdout);
+            
+            if (SvnHelper::dumpBlob(txn, fs_root, entryName, entryFinalName, dirpool) == EXIT_FAILURE)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+bool SvnRevision::sameRuleBefore(const RuleMatch& rule, const RuleMatcher& matchRules, const QString& current) const
+{
+    if (rule.minRevision > revnum - 1)
+    {
+        return false;
+    }
+
+    // an earlier rule that ended with the previous revision may have taken the path then
+    QVarLengthArray<int, 64> candidates;
+    matchRules.candidates(current, &candidates);
+
+    for (int i = 0; i < candidates.size(); ++i) 
+    {
+        QList<RuleMatch>::ConstIterator it = matchRules.rules().constBegin() + candidates[i];
+
+        if (&*it == &rule)
+        {
+            return true;
+        }
+
+        if (it->maxRevision == revnum - 1 && it->minRevision <= revnum - 1 && it->compiled.matchAtStart(current) >= 0)
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+int SvnRevision::prepareTransactions()
+{
+    // find out what was changed in this revision:
+    if (fetchChanges() != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // later revisions ask about the paths this one touched
+    if (nodeCache)
+    {
+        nodeCache->addKinds(changeset.knownKinds());
+    }
+
+    foreach (const SvnChange& change, changeset.changes()) 
+    {
+        if (exportEntry(change) == EXIT_FAILURE)
         {
             return EXIT_FAILURE;
         }
@@ -163,33 +362,24 @@ int SvnRevision::fetchRevProps()
         return EXIT_SUCCESS;
     }
 
-    apr_hash_t* revprops;
-    SVN_INT_ERR(svn_fs_revision_proplist(&revprops, fs, revnum, pool));
-    svn_string_t* svnauthor = (svn_string_t*)apr_hash_get(revprops, "svn:author", APR_HASH_KEY_STRING);
-    svn_string_t* svndate = (svn_string_t*)apr_hash_get(revprops, "svn:date", APR_HASH_KEY_STRING);
-    svn_string_t* svnlog = (svn_string_t*)apr_hash_get(revprops, "svn:log", APR_HASH_KEY_STRING);
-
-    if (svnlog)
-    {
-        log = svnlog->data;
-    }
-    else
+    if (fetchChanges() != EXIT_SUCCESS)
     {
-        log.clear();
+        return EXIT_FAILURE;
     }
-    
-    authorident = svnauthor ? identities.value(svnauthor->data) : QByteArray();
-    epoch = svndate ? SvnHelper::getEpoch(svndate->data) : 0;
+
+    log = changeset.log;
+    authorident = !changeset.author.isNull() ? identities.value(changeset.author) : QByteArray();
+    epoch = !changeset.date.isNull() ? SvnHelper::getEpoch(changeset.date) : 0;
     
     if (authorident.isEmpty()) 
     {
-        if (!svnauthor || svn_string_isempty(svnauthor))
+        if (changeset.author.isEmpty())
         {
             authorident = "nobody <nobody@localhost>";
         }
         else
         {
-            authorident = svnauthor->data + QByteArray(" <") + svnauthor->data + QByteArray("@") + userdomain.toUtf8() + QByteArray(">");
+            authorident = changeset.author + QByteArray(" <") + changeset.author + QByteArray("@") + userdomain.toUtf8() + QByteArray(">");
         }
     }
     
@@ -224,28 +414,21 @@ int SvnRevision::commit()
     return EXIT_SUCCESS;
 }
 
-int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* change, apr_hash_t* changes)
+int SvnRevision::exportEntry(const SvnChange& change)
 {
     AprAutoPool revpool(pool.data());
+    const char* key = change.path.constData();
     QString current = QString::fromUtf8(key);
 
     // was this copied from somewhere?
-    svn_revnum_t rev_from = SVN_INVALID_REVNUM;
-    const char *path_from = NULL;
-    
-    if (change->change_kind != svn_fs_path_change_delete) 
-    {
-        // svn_fs_copied_from would fail on deleted paths, because the path
-        // obviously no longer exists in the current revision
-        SVN_INT_ERR(svn_fs_copied_from(&rev_from, &path_from, fs_root, key, revpool));
-    }
+    svn_revnum_t rev_from = change.copyFromRev;
+    const char *path_from = change.copyFromPath.isNull() ? NULL : change.copyFromPath.constData();
 
-    // is this a directory?
-    svn_boolean_t is_dir;
-    SVN_INT_ERR(svn_fs_is_dir(&is_dir, fs_root, key, revpool));
+    // is this a directory? deleted paths no longer exist in the current revision
+    bool is_dir = change.kind != svn_fs_path_change_delete && change.isDir;
 
     // Adding newly created directories
-    if (is_dir && change->change_kind == svn_fs_path_change_add && path_from == NULL && CommandLineParser::instance()->contains("empty-dirs")) 
+    if (is_dir && change.kind == svn_fs_path_change_add && path_from == NULL && CommandLineParser::instance()->contains("empty-dirs")) 
     {
         QString keyQString = key;
         
@@ -260,13 +443,13 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
         //qDebug() << "Adding directory:" << key;
     }
     // svn:ignore-properties
-    else if (is_dir && (change->change_kind == svn_fs_path_change_add || change->change_kind == svn_fs_path_change_modify) && path_from == NULL && CommandLineParser::instance()->contains("svn-ignore")) 
+    else if (is_dir && (change.kind == svn_fs_path_change_add || change.kind == svn_fs_path_change_modify) && path_from == NULL && CommandLineParser::instance()->contains("svn-ignore")) 
     {
         needCommit = true;
     }
     else if (is_dir) 
     {
-        if (change->change_kind == svn_fs_path_change_modify || change->change_kind == svn_fs_path_change_add) 
+        if (change.kind == svn_fs_path_change_modify || change.kind == svn_fs_path_change_add) 
         {
             if (path_from == NULL) 
             {
@@ -278,7 +461,7 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
 
             qDebug() << "   " << key << "was copied from" << path_from << "rev" << rev_from;
         } 
-        else if (change->change_kind == svn_fs_path_change_replace) 
+        else if (change.kind == svn_fs_path_change_replace) 
         {
             if (path_from == NULL)
             {
@@ -289,7 +472,7 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
                 qDebug() << "   " << key << "was replaced from" << path_from << "rev" << rev_from;
             }
         } 
-        else if (change->change_kind == svn_fs_path_change_reset) 
+        else if (change.kind == svn_fs_path_change_reset) 
         {
             qCritical() << "   " << key << "was reset, panic!";
             return EXIT_FAILURE;
@@ -297,13 +480,13 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
         else 
         {
             // if change_kind == delete, it shouldn't come into this arm of the 'is_dir' test
-            qCritical() << "   " << key << "has unhandled change kind " << change->change_kind << ", panic!";
+            qCritical() << "   " << key << "has unhandled change kind " << change.kind << ", panic!";
             return EXIT_FAILURE;
         }
     } 
-    else if (change->change_kind == svn_fs_path_change_delete) 
+    else if (change.kind == svn_fs_path_change_delete) 
     {
-        is_dir = SvnHelper::wasDir(fs, revnum - 1, key, revpool);
+        is_dir = change.isDir;
     }
 
     if (is_dir)
@@ -315,15 +498,16 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
     //Replace all returns with continue,
     bool isHandled = false;
     
-    foreach ( const QList<RuleMatch> matchRules, allMatchRules ) 
+    foreach (const RuleMatcher& matchRules, allMatchRules) 
     {
         // find the first rule that matches this pathname
-        QList<RuleMatch>::ConstIterator match = SvnHelper::findMatchRule(matchRules, revnum, current);
-        if (match != matchRules.constEnd()) 
+        int matchedLength;
+        QList<RuleMatch>::ConstIterator match = SvnHelper::findMatchRule(matchRules, revnum, current, AnyRule, &matchedLength);
+        if (match != matchRules.rules().constEnd()) 
         {
             const RuleMatch &rule = *match;
             
-            if ( exportDispatch(key, change, path_from, rev_from, changes, current, rule, matchRules, revpool) == EXIT_FAILURE )
+            if ( exportDispatch(key, change, path_from, rev_from, current, rule, matchedLength, matchRules, revpool) == EXIT_FAILURE )
             {
                 return EXIT_FAILURE;
             }
@@ -334,18 +518,18 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
         {
             qDebug() << current << "is a copy-with-history, auto-recursing";
             
-            if ( recurse(key, change, path_from, matchRules, rev_from, changes, revpool) == EXIT_FAILURE )
+            if ( recurse(key, change, path_from, matchRules, rev_from, revpool) == EXIT_FAILURE )
             {
                 return EXIT_FAILURE;
             }
             
             isHandled = true;
         } 
-        else if (is_dir && change->change_kind == svn_fs_path_change_delete) 
+        else if (is_dir && change.kind == svn_fs_path_change_delete) 
         {
             qDebug() << current << "deleted, auto-recursing";
             
-            if ( recurse(key, change, path_from, matchRules, rev_from, changes, revpool) == EXIT_FAILURE )
+            if ( recurse(key, change, path_from, matchRules, rev_from, revpool) == EXIT_FAILURE )
             {
                 return EXIT_FAILURE;
             }
@@ -358,11 +542,11 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
         return EXIT_SUCCESS;
     }
     
-    if (SvnHelper::wasDir(fs, revnum - 1, key, revpool)) 
+    if (wasDir(revnum - 1, key, revpool)) 
     {
         qDebug() << current << "was a directory; ignoring";
     } 
-    else if (change->change_kind == svn_fs_path_change_delete) 
+    else if (change.kind == svn_fs_path_change_delete) 
     {
         qDebug() << current << "is being deleted but I don't know anything about it; ignoring";
     } 
@@ -375,7 +559,7 @@ int SvnRevision::exportEntry(const char* key, const svn_fs_path_change2_t* chang
     return EXIT_SUCCESS;
 }
 
-int SvnRevision::exportDispatch(const char* key, const svn_fs_path_change2_t* change, const char* path_from, svn_revnum_t rev_from, apr_hash_t* changes, const QString& current, const RuleMatch& rule, const QList<RuleMatch>& matchRules, apr_pool_t* pool)
+int SvnRevision::exportDispatch(const char* key, const SvnChange& change, const char* path_from, svn_revnum_t rev_from, const QString& current, const RuleMatch& rule, int matchedLength, const RuleMatcher& matchRules, apr_pool_t* pool)
 {
     //if(ruledebug)
     //  qDebug() << "rev" << revnum << qPrintable(current) << "matched rule:" << rule.lineNumber << "(" << rule.rx.pattern() << ")";
@@ -395,7 +579,7 @@ int SvnRevision::exportDispatch(const char* key, const svn_fs_path_change2_t* ch
                 qDebug() << "rev" << revnum << qPrintable(current) << "matched rule:" << rule.info() << "  " << "recursing.";
             }
             
-            return recurse(key, change, path_from, matchRules, rev_from, changes, pool);
+            return recurse(key, change, path_from, matchRules, rev_from, pool);
         }
 
         case Export:
@@ -405,12 +589,12 @@ int SvnRevision::exportDispatch(const char* key, const svn_fs_path_change2_t* ch
                 qDebug() << "rev" << revnum << qPrintable(current) << "matched rule:" << rule.info() << "  " << "exporting.";
             }
         
-            if (exportInternal(key, change, path_from, rev_from, current, rule, matchRules) == EXIT_SUCCESS)
+            if (exportInternal(key, change, path_from, rev_from, current, rule, matchedLength, matchRules) == EXIT_SUCCESS)
             {
                 return EXIT_SUCCESS;
             }
             
-            if (change->change_kind != svn_fs_path_change_delete) 
+            if (change.kind != svn_fs_path_change_delete) 
             {
                 if(ruledebug)
                 {
@@ -424,7 +608,7 @@ int SvnRevision::exportDispatch(const char* key, const svn_fs_path_change2_t* ch
             // either of which is reasonably safe for deletion
             qWarning() << "WARN: deleting unknown path" << current << "; auto-recursing";
             
-            return recurse(key, change, path_from, matchRules, rev_from, changes, pool);
+            return recurse(key, change, path_from, matchRules, rev_from, pool);
         }
     }
 
@@ -432,17 +616,17 @@ int SvnRevision::exportDispatch(const char* key, const svn_fs_path_change2_t* ch
     return EXIT_FAILURE;
 }
 
-int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* change, const char* path_from, svn_revnum_t rev_from, const QString& current, const RuleMatch& rule, const QList<RuleMatch>& matchRules)
+int SvnRevision::exportInternal(const char* key, const SvnChange& change, const char* path_from, svn_revnum_t rev_from, const QString& current, const RuleMatch& rule, int matchedLength, const RuleMatcher& matchRules)
 {
     needCommit = true;
     QString svnprefix, repository, effectiveRepository, branch, path;
-    splitPathName(rule, current, &svnprefix, &repository, &effectiveRepository, &branch, &path);
+    splitPathName(rule, matchedLength, current, &svnprefix, &repository, &effectiveRepository, &branch, &path);
 
     GitRepository *repo = repositories.value(repository, 0);
     
     if (!repo) 
     {
-        if (change->change_kind != svn_fs_path_change_delete)
+        if (change.kind != svn_fs_path_change_delete)
         {
             qCritical() << "Rule" << rule << "references unknown repository" << repository;
         }
@@ -455,7 +639,7 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
 //                qDebug() << "   " << qPrintable(current) << "rev" << revnum << "->"
 //                         << qPrintable(repository) << qPrintable(branch) << qPrintable(path);
 
-    if (change->change_kind == svn_fs_path_change_delete && current == svnprefix && path.isEmpty() && !repo->hasPrefix()) 
+    if (change.kind == svn_fs_path_change_delete && current == svnprefix && path.isEmpty() && !repo->hasPrefix()) 
     {
         if(ruledebug)
         {
@@ -472,16 +656,17 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
     {
         previous = QString::fromUtf8(path_from);
         
-        if (SvnHelper::wasDir(fs, rev_from, path_from, pool.data())) 
+        if (wasDir(rev_from, path_from, pool.data())) 
         {
             previous += '/';
         }
         
-        QList<RuleMatch>::ConstIterator prevmatch = SvnHelper::findMatchRule(matchRules, rev_from, previous, NoIgnoreRule);
+        int prevMatchedLength;
+        QList<RuleMatch>::ConstIterator prevmatch = SvnHelper::findMatchRule(matchRules, rev_from, previous, NoIgnoreRule, &prevMatchedLength);
         
-        if (prevmatch != matchRules.constEnd()) 
+        if (prevmatch != matchRules.rules().constEnd()) 
         {
-            splitPathName(*prevmatch, previous, &prevsvnprefix, &prevrepository, &preveffectiverepository, &prevbranch, &prevpath);
+            splitPathName(*prevmatch, prevMatchedLength, previous, &prevsvnprefix, &prevrepository, &preveffectiverepository, &prevbranch, &prevpath);
 
         } 
         else 
@@ -550,8 +735,26 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
                     qDebug() << "Create a true SVN copy of branch (" << key << "->" << branch << path << ")";
                 }
                 
-                txn->deleteFile(path);
-                SvnHelper::recursiveDumpDir(txn, fs_root, key, path, pool);
+                // the branch was just reset to the commit of its source at rev_from,
+                // tell git what differs from it; without that commit the branch holds
+                // something else and gets the whole tree
+                if (prevrepository == repository && CommandLineParser::instance()->contains("diff-dirs") && !CommandLineParser::instance()->contains("copy-trees")
+                    && repo->hasCommitFrom(prevbranch, rev_from))
+                {
+                    if (dumpDirChanges(txn, rev_from, path_from, key, path, pool) == EXIT_FAILURE)
+                    {
+                        return EXIT_FAILURE;
+                    }
+                }
+                else
+                {
+                    txn->deleteFile(path);
+                    
+                    if (prevrepository != repository || !txn->copyTree(prevbranch, rev_from, prevpath, path))
+                    {
+                        dumpDir(txn, key, path, pool);
+                    }
+                }
             }
             
             if (rule.annotate) 
@@ -596,7 +799,7 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
         txn->noteCopyFromBranch (prevbranch, rev_from);
     }
 
-    if (change->change_kind == svn_fs_path_change_replace && path_from == NULL) 
+    if (change.kind == svn_fs_path_change_replace && path_from == NULL) 
     {
         if(ruledebug)
         {
@@ -606,7 +809,7 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
         txn->deleteFile(path);
     }
     
-    if (change->change_kind == svn_fs_path_change_delete) 
+    if (change.kind == svn_fs_path_change_delete) 
     {
         if(ruledebug)
         {
@@ -632,7 +835,7 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
         }
 
         // Check unknown svn-properties
-        if (((path_from == NULL && change->prop_mod==1) || (path_from != NULL && change->change_kind == svn_fs_path_change_add)) && CommandLineParser::instance()->contains("propcheck")) 
+        if (((path_from == NULL && change.propMod==1) || (path_from != NULL && change.kind == svn_fs_path_change_add)) && CommandLineParser::instance()->contains("propcheck")) 
         {
             if (fetchUnknownProps(pool, key, fs_root) != EXIT_SUCCESS) 
             {
@@ -643,7 +846,7 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
         int ignoreSet = false;
 
         // Add GitIgnore with svn:ignore
-        if (((path_from == NULL && change->prop_mod == 1) || (path_from != NULL && change->change_kind == svn_fs_path_change_add)) && CommandLineParser::instance()->contains("svn-ignore")) 
+        if (((path_from == NULL && change.propMod == 1) || (path_from != NULL && change.kind == svn_fs_path_change_add)) && CommandLineParser::instance()->contains("svn-ignore")) 
         {
             QString svnignore;
             
@@ -672,29 +875,64 @@ int SvnRevision::exportInternal(const char* key, const svn_fs_path_change2_t* ch
             }
         }
 
+        // a directory that is still the same branch and path as in the previous
+        // revision only needs what changed since then
+        if (CommandLineParser::instance()->contains("diff-dirs") && (change.kind == svn_fs_path_change_modify || (change.kind == svn_fs_path_change_replace && path_from != NULL))
+            && sameRuleBefore(rule, matchRules, current) && wasDir(revnum - 1, key, pool))
+        {
+            return dumpDirChanges(txn, revnum - 1, key, key, path, pool);
+        }
+
         if (ignoreSet == false) 
         {
             txn->deleteFile(path);
+
+            // a copy-with-history inside one repository can reuse the tree the source got
+            if (path_from != NULL && prevrepository == repository && txn->copyTree(prevbranch, rev_from, prevpath, path))
+            {
+                return EXIT_SUCCESS;
+            }
         }
         
-        SvnHelper::recursiveDumpDir(txn, fs_root, key, path, pool);
+        dumpDir(txn, key, path, pool);
     }
 
     return EXIT_SUCCESS;
 }
 
-int SvnRevision::recurse(const char* path, const svn_fs_path_change2_t* change, const char* path_from, const QList<RuleMatch>& matchRules, svn_revnum_t rev_from, apr_hash_t* changes, apr_pool_t* pool)
+int SvnRevision::recurse(const char* path, const SvnChange& change, const char* path_from, const RuleMatcher& matchRules, svn_revnum_t rev_from, apr_pool_t* pool)
 {
     svn_fs_root_t *fs_root = this->fs_root;
+    int rootRevision = revnum;
+
+    // exporting the entries asks the cache for other revisions too
+    SvnRootPin pin(nodeCache);
     
-    if (change->change_kind == svn_fs_path_change_delete)
+    if (change.kind == svn_fs_path_change_delete)
     {
-        SVN_INT_ERR(svn_fs_revision_root(&fs_root, fs, revnum - 1, pool));
+        rootRevision = revnum - 1;
+        
+        if (nodeCache)
+        {
+            SVN_INT_ERR(pin.pin(&fs_root, rootRevision));
+        }
+        else
+        {
+            SVN_INT_ERR(svn_fs_revision_root(&fs_root, fs, rootRevision, pool));
+        }
     }
 
     // get the dir listing
     svn_node_kind_t kind;
-    SVN_INT_ERR(svn_fs_check_path(&kind, fs_root, path, pool));
+    
+    if (nodeCache)
+    {
+        SVN_INT_ERR(nodeCache->checkPath(&kind, rootRevision, path, pool));
+    }
+    else
+    {
+        SVN_INT_ERR(svn_fs_check_path(&kind, fs_root, path, pool));
+    }
     
     if(kind == svn_node_none) 
     {
@@ -711,6 +949,11 @@ int SvnRevision::recurse(const char* path, const svn_fs_path_change2_t* change,
     SVN_INT_ERR(svn_fs_dir_entries(&entries, fs_root, path, pool));
     AprAutoPool dirpool(pool);
 
+    if (nodeCache)
+    {
+        nodeCache->addDirEntries(rootRevision, path, entries, dirpool);
+    }
+
     // While we get a hash, put it in a map for sorted lookup, so we can
     // repeat the conversions and get the same git commit hashes.
     QMap<QByteArray, svn_node_kind_t> map;
@@ -740,9 +983,9 @@ int SvnRevision::recurse(const char* path, const svn_fs_path_change2_t* change,
         }
 
         // check if this entry is in the changelist for this revision already
-        svn_fs_path_change2_t *otherchange = (svn_fs_path_change2_t*)apr_hash_get(changes, entry.constData(), APR_HASH_KEY_STRING);
+        const SvnChange *otherchange = changeset.find(entry);
         
-        if (otherchange && otherchange->change_kind == svn_fs_path_change_add) 
+        if (otherchange && otherchange->kind == svn_fs_path_change_add) 
         {
             qDebug() << entry << "rev" << revnum << "is in the change-list, deferring to that one";
             continue;
@@ -756,10 +999,11 @@ int SvnRevision::recurse(const char* path, const svn_fs_path_change2_t* change,
         }
 
         // find the first rule that matches this pathname
-        QList<RuleMatch>::ConstIterator match = SvnHelper::findMatchRule(matchRules, revnum, current);
-        if (match != matchRules.constEnd()) 
+        int matchedLength;
+        QList<RuleMatch>::ConstIterator match = SvnHelper::findMatchRule(matchRules, revnum, current, AnyRule, &matchedLength);
+        if (match != matchRules.rules().constEnd()) 
         {
-            if (exportDispatch(entry, change, entryFrom.isNull() ? 0 : entryFrom.constData(), rev_from, changes, current, *match, matchRules, dirpool) == EXIT_FAILURE)
+            if (exportDispatch(entry, change, entryFrom.isNull() ? 0 : entryFrom.constData(), rev_from, current, *match, matchedLength, matchRules, dirpool) == EXIT_FAILURE)
             {
                 return EXIT_FAILURE;
             }
@@ -770,7 +1014,7 @@ int SvnRevision::recurse(const char* path, const svn_fs_path_change2_t* change,
             {
                 qDebug() << current << "rev" << revnum << "did not match any rules; auto-recursing";
                 
-                if (recurse(entry, change, entryFrom.isNull() ? 0 : entryFrom.constData(), matchRules, rev_from, changes, dirpool) == EXIT_FAILURE)
+                if (recurse(entry, change, entryFrom.isNull() ? 0 : entryFrom.constData(), matchRules, rev_from, dirpool) == EXIT_FAILURE)
                 {
                     return EXIT_FAILURE;
                 }
@@ -816,12 +1060,13 @@ int SvnRevision::addGitIgnore(apr_pool_t* pool, const char* key, QString path, s
 int SvnRevision::fetchIgnoreProps(QString* ignore, apr_pool_t* pool, const char* key, svn_fs_root_t* fs_root)
 {
     // Get svn:ignore
-    svn_string_t* prop = NULL;
-    SVN_INT_ERR(svn_fs_node_prop(&prop, fs_root, key, "svn:ignore", pool));
+    SvnProperties props;
+    SVN_INT_ERR(SvnPropertyCache::instance()->properties(&props, fs_root, key, pool));
+    SvnProperties::ConstIterator prop = props.constFind("svn:ignore");
     
-    if (prop) 
+    if (prop != props.constEnd()) 
     {
-        *ignore = QString(prop->data);
+        *ignore = QString(prop->constData());
     } 
     else 
     {
@@ -834,19 +1079,14 @@ int SvnRevision::fetchIgnoreProps(QString* ignore, apr_pool_t* pool, const char*
 int SvnRevision::fetchUnknownProps(apr_pool_t* pool, const char* key, svn_fs_root_t* fs_root)
 {
     // Check all properties
-    apr_hash_t* table;
-    SVN_INT_ERR(svn_fs_node_proplist(&table, fs_root, key, pool));
-    apr_hash_index_t* hi;
-    void* propVal;
-    const void* propKey;
+    SvnProperties props;
+    SVN_INT_ERR(SvnPropertyCache::instance()->properties(&props, fs_root, key, pool));
     
-    for (hi = apr_hash_first(pool, table); hi; hi = apr_hash_next(hi)) 
+    for (SvnProperties::ConstIterator prop = props.constBegin(); prop != props.constEnd(); ++prop) 
     {
-        apr_hash_this(hi, &propKey, NULL, &propVal);
-        
-        if (strcmp((char*)propKey, "svn:ignore")!=0) 
+        if (prop.key() != "svn:ignore") 
         {
-            qWarning() << "WARN: Unknown svn-property" << (char*)propKey << "set to" << ((svn_string_t*)propVal)->data << "for" << key;
+            qWarning() << "WARN: Unknown svn-property" << prop.key().constData() << "set to" << prop.value().constData() << "for" << key;
         }
     }
 
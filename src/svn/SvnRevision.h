@@ -24,10 +24,13 @@
 #include <svn_fs.h>
 
 #include "AprAutoPool.h"
-#include "rules/RuleMatch.h"
+#include "SvnChangeset.h"
+#include "rules/RuleMatcher.h"
 
 class GitRepository;
 class GitRepositoryTransaction;
+class SvnBlobReader;
+class SvnNodeCache;
 
 class SvnRevision
 {
@@ -37,40 +40,64 @@ public:
     SvnRevision(int revision, svn_fs_t* f, apr_pool_t* parent_pool);
 
     int open();
+    void setChangeset(const SvnChangeset& prefetched);
+    int fetchChanges();
     int prepareTransactions();
     int fetchRevProps();
     int commit();
 
-    int exportEntry(const char* path, const svn_fs_path_change2_t* change, apr_hash_t* changes);
-    int exportDispatch(const char* path, const svn_fs_path_change2_t* change, const char* path_from, svn_revnum_t rev_from, apr_hash_t* changes, const QString& current, const RuleMatch& rule, const QList<RuleMatch>& matchRules, apr_pool_t* pool);
-    int exportInternal(const char* path, const svn_fs_path_change2_t* change, const char* path_from, svn_revnum_t rev_from, const QString& current, const RuleMatch& rule, const QList<RuleMatch>& matchRules);
-    int recurse(const char* path, const svn_fs_path_change2_t* change, const char* path_from, const QList<RuleMatch>& matchRules, svn_revnum_t rev_from, apr_hash_t* changes, apr_pool_t* pool);
+    int exportEntry(const SvnChange& change);
+    int exportDispatch(const char* path, const SvnChange& change, const char* path_from, svn_revnum_t rev_from, const QString& current, const RuleMatch& rule, int matchedLength, const RuleMatcher& matchRules, apr_pool_t* pool);
+    int exportInternal(const char* path, const SvnChange& change, const char* path_from, svn_revnum_t rev_from, const QString& current, const RuleMatch& rule, int matchedLength, const RuleMatcher& matchRules);
+    int recurse(const char* path, const SvnChange& change, const char* path_from, const RuleMatcher& matchRules, svn_revnum_t rev_from, apr_pool_t* pool);
     int addGitIgnore(apr_pool_t* pool, const char* key, QString path, svn_fs_root_t* fs_root, GitRepositoryTransaction* txn, const char* content = NULL);
     int fetchIgnoreProps(QString* ignore, apr_pool_t* pool, const char* key, svn_fs_root_t* fs_root);
     int fetchUnknownProps(apr_pool_t* pool, const char* key, svn_fs_root_t* fs_root);
     
     AprAutoPool pool;
     QHash<QString, GitRepositoryTransaction*> transactions;
-    QList<QList<RuleMatch> > allMatchRules;
+    QList<RuleMatcher> allMatchRules;
     QHash<QString, GitRepository*> repositories;
     QHash<QByteArray, QByteArray> identities;
     QString userdomain;
+    SvnBlobReader* blobReader;
+    SvnNodeCache* nodeCache;
 
     svn_fs_t* fs;
     svn_fs_root_t* fs_root;
     int revnum;
 
+    // must call fetchChanges first:
+    SvnChangeset changeset;
+
     // must call fetchRevProps first:
     QByteArray authorident;
     QByteArray log;
     uint epoch;
     bool ruledebug;
+    bool changesFetched;
     bool propsFetched;
     bool needCommit;
     
 private:
+
+    // what splitPathName makes of the svnprefix a rule matched
+    struct SplitPrefix
+    {
+        QString repository;
+        QString effectiveRepository;
+        QString branch;
+        QString prefix;
+    };
+
+    QHash<const RuleMatch*, QHash<QString, SplitPrefix> > splitPrefixes;
     
-    void splitPathName(const RuleMatch& rule, const QString& pathName, QString* svnprefix_p, QString* repository_p, QString* effectiveRepository_p, QString* branch_p, QString* path_p);
+    bool wasDir(int rev, const char* pathname, apr_pool_t* pool);
+    int dumpDir(GitRepositoryTransaction* txn, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool);
+    int dumpDirChanges(GitRepositoryTransaction* txn, int baseRevision, const QByteArray& basePath, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool);
+    int dumpDirChanges(GitRepositoryTransaction* txn, svn_fs_root_t* base_root, const QByteArray& basePath, const QByteArray& pathname, const QString& finalPathName, apr_pool_t* pool);
+    bool sameRuleBefore(const RuleMatch& rule, const RuleMatcher& matchRules, const QString& current) const;
+    void splitPathName(const RuleMatch& rule, int matchedLength, const QString& pathName, QString* svnprefix_p, QString* repository_p, QString* effectiveRepository_p, QString* branch_p, QString* path_p);
 };
 
 #endif